@@ -0,0 +1,415 @@
+/**
+ * bench.c
+ *
+ * This program benchmarks the scanning modes of sums666. It generates a
+ * synthetic wordlist, times sums666 scanning it in each mode and prints the
+ * results as CSV. Before timing anything it checks that every mode saves the
+ * same words from words.txt as the ones in sums666.txt.
+ *
+ * Author: Richard Gale
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "mycutils.h"
+
+/**
+ * This is the most arguments a mode passes to sums666.
+ */
+#define MODE_ARGS 3
+
+/**
+ * This is a way of running sums666.
+ */
+struct mode {
+    const char* name;               /* Name of the mode in the results. */
+    const char* args[MODE_ARGS];    /* The mode's arguments to sums666. */
+};
+
+/**
+ * These are the settings of the benchmark.
+ */
+struct settings {
+    char* sums666;      /* Path of the sums666 program. */
+    char* wordlist;     /* Path of the generated wordlist. */
+    uint64_t size;      /* Size of the generated wordlist in bytes. */
+    unsigned minlen;    /* Shortest generated word. */
+    unsigned maxlen;    /* Longest generated word. */
+    bool normal;        /* Whether word lengths are normally distributed. */
+    char* alphabet;     /* Chars that generated words are made of. */
+    uint64_t seed;      /* Seed of the generator. */
+    unsigned repeat;    /* Number of times each mode is timed. */
+    char* jobs;         /* Number of threads for the threaded mode. */
+    bool keep;          /* Whether to keep the generated wordlist. */
+};
+
+void print_help()
+{
+    printf( "This program benchmarks the scanning modes of sums666 on a generated wordlist.\n\n"
+            "USAGE:\n"
+            "./bench [OPTIONS]\n\n"
+            "OPTIONS:\n"
+            "  --size BYTES       Size of the generated wordlist (default 64M). K, M\n"
+            "                     and G suffixes are allowed.\n"
+            "  --min-len N        Shortest generated word (default 3).\n"
+            "  --max-len N        Longest generated word (default 12).\n"
+            "  --dist uniform|normal\n"
+            "                     Distribution of word lengths (default uniform).\n"
+            "  --alphabet CHARS   Chars words are made of (default a-z).\n"
+            "  --seed N           Seed of the generator (default 666).\n"
+            "  --repeat N         Times each mode is run; the fastest is reported\n"
+            "                     (default 3).\n"
+            "  -j N               Threads for the threaded mode (default: online CPUs).\n"
+            "  --sums666 PATH     The sums666 program (default ./sums666).\n"
+            "  --wordlist PATH    Where the wordlist is generated\n"
+            "                     (default bench_wordlist.txt).\n"
+            "  --keep             Don't delete the generated wordlist.\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function returns the next number from a xorshift64* generator.
+ */
+uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * This function returns a random length between minlen and maxlen. Normal
+ * lengths are the sum of four uniform ones, which is close enough to a bell
+ * curve centred between minlen and maxlen.
+ */
+unsigned random_len(struct settings* s, uint64_t* state)
+{
+    unsigned span = s->maxlen - s->minlen + 1;
+    unsigned i;
+    uint64_t sum;
+
+    if (!s->normal)
+        return s->minlen + next_random(state) % span;
+
+    sum = 0;
+    for (i = 0; i < 4; i++)
+        sum += next_random(state) % span;
+
+    return s->minlen + sum / 4;
+}
+
+/**
+ * This function writes a wordlist of random words to the path in the settings
+ * provided to it. It returns the number of words written and stores the
+ * number of bytes written in bytes.
+ */
+uint64_t generate(struct settings* s, uint64_t* bytes)
+{
+    FILE* fs;           /* The wordlist. */
+    bufwriter* bw;      /* The buffered writer of the wordlist. */
+    char word[4096];    /* The current word. */
+    size_t nalpha;      /* Number of chars in the alphabet. */
+    uint64_t state;     /* State of the generator. */
+    uint64_t written;   /* Number of bytes written. */
+    uint64_t words;     /* Number of words written. */
+    unsigned len;       /* Length of the current word. */
+    unsigned i;
+
+    fs = openfs(s->wordlist, "w");
+    bw = openbw(fileno(fs), 1 << 20);
+    nalpha = strlen(s->alphabet);
+    state = s->seed != 0 ? s->seed : 1;
+    written = 0;
+    words = 0;
+
+    while (written < s->size)
+    {
+        len = random_len(s, &state);
+        for (i = 0; i < len; i++)
+            word[i] = s->alphabet[next_random(&state) % nalpha];
+        word[len] = '\n';
+
+        writebw(bw, word, len + 1);
+        written += len + 1;
+        words++;
+    }
+
+    closebw(bw);
+    closefs(fs);
+
+    *bytes = written;
+    return words;
+}
+
+/**
+ * This function returns the number of lines in the file with the name
+ * provided to it, counting a last line with no newline.
+ */
+uint64_t count_lines(char* fname)
+{
+    FILE* fs;       /* The file. */
+    char* map;      /* The mapped file. */
+    size_t len;     /* Length of the mapped file. */
+    const char* p;  /* The current position in the file. */
+    const char* nl; /* The next newline. */
+    uint64_t lines; /* Number of lines. */
+
+    fs = openfs(fname, "r");
+    lines = 0;
+
+    if ((map = mapfs(fs, &len)) != NULL)
+    {
+        for (p = map; (nl = memchr(p, '\n', map + len - p)) != NULL; p = nl + 1)
+            lines++;
+        if (p < map + len)
+            lines++;
+        unmapfs(map, len);
+    }
+
+    closefs(fs);
+
+    return lines;
+}
+
+/**
+ * This function returns true if the two files with the names provided to it
+ * hold the same bytes.
+ */
+bool same_files(char* a, char* b)
+{
+    FILE* afs;
+    FILE* bfs;
+    char* amap;
+    char* bmap;
+    size_t alen;
+    size_t blen;
+    bool same;
+
+    afs = openfs(a, "r");
+    bfs = openfs(b, "r");
+    amap = mapfs(afs, &alen);
+    bmap = mapfs(bfs, &blen);
+
+    same = alen == blen && (alen == 0 || memcmp(amap, bmap, alen) == 0);
+
+    unmapfs(amap, alen);
+    unmapfs(bmap, blen);
+    closefs(afs);
+    closefs(bfs);
+
+    return same;
+}
+
+/**
+ * This function runs sums666 in the mode provided to it on the wordlist and
+ * returns the number of nanoseconds it took. If sums666 fails the program
+ * will exit.
+ */
+uint64_t run_mode(struct settings* s, const struct mode* m,
+                                      char* wordlist, char* savefile)
+{
+    char* argv[MODE_ARGS + 5];  /* Arguments to sums666. */
+    struct timespec start;      /* When sums666 was started. */
+    pid_t pid;                  /* Process id of sums666. */
+    int status;                 /* Exit status of sums666. */
+    int argc;                   /* Number of arguments. */
+    int i;
+
+    argc = 0;
+    argv[argc++] = s->sums666;
+    argv[argc++] = "--quiet";
+    for (i = 0; i < MODE_ARGS && m->args[i] != NULL; i++)
+        argv[argc++] = (char*) m->args[i];
+    argv[argc++] = wordlist;
+    argv[argc++] = savefile;
+    argv[argc] = NULL;
+
+    fflush(stdout);
+    start_timer(&start);
+
+    if ((pid = fork()) == -1)
+    {
+        fprintf(stderr, "ERROR: In function run_mode(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        execv(s->sums666, argv);
+        fprintf(stderr, "ERROR: Could not run %s: %s\n",
+                s->sums666, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "ERROR: sums666 failed in mode %s.\n", m->name);
+        exit(EXIT_FAILURE);
+    }
+
+    return elapsed_timer(start);
+}
+
+/**
+ * This function parses a size with an optional K, M or G suffix.
+ */
+uint64_t parse_size(const char* str)
+{
+    char* end;
+    uint64_t size;
+
+    size = strtoull(str, &end, 10);
+    switch (*end)
+    {
+        case 'K': case 'k': size <<= 10; end++; break;
+        case 'M': case 'm': size <<= 20; end++; break;
+        case 'G': case 'g': size <<= 30; end++; break;
+    }
+
+    if (end == str || *end != '\0')
+        print_help();
+
+    return size;
+}
+
+int main(int argc, char* argv[])
+{
+    struct settings s;      /* The settings of the benchmark. */
+    struct mode modes[6];   /* The modes that are benchmarked. */
+    size_t nmodes;          /* Number of modes. */
+    char jobs[16];          /* The default number of threads. */
+    char* savefile;         /* Where sums666 saves its words. */
+    uint64_t words;         /* Number of words generated. */
+    uint64_t bytes;         /* Number of bytes generated. */
+    uint64_t matches;       /* Number of words sums666 saved. */
+    uint64_t best;          /* Fastest time of the current mode. */
+    uint64_t ns;            /* Time of the current run. */
+    double secs;            /* Fastest time in seconds. */
+    bool ok;                /* Whether every mode passed verification. */
+    size_t m;               /* Index of the current mode. */
+    unsigned r;             /* Index of the current run. */
+    int opt;
+
+    const struct option longopts[] = {
+        { "size", required_argument, NULL, 'z' },
+        { "min-len", required_argument, NULL, 'n' },
+        { "max-len", required_argument, NULL, 'x' },
+        { "dist", required_argument, NULL, 'd' },
+        { "alphabet", required_argument, NULL, 'a' },
+        { "seed", required_argument, NULL, 'e' },
+        { "repeat", required_argument, NULL, 'r' },
+        { "sums666", required_argument, NULL, 'p' },
+        { "wordlist", required_argument, NULL, 'w' },
+        { "keep", no_argument, NULL, 'k' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    snprintf(jobs, sizeof(jobs), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    s = (struct settings) {
+        .sums666 = "./sums666",
+        .wordlist = "bench_wordlist.txt",
+        .size = 64 << 20,
+        .minlen = 3,
+        .maxlen = 12,
+        .normal = false,
+        .alphabet = "abcdefghijklmnopqrstuvwxyz",
+        .seed = 666,
+        .repeat = 3,
+        .jobs = jobs,
+        .keep = false
+    };
+
+    while ((opt = getopt_long(argc, argv, "hj:", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'z': s.size = parse_size(optarg); break;
+            case 'n': s.minlen = atoi(optarg); break;
+            case 'x': s.maxlen = atoi(optarg); break;
+            case 'a': s.alphabet = optarg; break;
+            case 'e': s.seed = strtoull(optarg, NULL, 10); break;
+            case 'r': s.repeat = atoi(optarg); break;
+            case 'j': s.jobs = optarg; break;
+            case 'p': s.sums666 = optarg; break;
+            case 'w': s.wordlist = optarg; break;
+            case 'k': s.keep = true; break;
+            case 'd':
+                if (strcmp(optarg, "normal") == 0)
+                    s.normal = true;
+                else if (strcmp(optarg, "uniform") != 0)
+                    print_help();
+                break;
+            default:
+                print_help();
+        }
+    }
+
+    if (optind != argc || s.minlen < 1 || s.maxlen < s.minlen
+        || s.maxlen >= 4096 || *s.alphabet == '\0' || s.repeat < 1)
+        print_help();
+
+    nmodes = 0;
+    modes[nmodes++] = (struct mode) { "readfsl", { NULL } };
+    modes[nmodes++] = (struct mode) { "mmap", { "--mmap", NULL } };
+    modes[nmodes++] = (struct mode) { "simd", { "--simd", NULL } };
+    modes[nmodes++] = (struct mode) { "stream", { "--stream", NULL } };
+    modes[nmodes++] = (struct mode) { "async", { "--async-io", NULL } };
+    modes[nmodes++] = (struct mode) { "threads", { "-j", s.jobs, NULL } };
+
+    strfmt(&savefile, "%s.out", s.wordlist);
+
+    /* Checking that every mode finds the words in sums666.txt. */
+    ok = true;
+    for (m = 0; m < nmodes; m++)
+    {
+        run_mode(&s, &modes[m], "words.txt", savefile);
+        if (!same_files(savefile, "sums666.txt"))
+        {
+            fprintf(stderr, "FAIL: mode %s doesn't match sums666.txt\n",
+                    modes[m].name);
+            ok = false;
+        }
+    }
+
+    if (!ok)
+        exit(EXIT_FAILURE);
+
+    /* Generating the wordlist. */
+    words = generate(&s, &bytes);
+
+    /* Timing each mode. */
+    printf("mode,bytes,lines,matches,seconds,mb_per_s,lines_per_s,matches_per_s\n");
+    for (m = 0; m < nmodes; m++)
+    {
+        best = UINT64_MAX;
+        for (r = 0; r < s.repeat; r++)
+        {
+            if ((ns = run_mode(&s, &modes[m], s.wordlist, savefile)) < best)
+                best = ns;
+        }
+
+        matches = count_lines(savefile);
+        secs = (double) best / NANOS_PER_SEC;
+
+        printf("%s,%llu,%llu,%llu,%.6f,%.2f,%.0f,%.0f\n",
+                modes[m].name, (unsigned long long) bytes,
+                (unsigned long long) words, (unsigned long long) matches,
+                secs, bytes / secs / (1 << 20), words / secs, matches / secs);
+    }
+
+    /* Cleaning up. */
+    remove(savefile);
+    if (!s.keep)
+        remove(s.wordlist);
+    free(savefile);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+gcc -O2 -pthread -o sums666 mycutils.h mycutils.c linesum.h linesum.c sumindex.h sumindex.c phrase.h phrase.c cipher.h cipher.c checkpoint.h checkpoint.c source.h source.c sorter.h sorter.c progress.h progress.c text.h text.c serve.h serve.c pool.h pool.c reader.h reader.c sums666.c -lz
+gcc -O2 -o bench mycutils.h mycutils.c bench.c
+
+./bench "$@"
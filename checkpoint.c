@@ -0,0 +1,142 @@
+/**
+ * checkpoint.c
+ *
+ * This file contains the definitions of the functions that make, read and
+ * check checkpoint files.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "checkpoint.h"
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void checkpoint_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function returns the FNV-1a hash of the len bytes of buf, continuing
+ * from the hash h.
+ */
+uint64_t hash_bytes(const void* buf, size_t len, uint64_t h)
+{
+    const unsigned char* b = buf;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= b[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+/**
+ * This function returns the number of bytes before offset that a checkpoint
+ * hashes.
+ */
+static uint32_t tail_length(uint64_t offset)
+{
+    return offset < CHECKPOINT_TAIL ? (uint32_t) offset : CHECKPOINT_TAIL;
+}
+
+/**
+ * This function makes a checkpoint of a wordlist that has been scanned up to
+ * offset.
+ */
+void make_checkpoint(struct checkpoint* ck, const struct stat* st,
+                     const char* map, uint64_t offset, uint64_t config)
+{
+    memset(ck, 0, sizeof(*ck));
+    memcpy(ck->magic, CHECKPOINT_MAGIC, sizeof(ck->magic));
+    ck->version = CHECKPOINT_VERSION;
+    ck->offset = offset;
+    ck->size = st->st_size;
+    ck->dev = st->st_dev;
+    ck->inode = st->st_ino;
+    ck->tail_len = tail_length(offset);
+    ck->tail_hash = hash_bytes(map + offset - ck->tail_len, ck->tail_len,
+                               HASH_SEED);
+    ck->config = config;
+}
+
+/**
+ * This function reads the checkpoint file with the name provided to it. It
+ * returns false if there is no such file or it isn't a checkpoint.
+ */
+bool read_checkpoint(const char* fname, struct checkpoint* ck)
+{
+    FILE* fs;   /* The checkpoint file. */
+    bool ok;    /* Whether a checkpoint was read. */
+
+    if ((fs = fopen(fname, "rb")) == NULL)
+        return false;
+
+    ok = fread(ck, sizeof(*ck), 1, fs) == 1
+         && memcmp(ck->magic, CHECKPOINT_MAGIC, sizeof(ck->magic)) == 0
+         && ck->version == CHECKPOINT_VERSION;
+
+    fclose(fs);
+
+    return ok;
+}
+
+/**
+ * This function writes a checkpoint to a temporary file and renames it to the
+ * file with the name provided to it.
+ */
+void write_checkpoint(const char* fname, const struct checkpoint* ck)
+{
+    FILE* fs;       /* The temporary checkpoint file. */
+    char* tmpname;  /* Name of the temporary checkpoint file. */
+
+    strfmt(&tmpname, "%s.tmp", fname);
+
+    fs = openfs(tmpname, "wb");
+    if (fwrite(ck, sizeof(*ck), 1, fs) != 1 || fflush(fs) != 0
+        || fsync(fileno(fs)) != 0)
+        checkpoint_error("write_checkpoint", strerror(errno));
+    closefs(fs);
+
+    if (rename(tmpname, fname) != 0)
+        checkpoint_error("write_checkpoint", strerror(errno));
+
+    free(tmpname);
+}
+
+/**
+ * This function returns the offset that a scan of the wordlist can resume
+ * from, or 0 if the checkpoint can't be trusted.
+ */
+uint64_t resume_checkpoint(const struct checkpoint* ck, const struct stat* st,
+                           const char* map, uint64_t config)
+{
+    /* The wordlist must be the same file, searched the same way. */
+    if (ck->dev != (uint64_t) st->st_dev || ck->inode != (uint64_t) st->st_ino
+        || ck->config != config)
+        return 0;
+
+    /* It can only have grown since the checkpoint. */
+    if ((uint64_t) st->st_size < ck->size || ck->offset > ck->size
+        || ck->tail_len != tail_length(ck->offset))
+        return 0;
+
+    /* The bytes before the checkpoint must not have been rewritten. */
+    if (hash_bytes(map + ck->offset - ck->tail_len, ck->tail_len, HASH_SEED)
+        != ck->tail_hash)
+        return 0;
+
+    return ck->offset;
+}
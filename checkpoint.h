@@ -0,0 +1,96 @@
+/**
+ * checkpoint.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for checkpoint files. A checkpoint records how much of a
+ * wordlist has been scanned, so when more words are appended to the wordlist
+ * the next scan only has to read the new ones.
+ *
+ * A checkpoint is only trusted if the wordlist is the same file (same device
+ * and inode), is at least as long as it was, still holds the same bytes just
+ * before the checkpoint, and is being searched for the same targets with the
+ * same ciphers.
+ *
+ * All integers are stored in the byte order of the machine that wrote the
+ * checkpoint.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+/**
+ * These identify a checkpoint file and the version of its layout.
+ */
+#define CHECKPOINT_MAGIC "SUMS666C"
+#define CHECKPOINT_VERSION 1
+
+/**
+ * This is the most bytes before the checkpoint that are hashed to check that
+ * the scanned part of the wordlist hasn't changed.
+ */
+#define CHECKPOINT_TAIL 4096
+
+/**
+ * This is the starting value of hash_bytes().
+ */
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+/**
+ * This is a checkpoint file.
+ */
+struct checkpoint {
+    char magic[8];      /* CHECKPOINT_MAGIC, without its null character. */
+    uint32_t version;   /* CHECKPOINT_VERSION. */
+    uint32_t tail_len;  /* Number of bytes hashed before offset. */
+    uint64_t offset;    /* Offset of the first byte that hasn't been scanned. */
+    uint64_t size;      /* Size of the wordlist when it was scanned. */
+    uint64_t dev;       /* Device that the wordlist is on. */
+    uint64_t inode;     /* Inode of the wordlist. */
+    uint64_t tail_hash; /* Hash of the tail_len bytes before offset. */
+    uint64_t config;    /* Hash of the targets and ciphers. */
+};
+
+/**
+ * This function returns the FNV-1a hash of the len bytes of buf, continuing
+ * from the hash h. Start with HASH_SEED.
+ */
+uint64_t hash_bytes(const void* buf, size_t len, uint64_t h);
+
+/**
+ * This function makes a checkpoint of a wordlist whose file status is st and
+ * whose contents are map, which has been scanned up to offset. config is the
+ * hash of the targets and ciphers it was searched for.
+ */
+void make_checkpoint(struct checkpoint* ck, const struct stat* st,
+                     const char* map, uint64_t offset, uint64_t config);
+
+/**
+ * This function reads the checkpoint file with the name provided to it into
+ * ck. It returns false if there is no such file or it isn't a checkpoint.
+ */
+bool read_checkpoint(const char* fname, struct checkpoint* ck);
+
+/**
+ * This function writes ck to the checkpoint file with the name provided to
+ * it. The checkpoint is written to a temporary file that is then renamed, so
+ * a run that is interrupted never leaves half a checkpoint. If an error
+ * occurs the program will exit.
+ */
+void write_checkpoint(const char* fname, const struct checkpoint* ck);
+
+/**
+ * This function returns the offset that a scan of the wordlist whose file
+ * status is st and whose contents are map can resume from, or 0 if the
+ * checkpoint can't be trusted and the whole wordlist must be scanned.
+ */
+uint64_t resume_checkpoint(const struct checkpoint* ck, const struct stat* st,
+                           const char* map, uint64_t config);
+
+#endif // CHECKPOINT_H
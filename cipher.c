@@ -0,0 +1,421 @@
+/**
+ * cipher.c
+ *
+ * This file contains the definitions of the built-in ciphers and of the
+ * functions that sum words with them.
+ *
+ * The tables of the built-in ciphers are generated by the preprocessor, so
+ * they are built when the program is compiled and summing a byte is one load
+ * and one add.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "cipher.h"
+
+/**
+ * These expand f once for each byte value, which generates a 256 entry table
+ * at compile time.
+ */
+#define TABLE4(f, b)    f(b), f((b) + 1), f((b) + 2), f((b) + 3)
+#define TABLE16(f, b)   TABLE4(f, b), TABLE4(f, (b) + 4), \
+                        TABLE4(f, (b) + 8), TABLE4(f, (b) + 12)
+#define TABLE64(f, b)   TABLE16(f, b), TABLE16(f, (b) + 16), \
+                        TABLE16(f, (b) + 32), TABLE16(f, (b) + 48)
+#define TABLE256(f)     TABLE64(f, 0), TABLE64(f, 64), \
+                        TABLE64(f, 128), TABLE64(f, 192)
+
+/**
+ * This is the value of a byte as sums666() sums it: its decimal ascii value,
+ * as the platform's char type holds it.
+ */
+#define ASCII(b) ((int) (char) (b))
+
+/**
+ * This is the position of a letter in the English alphabet (a=1 to z=26),
+ * in either case.
+ */
+#define ORDINAL(b)  ((b) >= 'a' && (b) <= 'z' ? (b) - 'a' + 1 : \
+                     (b) >= 'A' && (b) <= 'Z' ? (b) - 'A' + 1 : 0)
+
+/**
+ * This is the English gematria value of a letter (a=6, b=12, ... z=156).
+ */
+#define GEMATRIA(b) (6 * ORDINAL(b))
+
+/**
+ * This is a value of nothing, for the ascii chars of the ciphers of other
+ * alphabets.
+ */
+#define NOTHING(b) 0
+
+/**
+ * This is the code point of an ascii char, which is used by the codepoints
+ * cipher.
+ */
+#define CODEPOINT(b) ((b) < 0x80 ? (b) : 0)
+
+/**
+ * These are the isopsephy values of the Hebrew letters (Mispar hechrechi),
+ * with final forms valued as their ordinary forms.
+ */
+static const int16_t hebrew_cp[CIPHER_CODE_POINTS] = {
+    [0x5D0] = 1,    [0x5D1] = 2,    [0x5D2] = 3,    [0x5D3] = 4,
+    [0x5D4] = 5,    [0x5D5] = 6,    [0x5D6] = 7,    [0x5D7] = 8,
+    [0x5D8] = 9,    [0x5D9] = 10,   [0x5DA] = 20,   [0x5DB] = 20,
+    [0x5DC] = 30,   [0x5DD] = 40,   [0x5DE] = 40,   [0x5DF] = 50,
+    [0x5E0] = 50,   [0x5E1] = 60,   [0x5E2] = 70,   [0x5E3] = 80,
+    [0x5E4] = 80,   [0x5E5] = 90,   [0x5E6] = 90,   [0x5E7] = 100,
+    [0x5E8] = 200,  [0x5E9] = 300,  [0x5EA] = 400
+};
+
+/**
+ * These are the isopsephy values of the Greek letters, in both cases and
+ * with tonos and dialytika, and of the archaic numeral letters.
+ */
+static const int16_t greek_cp[CIPHER_CODE_POINTS] = {
+    /* Capitals. */
+    [0x391] = 1,    [0x392] = 2,    [0x393] = 3,    [0x394] = 4,
+    [0x395] = 5,    [0x396] = 7,    [0x397] = 8,    [0x398] = 9,
+    [0x399] = 10,   [0x39A] = 20,   [0x39B] = 30,   [0x39C] = 40,
+    [0x39D] = 50,   [0x39E] = 60,   [0x39F] = 70,   [0x3A0] = 80,
+    [0x3A1] = 100,  [0x3A3] = 200,  [0x3A4] = 300,  [0x3A5] = 400,
+    [0x3A6] = 500,  [0x3A7] = 600,  [0x3A8] = 700,  [0x3A9] = 800,
+    [0x386] = 1,    [0x388] = 5,    [0x389] = 8,    [0x38A] = 10,
+    [0x38C] = 70,   [0x38E] = 400,  [0x38F] = 800,  [0x3AA] = 10,
+    [0x3AB] = 400,
+
+    /* Small letters. */
+    [0x3B1] = 1,    [0x3B2] = 2,    [0x3B3] = 3,    [0x3B4] = 4,
+    [0x3B5] = 5,    [0x3B6] = 7,    [0x3B7] = 8,    [0x3B8] = 9,
+    [0x3B9] = 10,   [0x3BA] = 20,   [0x3BB] = 30,   [0x3BC] = 40,
+    [0x3BD] = 50,   [0x3BE] = 60,   [0x3BF] = 70,   [0x3C0] = 80,
+    [0x3C1] = 100,  [0x3C2] = 200,  [0x3C3] = 200,  [0x3C4] = 300,
+    [0x3C5] = 400,  [0x3C6] = 500,  [0x3C7] = 600,  [0x3C8] = 700,
+    [0x3C9] = 800,  [0x3AC] = 1,    [0x3AD] = 5,    [0x3AE] = 8,
+    [0x3AF] = 10,   [0x3CC] = 70,   [0x3CD] = 400,  [0x3CE] = 800,
+    [0x3CA] = 10,   [0x3CB] = 400,  [0x390] = 10,   [0x3B0] = 400,
+
+    /* Digamma, stigma, koppa and sampi. */
+    [0x3DA] = 6,    [0x3DB] = 6,    [0x3DC] = 6,    [0x3DD] = 6,
+    [0x3D8] = 90,   [0x3D9] = 90,   [0x3DE] = 90,   [0x3DF] = 90,
+    [0x3E0] = 900,  [0x3E1] = 900
+};
+
+/**
+ * These are the built-in ciphers.
+ */
+static const struct cipher ciphers[] = {
+    { "ascii",      { TABLE256(ASCII) },     NULL,      false, false },
+    { "ordinal",    { TABLE256(ORDINAL) },   NULL,      false, true },
+    { "gematria",   { TABLE256(GEMATRIA) },  NULL,      false, true },
+    { "hebrew",     { TABLE256(NOTHING) },   hebrew_cp, false, true },
+    { "greek",      { TABLE256(NOTHING) },   greek_cp,  false, true },
+    { "codepoints", { TABLE256(CODEPOINT) }, NULL,      true,  true }
+};
+
+/**
+ * This is the number of bytes cipher_sum_max() sums between checking whether
+ * the sum has gone over its bound.
+ */
+#define BOUND_STEP 32
+
+/**
+ * This function returns the built-in cipher with the name provided to it, or
+ * NULL if there is no such cipher.
+ */
+const struct cipher* find_cipher(const char* name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(ciphers) / sizeof(ciphers[0]); i++)
+    {
+        if (strcmp(ciphers[i].name, name) == 0)
+            return &ciphers[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * This function returns the ascii cipher, which matches sums666().
+ */
+const struct cipher* ascii_cipher()
+{
+    return &ciphers[0];
+}
+
+/**
+ * This function returns the codepoints cipher.
+ */
+const struct cipher* codepoint_cipher()
+{
+    return &ciphers[5];
+}
+
+/**
+ * This function reads a cipher from the file with the name provided to it.
+ * The file holds 256 integers, which are the values of bytes 0 to 255.
+ */
+struct cipher* read_cipher(char* fname)
+{
+    struct cipher* c;   /* The cipher. */
+    FILE* fs;           /* The cipher file. */
+    const char* base;   /* The file name without its directories. */
+    const char* ext;    /* The extension of the file name, or its end. */
+    char* name;         /* The name of the cipher. */
+    char sep;           /* A separator between values. */
+    int i;
+
+    fs = openfs(fname, "r");
+
+    /* Naming the cipher after the file. */
+    base = (base = strrchr(fname, '/')) != NULL ? base + 1 : fname;
+    if ((ext = strrchr(base, '.')) == NULL || ext == base)
+        ext = base + strlen(base);
+    strfmt(&name, "%.*s", (int) (ext - base), base);
+
+    if ((c = calloc(1, sizeof(struct cipher))) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function read_cipher(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    c->name = name;
+    c->cp = NULL;
+    c->unicode = false;
+    c->nonnegative = true;
+
+    /* Reading the values. */
+    for (i = 0; i < 256; i++)
+    {
+        if (fscanf(fs, " %d", &c->bytes[i]) != 1)
+        {
+            fprintf(stderr, "ERROR: Cipher file %s holds %d values, "
+                            "it needs 256.\n", fname, i);
+            exit(EXIT_FAILURE);
+        }
+        if (c->bytes[i] < 0)
+            c->nonnegative = false;
+
+        /* Skipping a comma. */
+        if (fscanf(fs, " %c", &sep) == 1 && sep != ',')
+            ungetc(sep, fs);
+    }
+
+    closefs(fs);
+
+    return c;
+}
+
+/**
+ * This function returns true if the byte provided to it is a UTF-8
+ * continuation byte.
+ */
+static inline bool is_cont(unsigned char b)
+{
+    return (b & 0xC0) == 0x80;
+}
+
+/**
+ * This function decodes the UTF-8 char at word[i], storing its code point in
+ * cp and returning its length in bytes. A byte that doesn't start a valid
+ * char (including overlong encodings and surrogates) is decoded on its own as
+ * the Latin-1 char with the same value.
+ */
+static inline size_t decode_utf8(const unsigned char* word, size_t i,
+                                 size_t len, long* cp)
+{
+    unsigned char b = word[i];  /* The lead byte. */
+    size_t left = len - i;      /* Number of bytes left in the word. */
+    long c;                     /* The decoded code point. */
+
+    *cp = b;
+
+    if (b < 0x80)
+        return 1;
+
+    if (b >= 0xC2 && b < 0xE0 && left >= 2 && is_cont(word[i + 1]))
+    {
+        *cp = ((long) (b & 0x1F) << 6) | (word[i + 1] & 0x3F);
+        return 2;
+    }
+
+    if (b >= 0xE0 && b < 0xF0 && left >= 3
+        && is_cont(word[i + 1]) && is_cont(word[i + 2]))
+    {
+        c = ((long) (b & 0x0F) << 12) | ((long) (word[i + 1] & 0x3F) << 6)
+            | (word[i + 2] & 0x3F);
+        if (c >= 0x800 && (c < 0xD800 || c > 0xDFFF))
+        {
+            *cp = c;
+            return 3;
+        }
+    }
+
+    if (b >= 0xF0 && b < 0xF5 && left >= 4 && is_cont(word[i + 1])
+        && is_cont(word[i + 2]) && is_cont(word[i + 3]))
+    {
+        c = ((long) (b & 0x07) << 18) | ((long) (word[i + 1] & 0x3F) << 12)
+            | ((long) (word[i + 2] & 0x3F) << 6) | (word[i + 3] & 0x3F);
+        if (c >= 0x10000 && c <= 0x10FFFF)
+        {
+            *cp = c;
+            return 4;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * This function returns the value of the code point provided to it under the
+ * cipher provided to it, which must be unicode or have code point values.
+ */
+static inline long cp_value(const struct cipher* c, long cp)
+{
+    if (c->unicode)
+        return cp;
+    if (cp < 0x80)
+        return c->bytes[cp];
+    if (cp < CIPHER_CODE_POINTS)
+        return c->cp[cp];
+
+    return 0;
+}
+
+/**
+ * This function returns the sum of the len chars starting at word under the
+ * cipher provided to it.
+ */
+long cipher_sum(const struct cipher* c, const char* word, size_t len)
+{
+    const unsigned char* w = (const unsigned char*) word;
+    long sum = 0;   /* Sum of the word. */
+    long cp;        /* A code point. */
+    size_t i;
+
+    if (c->cp == NULL && !c->unicode)
+    {
+        for (i = 0; i < len; i++)
+            sum += c->bytes[w[i]];
+
+        return sum;
+    }
+
+    for (i = 0; i < len; )
+    {
+        i += decode_utf8(w, i, len, &cp);
+        sum += cp_value(c, cp);
+    }
+
+    return sum;
+}
+
+/**
+ * This function returns the sum of a word under the cipher provided to it,
+ * stopping once it can't come back down to max.
+ */
+long cipher_sum_max(const struct cipher* c, const char* word, size_t len,
+                                                            long max)
+{
+    const unsigned char* w = (const unsigned char*) word;
+    long sum = 0;   /* Sum of the word so far. */
+    long cp;        /* A code point. */
+    size_t i;       /* Position in the word. */
+    size_t stop;    /* End of the current step. */
+
+    if (!c->nonnegative && c != ascii_cipher())
+        return cipher_sum(c, word, len);
+
+    if (c->cp != NULL || c->unicode)
+    {
+        for (i = 0; i < len && sum <= max; )
+        {
+            i += decode_utf8(w, i, len, &cp);
+            sum += cp_value(c, cp);
+        }
+
+        return sum;
+    }
+
+    for (i = 0; i < len; )
+    {
+        stop = len - i > BOUND_STEP ? i + BOUND_STEP : len;
+        while (i < stop)
+            sum += c->bytes[w[i++]];
+
+        if (sum > max && i < len)
+        {
+            if (c->nonnegative || is_ascii(word + i, len - i))
+                return sum;
+
+            /* Bytes over 127 could bring the sum back down. */
+            return sum + cipher_sum(c, word + i, len - i);
+        }
+    }
+
+    return sum;
+}
+
+/**
+ * This function stores the sum of the len chars starting at word under each
+ * of the n ciphers provided to it in sums, reading the word once.
+ */
+void cipher_sums(const struct cipher* const* cs, size_t n,
+                 const char* word, size_t len, long* sums)
+{
+    const unsigned char* w = (const unsigned char*) word;
+    size_t i, j, k;     /* Positions in the word and the ciphers. */
+    size_t clen;        /* Length of a char. */
+    long cp;            /* A code point. */
+
+    for (j = 0; j < n; j++)
+        sums[j] = 0;
+
+    for (i = 0; i < len; i += clen)
+    {
+        clen = decode_utf8(w, i, len, &cp);
+
+        for (j = 0; j < n; j++)
+        {
+            /* Ciphers without code points sum every byte. */
+            if (cs[j]->cp == NULL && !cs[j]->unicode)
+            {
+                for (k = i; k < i + clen; k++)
+                    sums[j] += cs[j]->bytes[w[k]];
+            }
+            else
+            {
+                sums[j] += cp_value(cs[j], cp);
+            }
+        }
+    }
+}
+
+/**
+ * This function is linesums() for the codepoints cipher, which only decodes
+ * the lines that aren't pure ascii.
+ */
+size_t codepoint_sums(const char* buf, size_t len, struct linesum* out,
+                      size_t max, size_t* consumed)
+{
+    size_t n;   /* Number of lines summed. */
+    size_t i;
+
+    n = linesums(buf, len, out, max, consumed);
+
+    /* The kernel's sums of ascii lines are their code point sums. */
+    if (is_ascii(buf, *consumed))
+        return n;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!is_ascii(buf + out[i].off, out[i].len))
+            out[i].sum = cipher_sum(codepoint_cipher(),
+                                    buf + out[i].off, out[i].len);
+    }
+
+    return n;
+}
@@ -0,0 +1,111 @@
+/**
+ * cipher.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for ciphers. A cipher gives each char a value and a word's
+ * sum is the sum of the values of its chars. The original sums666 cipher is
+ * "ascii", which gives each char its decimal ascii value.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "linesum.h"
+
+/**
+ * This is the number of code points (U+0000 to U+07FF) that a cipher can
+ * give values to. These are the code points UTF-8 encodes in one or two
+ * bytes, which covers Latin, Greek, Cyrillic, Hebrew and Arabic letters.
+ */
+#define CIPHER_CODE_POINTS 0x800
+
+/**
+ * This is a cipher.
+ */
+struct cipher {
+    const char* name;       /* Name of the cipher. */
+    int32_t bytes[256];     /* Value of each byte. */
+    const int16_t* cp;      /* Value of each code point, or NULL. */
+    bool unicode;           /* Whether each char's value is its code point. */
+    bool nonnegative;       /* Whether no char has a negative value. */
+};
+
+/**
+ * If a cipher is unicode or has code point values, words are decoded as
+ * UTF-8. A unicode cipher gives each char the value of its code point. A
+ * cipher with code point values gives ascii chars their values from bytes,
+ * code points below CIPHER_CODE_POINTS their values from cp and anything else
+ * nothing. Bytes that aren't valid UTF-8 are decoded as the Latin-1 char
+ * with the same value.
+ * Otherwise every byte of a word is given its value from bytes, which is a
+ * single table lookup per byte.
+ */
+
+/**
+ * This function returns the built-in cipher with the name provided to it
+ * ("ascii", "ordinal", "gematria", "hebrew", "greek" or "codepoints"), or
+ * NULL if there is no such cipher.
+ */
+const struct cipher* find_cipher(const char* name);
+
+/**
+ * This function returns the ascii cipher, which matches sums666().
+ */
+const struct cipher* ascii_cipher();
+
+/**
+ * This function returns the codepoints cipher, which sums the code points of
+ * UTF-8 words.
+ */
+const struct cipher* codepoint_cipher();
+
+/**
+ * This function reads a cipher from the file with the name provided to it.
+ * The file holds 256 integers, separated by whitespace or commas, which are
+ * the values of bytes 0 to 255. The cipher is named after the file. If the
+ * file can't be read the program will exit. Make sure to free() the cipher
+ * when you're finished with it.
+ */
+struct cipher* read_cipher(char* fname);
+
+/**
+ * This function returns the sum of the len chars starting at word under the
+ * cipher provided to it.
+ */
+long cipher_sum(const struct cipher* c, const char* word, size_t len);
+
+/**
+ * This function returns the sum of the len chars starting at word under the
+ * cipher provided to it, like cipher_sum(), but stops summing as soon as the
+ * rest of the word can't bring the sum back down to max, returning the sum
+ * so far, which is greater than max. This is the case once the sum is over
+ * max under a cipher with no negative values, or under the ascii cipher if
+ * the rest of the word is pure ascii (only bytes over 127 are negative).
+ */
+long cipher_sum_max(const struct cipher* c, const char* word, size_t len,
+                                                            long max);
+
+/**
+ * This function stores the sum of the len chars starting at word under each
+ * of the n ciphers provided to it in sums. The word is only read once no
+ * matter how many ciphers there are.
+ */
+void cipher_sums(const struct cipher* const* cs, size_t n,
+                 const char* word, size_t len, long* sums);
+
+/**
+ * This function is linesums() for the codepoints cipher. Lines that are pure
+ * ascii are summed by the vector kernel, whose sums are already their code
+ * point sums, and only the other lines are decoded. A batch of lines with no
+ * non-ascii bytes at all is never decoded.
+ */
+size_t codepoint_sums(const char* buf, size_t len, struct linesum* out,
+                      size_t max, size_t* consumed);
+
+#endif // CIPHER_H
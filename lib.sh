@@ -0,0 +1,6 @@
+#!/bin/bash
+
+gcc -O2 -pthread -fPIC -fvisibility=hidden -c mycutils.c linesum.c cipher.c libsums666.c
+ar rcs libsums666.a mycutils.o linesum.o cipher.o libsums666.o
+gcc -shared -pthread -o libsums666.so mycutils.o linesum.o cipher.o libsums666.o
+rm mycutils.o linesum.o cipher.o libsums666.o
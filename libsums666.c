@@ -0,0 +1,305 @@
+/**
+ * libsums666.c
+ *
+ * This file contains the definitions of the functions of libsums666. Unlike
+ * the rest of the program, these functions never print anything or exit; a
+ * scanner that can't be made is returned as NULL, with errno set if memory
+ * couldn't be allocated.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "linesum.h"
+#include "cipher.h"
+#include "libsums666.h"
+
+/**
+ * This is the number of words summed at a time.
+ */
+#define SCANNER_BATCH 1024
+
+/**
+ * This is the number of matches sums666_scan() collects before calling the
+ * callback with them.
+ */
+#define CALLBACK_BATCH 64
+
+/**
+ * This is a scanner.
+ */
+struct sums666_scanner {
+    long* targets;              /* The targets, in ascending order. */
+    size_t n;                   /* Number of targets. */
+    const struct cipher* c;     /* The cipher that words are summed with. */
+    struct cipher* own;         /* The cipher, if the scanner made it. */
+    struct linesum* sums;       /* Sums of the current batch. */
+};
+
+/**
+ * This function compares two targets for qsort() and bsearch().
+ */
+static int compare_targets(const void* a, const void* b)
+{
+    long x = *(const long*) a;
+    long y = *(const long*) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * This function returns true if the sum provided to it is one of the
+ * scanner's targets.
+ */
+static inline bool is_target(const struct sums666_scanner* s, long sum)
+{
+    if (sum < s->targets[0] || sum > s->targets[s->n - 1])
+        return false;
+
+    return s->n == 1
+        || bsearch(&sum, s->targets, s->n, sizeof(long), compare_targets);
+}
+
+/**
+ * This function is linesums() for ciphers that the vector kernels don't sum.
+ * A line stops being summed once its sum can't come back down to bound, the
+ * largest target, so its sum is only exact if it is no more than bound.
+ */
+static size_t cipher_lines(const struct cipher* c, const char* buf,
+                           size_t len, struct linesum* out, size_t max,
+                           size_t* consumed, long bound)
+{
+    const char* end = buf + len;
+    const char* line;   /* Start of the current line. */
+    const char* nl;     /* The newline that ends the current line. */
+    size_t n;           /* Number of lines summed. */
+
+    for (line = buf, n = 0; n < max; line = nl + 1, n++)
+    {
+        if ((nl = memchr(line, '\n', end - line)) == NULL)
+            break;
+
+        out[n].off = line - buf;
+        out[n].len = nl - line;
+        out[n].sum = cipher_sum_max(c, line, nl - line, bound);
+    }
+
+    *consumed = line - buf;
+
+    return n;
+}
+
+/**
+ * This function makes a scanner with the targets and cipher provided to it.
+ */
+static struct sums666_scanner* make_scanner(const long* targets, size_t n,
+                                            const struct cipher* c)
+{
+    struct sums666_scanner* s;
+    size_t i, j;
+
+    if (targets == NULL || n == 0 || c == NULL)
+        return NULL;
+
+    if ((s = calloc(1, sizeof(struct sums666_scanner))) == NULL)
+        return NULL;
+
+    s->targets = malloc(sizeof(long) * n);
+    s->sums = malloc(sizeof(struct linesum) * SCANNER_BATCH);
+    if (s->targets == NULL || s->sums == NULL)
+    {
+        sums666_close(s);
+        return NULL;
+    }
+
+    /* Sorting the targets and dropping duplicates. */
+    memcpy(s->targets, targets, sizeof(long) * n);
+    qsort(s->targets, n, sizeof(long), compare_targets);
+    for (i = 1, j = 1; i < n; i++)
+    {
+        if (s->targets[i] != s->targets[j - 1])
+            s->targets[j++] = s->targets[i];
+    }
+    s->n = j;
+    s->c = c;
+
+    return s;
+}
+
+/**
+ * This function makes a scanner with a built-in cipher.
+ */
+struct sums666_scanner* sums666_open(const long* targets, size_t n,
+                                     const char* cipher)
+{
+    return make_scanner(targets, n,
+                cipher == NULL ? ascii_cipher() : find_cipher(cipher));
+}
+
+/**
+ * This function makes a scanner with a cipher of byte values.
+ */
+struct sums666_scanner* sums666_open_values(const long* targets, size_t n,
+                                            const int32_t values[256])
+{
+    struct sums666_scanner* s;
+    struct cipher* c;
+    size_t i;
+
+    if (values == NULL || (c = calloc(1, sizeof(struct cipher))) == NULL)
+        return NULL;
+
+    c->name = "custom";
+    memcpy(c->bytes, values, sizeof(c->bytes));
+    c->cp = NULL;
+    c->unicode = false;
+    c->nonnegative = true;
+    for (i = 0; i < 256; i++)
+    {
+        if (values[i] < 0)
+            c->nonnegative = false;
+    }
+
+    if ((s = make_scanner(targets, n, c)) == NULL)
+    {
+        free(c);
+        return NULL;
+    }
+    s->own = c;
+
+    return s;
+}
+
+/**
+ * This function sums a batch of the lines in buf with the fastest kernel for
+ * the scanner's cipher.
+ */
+static inline size_t sum_batch(const struct sums666_scanner* s,
+                               const char* buf, size_t len, size_t* consumed)
+{
+    if (s->c == ascii_cipher())
+        return linesums(buf, len, s->sums, SCANNER_BATCH, consumed);
+    if (s->c == codepoint_cipher())
+        return codepoint_sums(buf, len, s->sums, SCANNER_BATCH, consumed);
+
+    return cipher_lines(s->c, buf, len, s->sums, SCANNER_BATCH, consumed,
+                        s->targets[s->n - 1]);
+}
+
+/**
+ * This function stores the words in buf that sum to a target in out.
+ */
+size_t sums666_matches(struct sums666_scanner* s, const char* buf, size_t len,
+                       bool final, struct sums666_match* out, size_t max,
+                       size_t* consumed)
+{
+    size_t pos;         /* Offset of the current batch. */
+    size_t used;        /* Bytes consumed by the current batch. */
+    size_t n;           /* Number of words in the current batch. */
+    size_t i;           /* Index of the current word in the batch. */
+    size_t count;       /* Number of matches stored. */
+    long sum;           /* Sum of the last word. */
+
+    pos = 0;
+    count = 0;
+    while ((n = sum_batch(s, buf + pos, len - pos, &used)))
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (!is_target(s, s->sums[i].sum))
+                continue;
+
+            /* Stopping at the first match that doesn't fit. */
+            if (count == max)
+            {
+                *consumed = pos + s->sums[i].off;
+                return count;
+            }
+            out[count].off = pos + s->sums[i].off;
+            out[count].len = s->sums[i].len;
+            out[count].sum = s->sums[i].sum;
+            count++;
+        }
+        pos += used;
+    }
+
+    /* The kernels leave the last word if it doesn't end with a newline. */
+    if (final && pos < len)
+    {
+        if (is_target(s, (sum = cipher_sum(s->c, buf + pos, len - pos))))
+        {
+            if (count == max)
+            {
+                *consumed = pos;
+                return count;
+            }
+            out[count].off = pos;
+            out[count].len = len - pos;
+            out[count].sum = sum;
+            count++;
+        }
+        pos = len;
+    }
+
+    *consumed = pos;
+
+    return count;
+}
+
+/**
+ * This function calls cb with each word in buf that sums to a target.
+ */
+size_t sums666_scan(struct sums666_scanner* s, const char* buf, size_t len,
+                    bool final, sums666_callback cb, void* arg)
+{
+    struct sums666_match m[CALLBACK_BATCH];     /* The current matches. */
+    size_t pos;         /* Offset of the rest of the buffer. */
+    size_t used;        /* Bytes scanned by the current call. */
+    size_t n;           /* Number of matches of the current call. */
+    size_t end;         /* Offset of the end of a word that stopped the scan. */
+    size_t i;
+
+    pos = 0;
+    do
+    {
+        n = sums666_matches(s, buf + pos, len - pos, final, m, CALLBACK_BATCH,
+                            &used);
+        for (i = 0; i < n; i++)
+        {
+            if (!cb(buf + pos + m[i].off, m[i].len, m[i].sum, arg))
+            {
+                /* The word that stopped the scan, and its newline, were
+                 * scanned. */
+                end = pos + m[i].off + m[i].len;
+                return end < len && buf[end] == '\n' ? end + 1 : end;
+            }
+        }
+        pos += used;
+    }
+    while (n == CALLBACK_BATCH);
+
+    return pos;
+}
+
+/**
+ * This function returns the sum of a word under the scanner's cipher.
+ */
+int64_t sums666_sum(const struct sums666_scanner* s, const char* word,
+                    size_t len)
+{
+    return cipher_sum(s->c, word, len);
+}
+
+/**
+ * This function frees a scanner.
+ */
+void sums666_close(struct sums666_scanner* s)
+{
+    if (s == NULL)
+        return;
+
+    free(s->own);
+    free(s->sums);
+    free(s->targets);
+    free(s);
+}
@@ -0,0 +1,114 @@
+/**
+ * libsums666.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for libsums666, which lets other programs scan buffers of
+ * newline separated words for the ones that sum to a set of targets without
+ * running the sums666 program on a file.
+ *
+ * A scanner holds a set of targets and the cipher that words are summed
+ * with. Each call scans one buffer with the same vector kernels the program
+ * uses, and reports the words that sum to a target either through a callback
+ * or as an array of (offset, length, sum) records. A scanner can be used by
+ * one thread at a time; use a scanner per thread to scan in parallel.
+ *
+ * libsums666.a and libsums666.so are built by lib.sh. sums666.hpp wraps this
+ * API for C++.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef LIBSUMS666_H
+#define LIBSUMS666_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * This marks the functions that the shared library exports.
+ */
+#define SUMS666_API __attribute__((visibility("default")))
+
+/**
+ * This is a scanner.
+ */
+struct sums666_scanner;
+
+/**
+ * This is a word that sums to a target. The newline is not included in its
+ * length.
+ */
+struct sums666_match {
+    size_t off;     /* Offset of the word from the start of the buffer. */
+    size_t len;     /* Length of the word. */
+    int64_t sum;    /* Sum of the word, which is one of the targets. */
+};
+
+/**
+ * This is a function that is called with each word that sums to a target.
+ * word is not null terminated. Scanning stops if it returns false.
+ */
+typedef bool (*sums666_callback)(const char* word, size_t len, int64_t sum,
+                                                                void* arg);
+
+/**
+ * This function makes a scanner that looks for words that sum to any of the
+ * n targets provided to it under the built-in cipher with the name provided
+ * to it ("ascii", "ordinal", "gematria", "hebrew", "greek" or "codepoints").
+ * A cipher of NULL is ascii. It returns NULL if the cipher doesn't exist,
+ * there are no targets, or memory can't be allocated.
+ */
+SUMS666_API struct sums666_scanner* sums666_open(const long* targets, size_t n,
+                                                 const char* cipher);
+
+/**
+ * This function makes a scanner like sums666_open() whose cipher gives byte
+ * b the value values[b]. The values are copied.
+ */
+SUMS666_API struct sums666_scanner* sums666_open_values(const long* targets,
+                                        size_t n, const int32_t values[256]);
+
+/**
+ * This function scans the len bytes of buf provided to it and calls cb with
+ * each word that sums to a target, in order. If final is true, the bytes
+ * after the last newline are a word too. Otherwise they are left for the
+ * next call, once the rest of their word has been read. It returns the
+ * number of bytes scanned, which stops short of len if cb returned false.
+ */
+SUMS666_API size_t sums666_scan(struct sums666_scanner* s, const char* buf,
+                                size_t len, bool final, sums666_callback cb,
+                                void* arg);
+
+/**
+ * This function scans buf like sums666_scan() but stores up to max of the
+ * words that sum to a target in out instead. It returns the number of words
+ * stored and stores the number of bytes scanned in consumed. If out filled
+ * up, the next call should start at buf + consumed.
+ */
+SUMS666_API size_t sums666_matches(struct sums666_scanner* s, const char* buf,
+                                   size_t len, bool final,
+                                   struct sums666_match* out, size_t max,
+                                   size_t* consumed);
+
+/**
+ * This function returns the sum of the len chars of the word provided to it
+ * under the scanner's cipher.
+ */
+SUMS666_API int64_t sums666_sum(const struct sums666_scanner* s,
+                                const char* word, size_t len);
+
+/**
+ * This function frees a scanner.
+ */
+SUMS666_API void sums666_close(struct sums666_scanner* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBSUMS666_H
@@ -0,0 +1,505 @@
+/**
+ * linesum.c
+ *
+ * This file contains the definitions of the newline-segmented byte-sum
+ * kernels.
+ *
+ * The vector kernels load a block of the buffer, find the newlines in it with
+ * one compare and turn the rest of the block into a running (prefix) sum of
+ * its chars. The sum of a word that ends inside the block is then the prefix
+ * sum at its newline minus the prefix sum at the end of the previous word,
+ * so a block is summed once no matter how many words it holds. Blocks with
+ * no newline in them are simply added to the current word's sum.
+ *
+ * Author: Richard Gale
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "linesum.h"
+
+#if defined(__x86_64__)
+#define LINESUM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * This is the type of the kernel functions.
+ */
+typedef size_t (*linesum_kernel)(const char* buf, size_t len,
+                        struct linesum* out, size_t max, size_t* consumed);
+
+/**
+ * This makes sure the kernels are chosen exactly once, by whichever thread
+ * calls linesums(), is_ascii() or linesums_kernel() first.
+ */
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * This is the kernel that linesums() uses. It is chosen on the first call.
+ */
+static linesum_kernel kernel = NULL;
+
+/**
+ * This is the name of the kernel that linesums() uses.
+ */
+static const char* kernel_name = NULL;
+
+/**
+ * This is the type of the functions that check a buffer for non-ascii bytes.
+ */
+typedef bool (*ascii_kernel)(const char* buf, size_t len);
+
+/**
+ * This is the function that is_ascii() uses. It is chosen along with the
+ * linesums() kernel.
+ */
+static ascii_kernel ascii_check = NULL;
+
+/**
+ * This function sums the lines from pos to the end of the buffer one char at
+ * a time. acc is the running sum of the chars before pos and start is the
+ * running sum at the start of the current line, whose offset is linestart.
+ * It is the scalar kernel and also the tail of the vector kernels.
+ */
+static size_t linesums_tail(const char* buf, size_t len, size_t pos,
+                            int64_t acc, int64_t start, size_t linestart,
+                            struct linesum* out, size_t n, size_t max,
+                            size_t* consumed)
+{
+    for (; pos < len && n < max; pos++)
+    {
+        if (buf[pos] == '\n')
+        {
+            out[n].off = linestart;
+            out[n].len = pos - linestart;
+            out[n].sum = acc - start;
+            n++;
+
+            start = acc;
+            linestart = pos + 1;
+        }
+        else
+        {
+            acc += (int) buf[pos];
+        }
+    }
+
+    *consumed = linestart;
+    return n;
+}
+
+/**
+ * This function sums every complete line in the buffer one char at a time.
+ */
+size_t linesums_scalar(const char* buf, size_t len, struct linesum* out,
+                                            size_t max, size_t* consumed)
+{
+    return linesums_tail(buf, len, 0, 0, 0, 0, out, 0, max, consumed);
+}
+
+/**
+ * This function returns true if none of the len bytes of the buffer have
+ * their high bit set, checking 8 bytes at a time.
+ */
+static bool is_ascii_scalar(const char* buf, size_t len)
+{
+    uint64_t acc = 0;   /* The bytes checked so far, or'ed together. */
+    uint64_t word;      /* The current 8 bytes. */
+    size_t pos;
+
+    for (pos = 0; pos + 8 <= len; pos += 8)
+    {
+        memcpy(&word, buf + pos, 8);
+        acc |= word;
+    }
+
+    for (; pos < len; pos++)
+        acc |= (unsigned char) buf[pos];
+
+    return (acc & 0x8080808080808080ULL) == 0;
+}
+
+#ifdef LINESUM_X86
+
+/**
+ * This function is the SSE2 version of is_ascii_scalar(). It checks 64
+ * bytes per block.
+ */
+static bool is_ascii_sse2(const char* buf, size_t len)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t pos;
+
+    for (pos = 0; pos + 64 <= len; pos += 64)
+    {
+        acc = _mm_or_si128(acc, _mm_or_si128(
+                _mm_or_si128(_mm_loadu_si128((const __m128i*) (buf + pos)),
+                             _mm_loadu_si128((const __m128i*) (buf + pos + 16))),
+                _mm_or_si128(_mm_loadu_si128((const __m128i*) (buf + pos + 32)),
+                             _mm_loadu_si128((const __m128i*) (buf + pos + 48)))));
+
+        /* Stopping at the first block that isn't ascii. */
+        if (_mm_movemask_epi8(acc) != 0)
+            return false;
+    }
+
+    for (; pos + 16 <= len; pos += 16)
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*) (buf + pos)));
+
+    return _mm_movemask_epi8(acc) == 0 && is_ascii_scalar(buf + pos, len - pos);
+}
+
+/**
+ * This function is the AVX2 version of is_ascii_scalar(). It checks 128
+ * bytes per block.
+ */
+__attribute__((target("avx2")))
+static bool is_ascii_avx2(const char* buf, size_t len)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t pos;
+
+    for (pos = 0; pos + 128 <= len; pos += 128)
+    {
+        acc = _mm256_or_si256(acc, _mm256_or_si256(
+                _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (buf + pos)),
+                        _mm256_loadu_si256((const __m256i*) (buf + pos + 32))),
+                _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (buf + pos + 64)),
+                        _mm256_loadu_si256((const __m256i*) (buf + pos + 96)))));
+
+        /* Stopping at the first block that isn't ascii. */
+        if (_mm256_movemask_epi8(acc) != 0)
+            return false;
+    }
+
+    for (; pos + 32 <= len; pos += 32)
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*) (buf + pos)));
+
+    return _mm256_movemask_epi8(acc) == 0 && is_ascii_sse2(buf + pos, len - pos);
+}
+
+/**
+ * This function emits a result for each newline in mask. pre holds the
+ * prefix sums of the block at offset pos and acc is the running sum before
+ * the block. It returns false if out filled up, in which case
+ * linestart is the offset at which the caller must stop.
+ */
+static inline bool emit_block(const int16_t* pre, uint32_t mask, size_t pos,
+                              int64_t acc, int64_t* start, size_t* linestart,
+                              struct linesum* out, size_t* n, size_t max)
+{
+    int64_t s;  /* Running sum at the current newline. */
+    int bit;    /* Position of the current newline in the block. */
+
+    while (mask)
+    {
+        bit = __builtin_ctz(mask);
+        s = acc + pre[bit];
+
+        out[*n].off = *linestart;
+        out[*n].len = pos + bit - *linestart;
+        out[*n].sum = s - *start;
+        (*n)++;
+
+        *start = s;
+        *linestart = pos + bit + 1;
+        mask &= mask - 1;
+
+        if (*n == max)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * This function returns the inclusive prefix sum of the eight 16 bit lanes
+ * of x.
+ */
+static inline __m128i prefix_epi16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+    x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+    return x;
+}
+
+/**
+ * This function returns the sum of the sixteen signed chars in v.
+ * Flipping the sign bit turns each char into an unsigned value that is 128
+ * too large, which _mm_sad_epu8() can then add up.
+ */
+static inline int64_t hsum_epi8(__m128i v)
+{
+    __m128i sad;
+
+    sad = _mm_sad_epu8(_mm_xor_si128(v, _mm_set1_epi8((char) 0x80)),
+                       _mm_setzero_si128());
+
+    return _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4) - 16 * 128;
+}
+
+/**
+ * This function is the SSE2 kernel. It sums 16 chars per block.
+ */
+static size_t linesums_sse2(const char* buf, size_t len, struct linesum* out,
+                                            size_t max, size_t* consumed)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    int16_t pre[16];        /* Prefix sums of the current block. */
+    int64_t acc = 0;        /* Running sum before the current block. */
+    int64_t start = 0;      /* Running sum at the start of the line. */
+    size_t linestart = 0;   /* Offset of the start of the line. */
+    size_t n = 0;           /* Number of results stored. */
+    size_t pos;             /* Offset of the current block. */
+    __m128i v, eq, sign, lo, hi;
+    uint32_t mask;
+
+    if (max == 0)
+    {
+        *consumed = 0;
+        return 0;
+    }
+
+    for (pos = 0; pos + 16 <= len; pos += 16)
+    {
+        v = _mm_loadu_si128((const __m128i*) (buf + pos));
+        eq = _mm_cmpeq_epi8(v, nl);
+        mask = _mm_movemask_epi8(eq);
+
+        /* Newlines don't count towards any word. */
+        v = _mm_andnot_si128(eq, v);
+
+        /* The whole block belongs to the current word. */
+        if (mask == 0)
+        {
+            acc += hsum_epi8(v);
+            continue;
+        }
+
+        /* Sign extending the chars to 16 bits and taking the prefix sum
+         * of each half of the block. */
+        sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+        lo = prefix_epi16(_mm_unpacklo_epi8(v, sign));
+        hi = prefix_epi16(_mm_unpackhi_epi8(v, sign));
+
+        /* Carrying the total of the low half into the high half. */
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi64(
+                                _mm_shufflehi_epi16(lo, 0xFF),
+                                _mm_shufflehi_epi16(lo, 0xFF)));
+
+        _mm_storeu_si128((__m128i*) pre, lo);
+        _mm_storeu_si128((__m128i*) (pre + 8), hi);
+
+        if (!emit_block(pre, mask, pos, acc, &start, &linestart, out, &n, max))
+        {
+            *consumed = linestart;
+            return n;
+        }
+
+        acc += pre[15];
+    }
+
+    return linesums_tail(buf, len, pos, acc, start, linestart,
+                         out, n, max, consumed);
+}
+
+/**
+ * This function returns the inclusive prefix sum of the sixteen 16 bit lanes
+ * of x.
+ */
+__attribute__((target("avx2")))
+static inline __m256i prefix256_epi16(__m256i x)
+{
+    __m256i carry;
+
+    /* Prefix sum within each 128 bit lane. */
+    x = _mm256_add_epi16(x, _mm256_slli_si256(x, 2));
+    x = _mm256_add_epi16(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi16(x, _mm256_slli_si256(x, 8));
+
+    /* Carrying the total of the low lane into the high lane. */
+    carry = _mm256_shufflehi_epi16(x, 0xFF);
+    carry = _mm256_unpackhi_epi64(carry, carry);
+    carry = _mm256_permute2x128_si256(carry, carry, 0x08);
+
+    return _mm256_add_epi16(x, carry);
+}
+
+/**
+ * This function is the AVX2 kernel. It sums 32 chars per block.
+ */
+__attribute__((target("avx2")))
+static size_t linesums_avx2(const char* buf, size_t len, struct linesum* out,
+                                            size_t max, size_t* consumed)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i bias = _mm256_set1_epi8((char) 0x80);
+    int16_t pre[32];        /* Prefix sums of the current block. */
+    int64_t acc = 0;        /* Running sum before the current block. */
+    int64_t start = 0;      /* Running sum at the start of the line. */
+    size_t linestart = 0;   /* Offset of the start of the line. */
+    size_t n = 0;           /* Number of results stored. */
+    size_t pos;             /* Offset of the current block. */
+    __m256i v, eq, lo, hi, sad;
+    uint32_t mask;
+
+    if (max == 0)
+    {
+        *consumed = 0;
+        return 0;
+    }
+
+    for (pos = 0; pos + 32 <= len; pos += 32)
+    {
+        v = _mm256_loadu_si256((const __m256i*) (buf + pos));
+        eq = _mm256_cmpeq_epi8(v, nl);
+        mask = _mm256_movemask_epi8(eq);
+
+        /* Newlines don't count towards any word. */
+        v = _mm256_andnot_si256(eq, v);
+
+        /* The whole block belongs to the current word. */
+        if (mask == 0)
+        {
+            sad = _mm256_sad_epu8(_mm256_xor_si256(v, bias),
+                                  _mm256_setzero_si256());
+            acc += _mm256_extract_epi64(sad, 0) + _mm256_extract_epi64(sad, 1)
+                 + _mm256_extract_epi64(sad, 2) + _mm256_extract_epi64(sad, 3)
+                 - 32 * 128;
+            continue;
+        }
+
+        /* Sign extending each half of the block to 16 bits and taking
+         * their prefix sums. */
+        lo = prefix256_epi16(_mm256_cvtepi8_epi16(
+                                        _mm256_castsi256_si128(v)));
+        hi = prefix256_epi16(_mm256_cvtepi8_epi16(
+                                        _mm256_extracti128_si256(v, 1)));
+
+        /* Carrying the total of the low half into the high half. */
+        hi = _mm256_add_epi16(hi, _mm256_set1_epi16(
+                                        _mm256_extract_epi16(lo, 15)));
+
+        _mm256_storeu_si256((__m256i*) pre, lo);
+        _mm256_storeu_si256((__m256i*) (pre + 16), hi);
+
+        if (!emit_block(pre, mask, pos, acc, &start, &linestart, out, &n, max))
+        {
+            *consumed = linestart;
+            return n;
+        }
+
+        acc += pre[31];
+    }
+
+    return linesums_tail(buf, len, pos, acc, start, linestart,
+                         out, n, max, consumed);
+}
+
+#endif // LINESUM_X86
+
+/**
+ * This function chooses the fastest kernel that the CPU supports.
+ */
+static void choose_kernel()
+{
+    kernel = linesums_scalar;
+    kernel_name = "scalar";
+    ascii_check = is_ascii_scalar;
+
+#ifdef LINESUM_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+    {
+        kernel = linesums_sse2;
+        kernel_name = "sse2";
+        ascii_check = is_ascii_sse2;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = linesums_avx2;
+        kernel_name = "avx2";
+        ascii_check = is_ascii_avx2;
+    }
+#endif
+}
+
+/**
+ * This function sums every complete line in the buffer with the fastest
+ * kernel that the CPU supports.
+ */
+size_t linesums(const char* buf, size_t len, struct linesum* out, size_t max,
+                                                    size_t* consumed)
+{
+    pthread_once(&kernel_once, choose_kernel);
+
+    return kernel(buf, len, out, max, consumed);
+}
+
+/**
+ * This function makes linesums() use the kernel with the name provided to it,
+ * or the fastest one if name is NULL. It returns false if the CPU doesn't
+ * support the kernel.
+ */
+bool linesums_use(const char* name)
+{
+    pthread_once(&kernel_once, choose_kernel);
+
+    if (name == NULL || strcmp(name, "scalar") == 0)
+    {
+        choose_kernel();
+        if (name != NULL)
+        {
+            kernel = linesums_scalar;
+            kernel_name = "scalar";
+            ascii_check = is_ascii_scalar;
+        }
+        return true;
+    }
+
+#ifdef LINESUM_X86
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        kernel = linesums_sse2;
+        kernel_name = "sse2";
+        ascii_check = is_ascii_sse2;
+        return true;
+    }
+
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        kernel = linesums_avx2;
+        kernel_name = "avx2";
+        ascii_check = is_ascii_avx2;
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+/**
+ * This function returns the name of the kernel that linesums() uses.
+ */
+const char* linesums_kernel()
+{
+    pthread_once(&kernel_once, choose_kernel);
+
+    return kernel_name;
+}
+
+/**
+ * This function returns true if every byte of the buffer is ascii, with the
+ * fastest check the CPU supports.
+ */
+bool is_ascii(const char* buf, size_t len)
+{
+    pthread_once(&kernel_once, choose_kernel);
+
+    return ascii_check(buf, len);
+}
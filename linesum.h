@@ -0,0 +1,70 @@
+/**
+ * linesum.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for the newline-segmented byte-sum kernels. The kernels take
+ * a large buffer of newline separated words and produce the sum of the
+ * decimal ascii values of every word in it, many words per call.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef LINESUM_H
+#define LINESUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * This is the sum of one line of a buffer. The newline is not included in
+ * the line's length or its sum.
+ */
+struct linesum {
+    size_t off;     /* Offset of the line from the start of the buffer. */
+    size_t len;     /* Length of the line without its newline. */
+    int64_t sum;    /* Sum of the decimal ascii values of the line. */
+};
+
+/**
+ * This function sums every complete (newline terminated) line in the buffer
+ * of length len provided to it, storing up to max results in out. It returns
+ * the number of results stored and stores the number of bytes of the buffer
+ * that were consumed in consumed; the next call should start there. Bytes
+ * after the last newline in the buffer are never consumed.
+ * Chars are summed as the platform's char type sums them, so the results
+ * match those of sums666().
+ * The fastest kernel the CPU supports is chosen the first time this function
+ * is called.
+ */
+size_t linesums(const char* buf, size_t len, struct linesum* out, size_t max,
+                                                    size_t* consumed);
+
+/**
+ * This function does the same as linesums() but always uses the portable
+ * scalar kernel. It is the reference the vector kernels are checked against.
+ */
+size_t linesums_scalar(const char* buf, size_t len, struct linesum* out,
+                                            size_t max, size_t* consumed);
+
+/**
+ * This function makes linesums() use the kernel with the name provided to it
+ * ("scalar", "sse2" or "avx2"), or the fastest one if name is NULL. It
+ * returns false, changing nothing, if the CPU doesn't support the kernel.
+ * It mustn't be called while other threads are summing lines.
+ */
+bool linesums_use(const char* name);
+
+/**
+ * This function returns the name of the kernel that linesums() uses.
+ */
+const char* linesums_kernel();
+
+/**
+ * This function returns true if none of the len bytes of the buffer have
+ * their high bit set, i.e. the buffer is pure ascii. It uses the vector
+ * instructions that linesums() uses.
+ */
+bool is_ascii(const char* buf, size_t len);
+
+#endif // LINESUM_H
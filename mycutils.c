@@ -30,18 +30,9 @@ bool check_timer(struct timespec start, uint64_t wait_time)
 {
     const bool HAS_ELAPSED = true;      /* Value if time has elapsed. */
     const bool NOT_ELAPSED = false;     /* Value if time has not elapsed. */
-    struct timespec current;            /* The current time. */
-    struct timespec elapsed;            /* The time elapsed since start. */
-
-    /* Obtaining the current time. */
-    clock_gettime(CLOCK_REALTIME, &current);
-
-    /* Calculating the elapsed time. */
-    elapsed.tv_sec = current.tv_sec - start.tv_sec;
-    elapsed.tv_nsec = current.tv_nsec - start.tv_nsec;
 
     /* Checking whether the time hasn't elapsed. */
-    if ((elapsed.tv_sec * NANOS_PER_SEC) + elapsed.tv_nsec < wait_time)
+    if (elapsed_timer(start) < wait_time)
         return NOT_ELAPSED;
 
     /* The time has elapsed. */
@@ -50,14 +41,16 @@ bool check_timer(struct timespec start, uint64_t wait_time)
 
 /**
  * This function obtains the current time and stores it in the timespec
- * that was provided to it.
+ * that was provided to it. The time comes from the monotonic clock, which
+ * isn't changed when the system time is set, so it is only useful for
+ * measuring how much time has elapsed.
  */
 void start_timer(struct timespec* ts)
 {
     char* tstamp;
 
     /* Obtaining the current time.*/
-    if ((clock_gettime(CLOCK_REALTIME, ts)) != -1)
+    if ((clock_gettime(CLOCK_MONOTONIC, ts)) != -1)
         return;
         
     /* An error occured so we are printing an error message. */
@@ -74,15 +67,31 @@ void start_timer(struct timespec* ts)
 }
 
 /**
- * This function returns a string that represent the current time.
- * For reasons detailed in a comment within this function, you must
- * free() the string that this function returns.
+ * This function returns the number of nano-seconds that have elapsed since
+ * start, which must have been obtained with start_timer().
+ */
+uint64_t elapsed_timer(struct timespec start)
+{
+    struct timespec current;    /* The current time. */
+
+    /* Obtaining the current time. */
+    start_timer(&current);
+
+    /* Calculating the elapsed time. */
+    return (current.tv_sec - start.tv_sec) * (uint64_t) NANOS_PER_SEC
+           + current.tv_nsec - start.tv_nsec;
+}
+
+/**
+ * This function returns a string that represent the current time, in the
+ * format of ctime() without its newline. You must free() the string that
+ * this function returns.
  */
 char* timestamp()
 {
     time_t current_time;    /* The current time. */
+    struct tm local;        /* The current time as local time. */
     char* stamp;            /* The time stamp. */
-    char* stamp_cpy;        /* A Copy of the time stamp. */
 
     /* Obtaining the current time. */
     if ((current_time = time(NULL)) == ((time_t) - 1))
@@ -95,8 +104,11 @@ char* timestamp()
         exit(EXIT_FAILURE);
     }
 
-    /* Converting time to local time format. */
-    if ((stamp = ctime(&current_time)) == NULL)
+    /* Formatting the local time straight into the stamp, the way ctime()
+     * does but without the newline. */
+    if ((stamp = malloc(TIMESTAMP_SIZE)) == NULL
+        || localtime_r(&current_time, &local) == NULL
+        || strftime(stamp, TIMESTAMP_SIZE, "%a %b %e %H:%M:%S %Y", &local) == 0)
     {
         /* An error occured converting so we're printing an error message
          * and exiting the program. */
@@ -106,22 +118,8 @@ char* timestamp()
         exit(EXIT_FAILURE);
     }
 
-    /* The string that ctime() returns is not one that should be be freed
-     * with free() because the memory it uses was not allocated with malloc()
-     * or a similar function. Because we are going to use sdelchar() to remove
-     * the newline character that ctime() added to our timestamp, and
-     * sdelchar() uses free() to remove chars from strings, we have to make
-     * a copy of our stamp.
-     * If this copy is not freed by the calling function, it will create a 
-     * memory leak.
-     */
-    strfmt(&stamp_cpy, "%s", stamp);
-
-    /* Removing the newline character that was added by ctime(). */
-    sdelchar(&stamp_cpy, '\n');
-
-    /* Returning the copy of the time stamp. */
-    return stamp_cpy;
+    /* Returning the time stamp. */
+    return stamp;
 }
 
 /******************************** In/Out *************************************/
@@ -156,6 +154,7 @@ void scans(char** buf, char* prompt)
         move_cursor(AFTER, strlen(prompt) + strlen(*buf));
 
         /* Getting and processing user input. */
+        flush_term();
         switch (userin = scanc_nowait())
         {
             /* Backspace. */
@@ -265,6 +264,70 @@ FILE* openfs(char* fname, char* mode)
     exit(EXIT_FAILURE);
 }
 
+/**
+ * This function maps the whole of the regular file behind the file stream
+ * provided to it into memory and returns a pointer to the mapping, storing
+ * the length of the mapping in len. The kernel is advised that the mapping
+ * will be read sequentially so it can read ahead aggressively.
+ * It returns NULL if the file can't be mapped (e.g. it is a pipe or it is
+ * empty), in which case the stream can still be read with readfsl().
+ * If an error occurs the program will exit.
+ */
+char* mapfs(FILE* fs, size_t* len)
+{
+    struct stat st; /* Information about the file. */
+    char* map;      /* The mapping. */
+    char* tstamp;   /* A time stamp. */
+
+    /* Nothing has been mapped yet. */
+    *len = 0;
+
+    /* Getting information about the file. */
+    if (fstat(fileno(fs), &st) != -1)
+    {
+        /* Pipes, terminals and empty files can't be mapped. */
+        if (!S_ISREG(st.st_mode) || st.st_size == 0)
+            return NULL;
+
+        /* Mapping the file. */
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fs), 0);
+        if (map != MAP_FAILED)
+        {
+            /* Telling the kernel we'll be reading the file from start to
+             * end. This is only advice so a failure here isn't an error. */
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+            /* Returning the mapping. */
+            *len = st.st_size;
+            return map;
+        }
+    }
+
+    /* An error occurred so we are printing an error message. */
+    fprintf(stderr,
+            "[ %s ] ERROR: In function mapfs(): %s\n",
+            (tstamp = timestamp()), strerror(errno));
+
+    /* De-allocating memory. */
+    free(tstamp);
+
+    /* Exiting the program. */
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function unmaps a mapping that was returned by mapfs().
+ */
+void unmapfs(char* map, size_t len)
+{
+    /* Nothing was mapped. */
+    if (map == NULL)
+        return;
+
+    /* Unmapping the file. */
+    munmap(map, len);
+}
+
 /**
  * This function assigns the next char in the file stream provided to it to
  * the buffer provided to it. It returns true on success or false if EOF is
@@ -305,10 +368,25 @@ bool readfsc(FILE* fs, char* buf)
  * Make sure to free() the buffer when you're finished with it.
  */
 bool readfsl(FILE* fs, char** buf)
+{
+    size_t len;     /* Length of the line, which isn't needed. */
+
+    return readfsln(fs, buf, &len);
+}
+
+/**
+ * This function assigns the next line in the file stream provided to it to
+ * the string provided to it and its length, counting any null characters in
+ * it, to len. It returns true if the line was read successfully or false if
+ * EOF was reached. If an error occurs the program will exit. Make sure to
+ * free() the buffer when you're finished with it.
+ */
+bool readfsln(FILE* fs, char** buf, size_t* len)
 {
     const bool SUCCESS = true;      /* Return value if success. */
     const bool END_OF_FILE = false; /* Return value if EOF. */
     size_t n;                       /* Allocated size of the buffer. */
+    ssize_t read;                   /* Length of the line read. */
     char* tstamp;                   /* A time stamp. */
 
     /* Initialising how big the buffer is. */
@@ -316,17 +394,64 @@ bool readfsl(FILE* fs, char** buf)
     
     /* Reading the next line from the file stream and checking if it was
      * read successfully. */
-    if (getline(buf, &n, fs) != -1)
+    if ((read = getline(buf, &n, fs)) != -1)
+    {
+        *len = read;
         return SUCCESS;
+    }
 
     /* Checking if EOF was reached. */
     if (!ferror(fs))
         return END_OF_FILE;
             
     /* An error occurred so we are printing an error message. */
-    fprintf(stdout,
-            "[ %s ] ERROR: In function readfsl: %s\n",
-            timestamp(), strerror(errno));
+    fprintf(stderr,
+            "[ %s ] ERROR: In function readfsln(): %s\n",
+            (tstamp = timestamp()), strerror(errno));
+
+    /* De-allocating memory. */
+    free(tstamp);
+
+    /* Exiting the program. */
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function reads the rest of the file stream provided to it into a
+ * buffer and returns it, storing the number of bytes read in len. It is for
+ * streams that can't be mapped with mapfs(). If an error occurs the program
+ * will exit. Make sure to free() the buffer when you're finished with it.
+ */
+char* readfsall(FILE* fs, size_t* len)
+{
+    char* buf;      /* The bytes read so far. */
+    size_t cap;     /* Allocated size of the buffer. */
+    size_t n;       /* Number of bytes read by the last fread(). */
+    char* tstamp;   /* A time stamp. */
+
+    /* Initialising the buffer. */
+    cap = BUFSIZ;
+    *len = 0;
+
+    if ((buf = (char*) malloc(cap)) != NULL)
+    {
+        /* Reading the stream, doubling the buffer whenever it fills up. */
+        while ((n = fread(buf + *len, sizeof(char), cap - *len, fs)) > 0)
+        {
+            *len += n;
+            if (*len == cap && (buf = (char*) realloc(buf, cap *= 2)) == NULL)
+                break;
+        }
+
+        /* Returning the buffer if the whole stream was read. */
+        if (buf != NULL && !ferror(fs))
+            return buf;
+    }
+
+    /* An error occurred so we are printing an error message. */
+    fprintf(stderr,
+            "[ %s ] ERROR: In function readfsall(): %s\n",
+            (tstamp = timestamp()), strerror(errno));
 
     /* De-allocating memory. */
     free(tstamp);
@@ -342,7 +467,7 @@ bool readfsl(FILE* fs, char** buf)
 void writefsc(FILE* fs, char ch)
 {
     /* Writing the char to the file stream. */
-    fprintf(fs, "%c", ch); 
+    fputc(ch, fs);
 }
 
 /**
@@ -351,11 +476,151 @@ void writefsc(FILE* fs, char ch)
  */
 void writefss(FILE* fs, char* str)
 {
-    int c;  /* Index of the current char in the string. */
-
     /* Writing the string to the file stream. */
-    for (c = 0; c < strlen(str); c++)
-        writefsc(fs, str[c]);
+    fwrite(str, sizeof(char), strlen(str), fs);
+}
+
+/**
+ * This function prints an error message for the buffered writer function
+ * with the name provided to it and exits the program.
+ */
+static void bwerror(const char* func)
+{
+    char* tstamp;   /* A time stamp. */
+
+    /* Printing the error message. */
+    fprintf(stderr,
+            "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, strerror(errno));
+
+    /* De-allocating memory. */
+    free(tstamp);
+
+    /* Exiting the program. */
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function writes every byte described by the iovecs provided to it to
+ * the file descriptor of the buffered writer provided to it, retrying after
+ * partial writes and interruptions, and adds the time it took to the
+ * writer's write_ns. If an error occurs the program will exit.
+ */
+static void writeallv(bufwriter* bw, struct iovec* iov, int iovcnt)
+{
+    struct timespec start;  /* When writing started. */
+    ssize_t n;              /* Number of bytes written by the last writev(). */
+
+    start_timer(&start);
+
+    while (iovcnt > 0)
+    {
+        if ((n = writev(bw->fd, iov, iovcnt)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            bwerror("writebw");
+        }
+
+        bw->written += n;
+
+        /* Skipping the iovecs that were written completely. */
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        /* Skipping the part of the next iovec that was written. */
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    bw->write_ns += elapsed_timer(start);
+}
+
+/**
+ * This function creates a buffered writer that writes to the file descriptor
+ * provided to it through a buffer of cap bytes. If an error occurs the
+ * program will exit.
+ */
+bufwriter* openbw(int fd, size_t cap)
+{
+    bufwriter* bw;  /* The buffered writer. */
+
+    /* Allocating the writer and its buffer. */
+    if ((bw = (bufwriter*) malloc(sizeof(bufwriter))) == NULL
+        || (bw->buf = (char*) malloc(cap)) == NULL)
+        bwerror("openbw");
+
+    bw->fd = fd;
+    bw->len = 0;
+    bw->cap = cap;
+    bw->written = 0;
+    bw->write_ns = 0;
+
+    return bw;
+}
+
+/**
+ * This function writes len bytes of data to the buffered writer provided to
+ * it. Small writes are copied into the buffer. When the data doesn't fit,
+ * the buffer and the data are written together with one writev() so large
+ * writes are never copied.
+ */
+void writebw(bufwriter* bw, const char* data, size_t len)
+{
+    struct iovec iov[2];    /* The buffer and the data. */
+
+    /* Copying the data into the buffer if it fits. */
+    if (bw->len + len <= bw->cap)
+    {
+        memcpy(bw->buf + bw->len, data, len);
+        bw->len += len;
+        return;
+    }
+
+    /* Writing the buffer and the data at once. */
+    iov[0].iov_base = bw->buf;
+    iov[0].iov_len = bw->len;
+    iov[1].iov_base = (char*) data;
+    iov[1].iov_len = len;
+    writeallv(bw, iov, 2);
+
+    bw->len = 0;
+}
+
+/**
+ * This function writes everything in the buffered writer provided to it to
+ * its file descriptor.
+ */
+void flushbw(bufwriter* bw)
+{
+    struct iovec iov;   /* The buffer. */
+
+    if (bw->len == 0)
+        return;
+
+    iov.iov_base = bw->buf;
+    iov.iov_len = bw->len;
+    writeallv(bw, &iov, 1);
+
+    bw->len = 0;
+}
+
+/**
+ * This function flushes and frees the buffered writer provided to it. It
+ * doesn't close the writer's file descriptor.
+ */
+void closebw(bufwriter* bw)
+{
+    flushbw(bw);
+    free(bw->buf);
+    free(bw);
 }
 
 /******************************** Strings ************************************/
@@ -391,90 +656,289 @@ size_t vbytesfmt(va_list lp, char* fmt)
  */
 void strfmt(char** sp, char *fmt, ...)
 {
-    va_list lp;     /* Pointer to the list of arguments. */
-    size_t bytes;   /* The number of bytes the string needs. */
+    char buf[STRFMT_STACK]; /* The string, if it is short. */
+    va_list lp;             /* Pointer to the list of arguments. */
+    va_list lp_cpy;         /* A copy of the list, in case it is long. */
+    int len;                /* Length of the string. */
 
-    /* Pointing to the first argument. */
+    /* Formatting the string once into a buffer on the stack, which is enough
+     * for most strings. Only longer ones are formatted a second time. */
     va_start(lp, fmt);
+    va_copy(lp_cpy, lp);
+    len = vsnprintf(buf, sizeof(buf), fmt, lp);
+    va_end(lp);
 
-    /* Getting the number of bytes the string will need to be allocated. */
-    bytes = vbytesfmt(lp, fmt);
-
-    /* Allocating memory to the string. */
-    *sp = (char*) malloc(bytes);
+    if (len < 0 || (*sp = (char*) malloc(len + 1)) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function strfmt(): %s\n",
+                len < 0 ? "Invalid format" : strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
-    /* Creating the string. */
-    vsprintf(*sp, fmt, lp);
+    if ((size_t) len < sizeof(buf))
+        memcpy(*sp, buf, len + 1);
+    else
+        vsnprintf(*sp, len + 1, fmt, lp_cpy);
 
     /* Assuring a clean finish to the argument list. */
-    va_end(lp);
+    va_end(lp_cpy);
 }
 
 /**
  * This function removes the char element from the string provided to it which
- * is at the element number/index provided to it.
+ * is at the element number/index provided to it. The string is changed in
+ * place.
  */
 void sdelelem(char** sp, unsigned elem)
 {
-    char* to_elem;      /* Chars from start of string to element to delete. */
-    char* from_elem;    /* Chars from element to delete to end of string. */
-    unsigned c;         /* The current char in the string. */
+    size_t len = strlen(*sp);   /* Length of the string. */
+
+    /* Moving the chars after the element, and the null character, back
+     * over it. */
+    if (elem < len)
+        memmove(*sp + elem, *sp + elem + 1, len - elem);
+}
 
-    /* Allocating memory. */
-    to_elem     = (char*) malloc(sizeof(char) * (elem + 1));
-    from_elem   = (char*) malloc(sizeof(char) * (strlen(*sp) - elem));
+/**
+ * This function removes all cases of the provided char from the string at the
+ * provided pointer. The string is changed in place, in one pass.
+ */
+void sdelchar(char** sp, char remove)
+{
+    char* from;     /* The char being read. */
+    char* to;       /* Where the next char that is kept goes. */
 
-    /* Storing the two sections of the string. */
-    for (c = 0; c < strlen(*sp); c++)
+    /* Copying every char that isn't removed over the ones that are. */
+    for (from = to = *sp; *from != '\0'; from++)
     {
-        if (c < elem)
-            to_elem[c] = (*sp)[c];
-        if (c > elem)
-            from_elem[c] = (*sp)[c];
+        if (*from != remove)
+            *to++ = *from;
     }
-    to_elem[elem] = '\0';
-    from_elem[strlen(*sp) - elem - 1] = '\0';
+    *to = '\0';
+}
 
-    /* Recreating the string. */
-    free(*sp);
-    strfmt(sp, "%s%s", to_elem, from_elem);
+/********************************* Memory ************************************/
 
-    /* Cleaning up. */
-    free(to_elem);
-    free(from_elem);
+/**
+ * This function rounds size up to the alignment of every type.
+ */
+static inline size_t alignup(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
 }
 
 /**
- * This function removes all cases of the provided char from the string at the
- * provided pointer.
+ * This function adds a block with room for at least size bytes to the arena
+ * provided to it and makes it the current block.
  */
-void sdelchar(char** sp, char remove)
+static arenablock* growarena(arena* a, size_t size)
 {
-    unsigned c;     /* Index of current char in the string. */
+    arenablock* b;  /* The new block. */
+    size_t cap;     /* Size of the new block's data. */
 
-    /* Overwriting the unwanted characters. */
-	for (c = 0; c < strlen(*sp); c++)
-	{
-        if ((*sp)[c] == remove)
-        {
-            sdelelem(sp, c);
+    /* Reusing the next block, which was kept by resetarena(). */
+    if (a->cur != NULL && a->cur->next != NULL && a->cur->next->cap >= size)
+    {
+        a->cur = a->cur->next;
+        a->cur->used = 0;
+        return a->cur;
+    }
 
-            /* Decrementing the index so we will check the replacement 
-             * character. */
-            c--;
-        }
+    cap = size > a->block ? size : a->block;
+    if ((b = malloc(sizeof(arenablock) + cap)) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function growarena(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
     }
+    b->cap = cap;
+    b->used = 0;
+
+    /* Linking the block in after the current one. */
+    if (a->cur == NULL)
+    {
+        b->next = NULL;
+        a->first = b;
+    }
+    else
+    {
+        b->next = a->cur->next;
+        a->cur->next = b;
+    }
+    a->cur = b;
+
+    return b;
+}
+
+/**
+ * This function creates an arena that allocates memory in blocks of at least
+ * block bytes.
+ */
+arena* openarena(size_t block)
+{
+    arena* a;   /* The arena. */
+
+    if ((a = malloc(sizeof(arena))) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function openarena(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    a->first = NULL;
+    a->cur = NULL;
+    a->block = block > 0 ? block : ARENA_BLOCK;
+
+    return a;
+}
+
+/**
+ * This function allocates size bytes from the arena provided to it, aligned
+ * for any type.
+ */
+void* allocarena(arena* a, size_t size)
+{
+    arenablock* b = a->cur;     /* The current block. */
+    size_t at;                  /* Offset of the allocation in the block. */
+
+    if (b == NULL || (at = alignup(b->used)) > b->cap || b->cap - at < size)
+    {
+        b = growarena(a, size);
+        at = 0;
+    }
+    b->used = at + size;
+
+    return b->data + at;
+}
+
+/**
+ * This function copies len bytes of data into the arena provided to it,
+ * without aligning them or adding a null character, and returns the copy.
+ */
+char* copyarena(arena* a, const char* data, size_t len)
+{
+    arenablock* b = a->cur;     /* The current block. */
+    char* copy;                 /* The copy. */
+
+    if (b == NULL || b->cap - b->used < len)
+        b = growarena(a, len);
+    copy = b->data + b->used;
+    b->used += len;
+
+    memcpy(copy, data, len);
+
+    return copy;
+}
+
+/**
+ * This function is strfmt() for strings that are allocated from the arena
+ * provided to it. The string is formatted straight into the arena, and only
+ * formatted a second time if it doesn't fit in the current block.
+ */
+char* strfmtarena(arena* a, char* fmt, ...)
+{
+    arenablock* b = a->cur;     /* The current block. */
+    va_list lp;                 /* Pointer to the list of arguments. */
+    va_list lp_cpy;             /* A copy of the list, in case it is long. */
+    size_t room;                /* Bytes left in the current block. */
+    char* str;                  /* The string. */
+    int len;                    /* Length of the string. */
+
+    room = b != NULL ? b->cap - b->used : 0;
+    str = b != NULL ? b->data + b->used : NULL;
+
+    va_start(lp, fmt);
+    va_copy(lp_cpy, lp);
+    len = vsnprintf(str, room, fmt, lp);
+    va_end(lp);
+
+    if (len < 0)
+    {
+        fprintf(stderr, "ERROR: In function strfmtarena(): Invalid format\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((size_t) len >= room)
+    {
+        b = growarena(a, len + 1);
+        str = b->data;
+        vsnprintf(str, len + 1, fmt, lp_cpy);
+    }
+    b->used += len + 1;
+
+    va_end(lp_cpy);
+
+    return str;
+}
+
+/**
+ * This function frees everything allocated from the arena provided to it at
+ * once. Its blocks are kept, so the arena can be refilled without allocating
+ * them again.
+ */
+void resetarena(arena* a)
+{
+    a->cur = a->first;
+    if (a->cur != NULL)
+        a->cur->used = 0;
+}
+
+/**
+ * This function frees the arena provided to it and everything allocated from
+ * it.
+ */
+void closearena(arena* a)
+{
+    arenablock* b;      /* The current block. */
+    arenablock* next;   /* The block after it. */
+
+    for (b = a->first; b != NULL; b = next)
+    {
+        next = b->next;
+        free(b);
+    }
+    free(a);
 }
 
 /******************************* Terminal ************************************/
 
+/**
+ * This is the stream that terminal output is written to. It is stdout unless
+ * set_term() changes it.
+ */
+static FILE* term = NULL;
+
+/**
+ * This function returns the stream that terminal output is written to.
+ */
+static inline FILE* termfs()
+{
+    return term != NULL ? term : stdout;
+}
+
+/**
+ * This function makes the terminal functions write to the stream provided
+ * to it instead of stdout.
+ */
+void set_term(FILE* fs)
+{
+    term = fs;
+}
+
+/**
+ * This function writes any terminal output that is still buffered.
+ */
+void flush_term()
+{
+    fflush(termfs());
+}
+
 /**
  * This function clears the entire terminal and positions the cursor at home.
  */
 void clear()
 {
-    /* Clearing the terminal and putting the cursor at home. */
-    system("tput clear");
+    /* Putting the cursor at home and clearing the terminal. */
+    fputs("\033[H\033[2J", termfs());
 }
 
 /**
@@ -484,7 +948,7 @@ void clear()
 void clearb()
 {
     /* Clearing from the cursor to the beginning of the line. */
-    system("tput el1");
+    fputs("\033[1K", termfs());
 }
 
 /**
@@ -494,7 +958,7 @@ void clearb()
 void clearf()
 {
     /* Clearing from the cursor to the end of the line. */
-    system("tput el");
+    fputs("\033[K", termfs());
 }
 
 /**
@@ -504,48 +968,38 @@ void clearf()
 void clearfb()
 {
     /* Clearing the line that the terminal cursor is currently on. */
-    clearf();
-    clearb();
+    fputs("\033[2K", termfs());
 }
 
 /**
- * This function returns the number of rows and columns of the terminal.
+ * This function returns the number of rows and columns of the terminal. If
+ * none of the terminal stream, stdout, stderr and stdin are a terminal, the
+ * LINES and COLUMNS environment variables are used, or else 24 rows and 80
+ * columns.
  */
 vec2d get_res()
 {
-    vec2d res;      /* Storage for the rows and columns. */
-    FILE* rfp;      /* File stream for the rows file. */
-    FILE* cfp;      /* File stream for the columns file. */
-    char rbuf[5];   /* The number of rows. */
-    char cbuf[5];   /* The number of columns. */
-
-    /* Creating a temporary directory to store the files. */
-    system("if [ ! -d temp/ ]; then\nmkdir temp/\nfi");
-
-    /* Writing the number of rows and columns to their files. */
-    system("tput lines >> temp/screen_rows.txt");
-    system("tput cols >> temp/screen_cols.txt");
-
-    /* Opening the files. */
-    rfp = openfs("temp/screen_rows.txt", "r");
-    cfp = openfs("temp/screen_cols.txt", "r");
-
-    /* Getting the number of rows and columns from the files. */
-    fgets(rbuf, sizeof(rbuf), rfp);
-    fgets(cbuf, sizeof(cbuf), cfp);
-
-    /* Converting the number of rows and columns to integers. */
-    res.x = atoi(cbuf); //strtol( cbuf, &end, 10 );
-    res.y = atoi(rbuf); //strtol( rbuf, &end, 10 );
-
-    /* Closing the files. */
-    closefs(rfp);
-    closefs(cfp);
+    const int fds[] = { -1, STDOUT_FILENO, STDERR_FILENO, STDIN_FILENO };
+    struct winsize ws;  /* The size of the terminal. */
+    vec2d res;          /* Storage for the rows and columns. */
+    char* env;          /* An environment variable. */
+    size_t i;
+
+    /* Asking the terminal for its size. */
+    for (i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    {
+        if (ioctl(i == 0 ? fileno(termfs()) : fds[i], TIOCGWINSZ, &ws) == 0
+            && ws.ws_row > 0 && ws.ws_col > 0)
+        {
+            res.x = ws.ws_col;
+            res.y = ws.ws_row;
+            return res;
+        }
+    }
 
-    /* Deleting the files. */
-    system("rm -rf temp");
+    res.x = (env = getenv("COLUMNS")) != NULL && atoi(env) > 0 ? atoi(env) : 80;
+    res.y = (env = getenv("LINES")) != NULL && atoi(env) > 0 ? atoi(env) : 24;
 
-    /* Returning the number of rows and columns that the terminal has. */
     return res;
 }
 
@@ -556,30 +1010,31 @@ vec2d get_res()
  */
 void move_cursor(enum directions direction, unsigned int n)
 {
-    char* cmd; /* The command. */
+    char code;  /* The final byte of the escape sequence. */
+
+    /* An escape sequence that moves 0 places moves 1. */
+    if (n == 0)
+        return;
 
-    /* Creating the command. */
     switch (direction)
     {
         case ABOVE:
-            strfmt(&cmd, "tput cuu %d", n);
+            code = 'A';
             break;
         case BELOW:
-            strfmt(&cmd, "tput cud %d", n);
+            code = 'B';
             break;
         case BEFORE:
-            strfmt(&cmd, "tput cub %d", n);
+            code = 'D';
             break;
         case AFTER:
-            strfmt(&cmd, "tput cuf %d", n);
+        default:
+            code = 'C';
             break;
     }
 
     /* Moving the cursor. */
-    system(cmd);
-
-    /* Cleaning up. */
-    free(cmd);
+    fprintf(termfs(), "\033[%u%c", n, code);
 }
 
 /**
@@ -628,15 +1083,9 @@ void print_fs_mod(char* filepath, vec2d origin, enum termcolours colour,
  */
 void print_str(char* str, vec2d pos)
 {
-    char* cmd;  // The command
-
     /* Printing the string. */
     put_cursor(pos.x, pos.y);
-    strfmt(&cmd, "printf \"%s\"", str);
-    system(cmd);
-
-    /* Cleaning up. */
-    free(cmd);
+    fputs(str, termfs());
 }
 
 /**
@@ -661,18 +1110,12 @@ void print_str_mod(char* str, vec2d pos, enum termcolours fcol,
 
 /**
  * This function places the terminal at the row and column numbers
- * provided to it.
+ * provided to it. Rows and columns start at 0.
  */
 void put_cursor(unsigned int col, unsigned int row)
 {
-    char* cmd;   /* The command. */
-
-    /* Setting the cursor position. */
-    strfmt(&cmd, "tput cup %d %d", row, col);
-    system(cmd);
-
-    /* Cleaning up. */
-    free(cmd); 
+    /* Setting the cursor position, which the terminal counts from 1. */
+    fprintf(termfs(), "\033[%u;%uH", row + 1, col + 1);
 }
 
 /**
@@ -680,14 +1123,8 @@ void put_cursor(unsigned int col, unsigned int row)
  */
 void text_bcol(enum termcolours c)
 {
-    char* cmd;  /* The command. */
-
     /* Setting the background colour. */
-    strfmt(&cmd, "tput setab %d", c);
-    system(cmd);
-
-    /* Cleaning up. */
-    free(cmd);
+    fprintf(termfs(), "\033[4%dm", c);
 }
 
 /**
@@ -695,14 +1132,8 @@ void text_bcol(enum termcolours c)
  */
 void text_fcol(enum termcolours c)
 {
-    char* cmd;   /* The command. */
-
     /* Setting the colour. */
-    strfmt(&cmd, "tput setaf %d", c);
-    system(cmd);
-
-    /* Cleaning up. */
-    free(cmd);
+    fprintf(termfs(), "\033[3%dm", c);
 }
 
 /**
@@ -713,10 +1144,10 @@ void text_mode(enum textmodes m)
     /* Changing the terminal text-mode. */
     switch (m) 
     {
-        case BOLD       : system( "tput bold" ); break;
-        case NORMAL     : system( "tput sgr0" ); break;
-        case BLINK      : system( "tput blink" ); break;
-        case REVERSE    : system( "tput smso" ); break;
-        case UNDERLINE  : system( "tput smul" ); break;
+        case BOLD       : fputs("\033[1m", termfs()); break;
+        case NORMAL     : fputs("\033[0m", termfs()); break;
+        case BLINK      : fputs("\033[5m", termfs()); break;
+        case REVERSE    : fputs("\033[7m", termfs()); break;
+        case UNDERLINE  : fputs("\033[4m", termfs()); break;
     }
 }
@@ -19,15 +19,38 @@
 #include <stdarg.h>
 #include <time.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <errno.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 /**
  * This is the number of nanoseconds in a second.
  */
 #define NANOS_PER_SEC 1000000000
 
+/**
+ * This is the size of the string that timestamp() returns.
+ */
+#define TIMESTAMP_SIZE 32
+
+/**
+ * This is the size of the stack buffer that strfmt() formats strings into
+ * before copying them to the heap. Longer strings are formatted twice.
+ */
+#define STRFMT_STACK 256
+
+/**
+ * This is the default size of each block of an arena, and the alignment of
+ * the memory allocarena() returns.
+ */
+#define ARENA_BLOCK (1 << 16)
+#define ARENA_ALIGN _Alignof(max_align_t)
+
 /********************************* Types *************************************/
 
 typedef struct {
@@ -35,6 +58,41 @@ typedef struct {
     int y;
 } vec2d;
 
+/**
+ * This is a buffered writer. Bytes written to it are collected in a large
+ * buffer and written to its file descriptor in as few system calls as
+ * possible.
+ */
+typedef struct {
+    int fd;             /* The file descriptor that is written to. */
+    char* buf;          /* Bytes that haven't been written yet. */
+    size_t len;         /* Number of bytes in the buffer. */
+    size_t cap;         /* Size of the buffer. */
+    uint64_t written;   /* Number of bytes written to fd. */
+    uint64_t write_ns;  /* Nano-seconds spent writing to fd. */
+} bufwriter;
+
+/**
+ * This is a block of an arena.
+ */
+typedef struct arenablock {
+    struct arenablock* next;    /* The next block. */
+    size_t cap;                 /* Number of bytes in data. */
+    size_t used;                /* Number of bytes of data allocated. */
+    _Alignas(max_align_t) char data[];  /* The memory that is allocated. */
+} arenablock;
+
+/**
+ * This is an arena, or bump allocator. Memory is allocated from it by moving
+ * a pointer along a large block, and everything allocated from it is freed
+ * at once, so many small allocations cost almost nothing.
+ */
+typedef struct {
+    arenablock* first;  /* The first block. */
+    arenablock* cur;    /* The block memory is allocated from. */
+    size_t block;       /* The size of new blocks. */
+} arena;
+
 /******************************** Maths **************************************/
 
 /**
@@ -58,6 +116,12 @@ bool check_timer(struct timespec ts_start, uint64_t wait_time);
  */
 void start_timer(struct timespec* ts);
 
+/**
+ * This function returns the number of nano-seconds that have elapsed since
+ * start.
+ */
+uint64_t elapsed_timer(struct timespec start);
+
 /**
  * This function returns a string that represent the current time.
  */
@@ -92,6 +156,21 @@ void closefs(FILE* fp);
  */
 FILE* openfs(char* fname, char* mode);
 
+/**
+ * This function maps the whole of the regular file behind the file stream
+ * provided to it into memory and returns a pointer to the mapping, storing
+ * the length of the mapping in len. It returns NULL if the file can't be
+ * mapped (e.g. it is a pipe or it is empty), in which case the stream can
+ * still be read with readfsl(). If an error occurs the program will exit.
+ * Make sure to unmapfs() the mapping when you're finished with it.
+ */
+char* mapfs(FILE* fstreamp, size_t* len);
+
+/**
+ * This function unmaps a mapping that was returned by mapfs().
+ */
+void unmapfs(char* map, size_t len);
+
 /**
  * This function assigns the next char in the file stream provided to it to
  * the buffer provided to it.
@@ -106,6 +185,21 @@ bool readfsc(FILE* fstreamp, char* buf);
  */
 bool readfsl(FILE* fstreamp, char** buf);
 
+/**
+ * This function is readfsl() that also stores the length of the line,
+ * including its newline, in len. Unlike strlen() it counts every char of
+ * the line, even if the line holds null characters.
+ */
+bool readfsln(FILE* fstreamp, char** buf, size_t* len);
+
+/**
+ * This function reads the rest of the file stream provided to it into a
+ * buffer and returns it, storing the number of bytes read in len. It is for
+ * streams that can't be mapped with mapfs(). If an error occurs the program
+ * will exit. Make sure to free() the buffer when you're finished with it.
+ */
+char* readfsall(FILE* fstreamp, size_t* len);
+
 /**
  * This function writes the char provided to it to the file stream provided to
  * it.
@@ -119,6 +213,32 @@ void writefsc(FILE* fstreamp, char ch);
 void writefss(FILE* fstreamp, char* str);
 
 
+/**
+ * This function creates a buffered writer that writes to the file descriptor
+ * provided to it through a buffer of cap bytes. If an error occurs the
+ * program will exit.
+ */
+bufwriter* openbw(int fd, size_t cap);
+
+/**
+ * This function writes len bytes of data to the buffered writer provided to
+ * it. The data is only written to the file descriptor when the buffer fills
+ * up. If an error occurs the program will exit.
+ */
+void writebw(bufwriter* bw, const char* data, size_t len);
+
+/**
+ * This function writes everything in the buffered writer provided to it to
+ * its file descriptor. If an error occurs the program will exit.
+ */
+void flushbw(bufwriter* bw);
+
+/**
+ * This function flushes and frees the buffered writer provided to it. It
+ * doesn't close the writer's file descriptor.
+ */
+void closebw(bufwriter* bw);
+
 /******************************** Strings ************************************/
 
 /**
@@ -137,13 +257,13 @@ void strfmt(char** sp, char *fmt, ...);
 
 /**
  * This function removes the char element from the string provided to it which
- * is at the element number provided to it.
+ * is at the element number provided to it. The string is changed in place.
  */
 void sdelelem(char** sp, unsigned elem);
 
 /**
  * This function removes all cases of the provided char from the string at the
- * provided pointer.
+ * provided pointer. The string is changed in place, in one pass.
  */
 void sdelchar(char** sp, char remove);
 
@@ -153,6 +273,47 @@ void sdelchar(char** sp, char remove);
  */
 //void stringrmlast(char** s);
 
+/********************************* Memory ************************************/
+
+/**
+ * This function creates an arena that allocates memory in blocks of block
+ * bytes, or ARENA_BLOCK bytes if block is 0. Allocations larger than a block
+ * get a block of their own. If an error occurs the program will exit. Make
+ * sure to closearena() the arena when you're finished with it.
+ */
+arena* openarena(size_t block);
+
+/**
+ * This function allocates size bytes from the arena provided to it, aligned
+ * for any type. If an error occurs the program will exit.
+ */
+void* allocarena(arena* a, size_t size);
+
+/**
+ * This function copies len bytes of data into the arena provided to it,
+ * without aligning them or adding a null character, and returns the copy.
+ * If an error occurs the program will exit.
+ */
+char* copyarena(arena* a, const char* data, size_t len);
+
+/**
+ * This function is strfmt() for strings allocated from the arena provided to
+ * it. It returns the string, which is freed with the arena.
+ */
+char* strfmtarena(arena* a, char* fmt, ...);
+
+/**
+ * This function frees everything allocated from the arena provided to it at
+ * once, keeping its blocks to allocate from again.
+ */
+void resetarena(arena* a);
+
+/**
+ * This function frees the arena provided to it and everything allocated from
+ * it.
+ */
+void closearena(arena* a);
+
 /******************************* Terminal ************************************/
 
 #define LINE_HEIGHT 8
@@ -184,6 +345,24 @@ enum textmodes {
     UNDERLINE
     };
 
+/**
+ * The terminal functions write ANSI escape sequences to stdout, or the stream
+ * given to set_term(), through its stdio buffer. Nothing reaches the terminal
+ * until the stream is flushed, so a whole frame can be drawn and then shown
+ * at once with flush_term().
+ */
+
+/**
+ * This function makes the terminal functions write to the stream provided
+ * to it (e.g. stderr) instead of stdout.
+ */
+void set_term(FILE* fs);
+
+/**
+ * This function writes any terminal output that is still buffered.
+ */
+void flush_term();
+
 /**
  * This function clears the terminal.
  */
@@ -208,7 +387,9 @@ void clearf();
 void clearfb();
 
 /**
- * This function returns the number of rows and columns of the terminal.
+ * This function returns the number of rows and columns of the terminal, in
+ * x and y. It asks the terminal with ioctl(TIOCGWINSZ), and falls back to the
+ * COLUMNS and LINES environment variables, then 80x24, if there isn't one.
  */
 vec2d get_res();
 
@@ -243,7 +424,7 @@ void print_str_mod(char* str, vec2d origin, enum termcolours fcol,
 
 /**
  * This function places the terminal cursor at the row and column numbers
- * provided to it.
+ * provided to it. Rows and columns start at 0.
  */
 void put_cursor(unsigned int col, unsigned int row);
 
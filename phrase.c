@@ -0,0 +1,459 @@
+/**
+ * phrase.c
+ *
+ * This file contains the definitions of the functions that find phrases of
+ * two or three words whose combined sum is a target.
+ *
+ * Checking every pair of words in a large wordlist is far too slow, so the
+ * words are first bucketed by their sums. For each bucket, the sum the other
+ * words of a phrase need is known, so only the buckets holding those sums are
+ * visited and every combination found in them is a result. The work done is
+ * proportional to the number of buckets plus the number of results.
+ *
+ * Author: Richard Gale
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "mycutils.h"
+#include "linesum.h"
+#include "cipher.h"
+#include "phrase.h"
+
+/**
+ * This is the number of words the kernel sums per call while bucketing.
+ */
+#define PHRASE_BATCH 4096
+
+/**
+ * These are the phrases found from one bucket, which is the bucket holding
+ * the phrases' smallest sum.
+ */
+struct result {
+    char* buf;          /* The phrases, one per line. */
+    size_t len;         /* Number of bytes of phrases. */
+    size_t cap;         /* Number of bytes allocated. */
+    uint64_t count;     /* Number of phrases. */
+    bool done;          /* Whether the bucket has been searched. */
+};
+
+/**
+ * This is the state of a search that is shared by its threads.
+ */
+struct search {
+    const struct buckets* b;        /* The bucketed words. */
+    const struct phrase_opts* opts; /* The settings of the search. */
+    long target;                    /* The sum to search for. */
+    struct result* results;         /* The results of each bucket. */
+    atomic_size_t next;             /* The next bucket to search. */
+    size_t ndone;                   /* Number of buckets, from the first,
+                                     * that have all been searched. */
+    atomic_uint_fast64_t found;     /* Number of phrases found by those
+                                     * buckets. */
+    pthread_mutex_t lock;           /* Protects the results' done flags and
+                                     * ndone. */
+    pthread_cond_t cond;            /* Signalled when a bucket is done. */
+};
+
+/**
+ * This function prints an error message and exits the program.
+ */
+static void phrase_error(const char* func, int err)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, strerror(err));
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function compares two words by their sums and then by where they
+ * appear in the wordlist, for qsort().
+ */
+static int compare_words(const void* a, const void* b)
+{
+    const struct word* x = a;
+    const struct word* y = b;
+
+    if (x->sum != y->sum)
+        return (x->sum > y->sum) - (x->sum < y->sum);
+
+    return (x->str > y->str) - (x->str < y->str);
+}
+
+/**
+ * This function sums every non-empty line of the buffer provided to it and
+ * buckets the words by their sums. If c isn't NULL the words are summed with
+ * it instead of their ascii values.
+ */
+struct buckets* bucket_words(const char* buf, size_t len, const struct cipher* c)
+{
+    struct linesum sums[PHRASE_BATCH];  /* Sums of the current batch. */
+    struct buckets* b;                  /* The buckets. */
+    size_t cap;                         /* Number of words allocated. */
+    size_t pos;                         /* Offset of the current batch. */
+    size_t used;                        /* Bytes consumed by the batch. */
+    size_t n;                           /* Number of words in the batch. */
+    size_t i;                           /* Index of the current word. */
+
+    if ((b = calloc(1, sizeof(struct buckets))) == NULL)
+        phrase_error("bucket_words", errno);
+
+    /* Summing every word. The last word may not end with a newline, so
+     * there is always room left for it. */
+    cap = PHRASE_BATCH + 1;
+    if ((b->words = malloc(sizeof(struct word) * cap)) == NULL)
+        phrase_error("bucket_words", errno);
+
+    pos = 0;
+    while ((n = linesums(buf + pos, len - pos, sums, PHRASE_BATCH, &used)))
+    {
+        if (b->nwords + n + 1 > cap)
+        {
+            cap = cap * 2 + n;
+            if ((b->words = realloc(b->words, sizeof(struct word) * cap)) == NULL)
+                phrase_error("bucket_words", errno);
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            if (sums[i].len == 0)
+                continue;
+
+            b->words[b->nwords].str = buf + pos + sums[i].off;
+            b->words[b->nwords].len = sums[i].len;
+            b->words[b->nwords].sum = c == NULL ? sums[i].sum
+                    : cipher_sum(c, buf + pos + sums[i].off, sums[i].len);
+            b->nwords++;
+        }
+        pos += used;
+    }
+
+    if (pos < len)
+    {
+        b->words[b->nwords].str = buf + pos;
+        b->words[b->nwords].len = len - pos;
+        b->words[b->nwords].sum = 0;
+        for (i = pos; i < len; i++)
+            b->words[b->nwords].sum += (int) buf[i];
+        if (c != NULL)
+            b->words[b->nwords].sum = cipher_sum(c, buf + pos, len - pos);
+        b->nwords++;
+    }
+
+    /* Grouping the words by their sums. */
+    qsort(b->words, b->nwords, sizeof(struct word), compare_words);
+
+    /* Finding where each bucket starts. */
+    b->sums = malloc(sizeof(long) * (b->nwords + 1));
+    b->starts = malloc(sizeof(size_t) * (b->nwords + 1));
+    if (b->sums == NULL || b->starts == NULL)
+        phrase_error("bucket_words", errno);
+
+    for (i = 0; i < b->nwords; i++)
+    {
+        if (i == 0 || b->words[i].sum != b->words[i - 1].sum)
+        {
+            b->sums[b->nbuckets] = b->words[i].sum;
+            b->starts[b->nbuckets] = i;
+            b->nbuckets++;
+        }
+    }
+
+    /* The end of the last bucket. */
+    b->starts[b->nbuckets] = b->nwords;
+
+    return b;
+}
+
+/**
+ * This function frees buckets that were made by bucket_words().
+ */
+void free_buckets(struct buckets* b)
+{
+    free(b->words);
+    free(b->sums);
+    free(b->starts);
+    free(b);
+}
+
+/**
+ * This function returns the index of the bucket holding the sum provided to
+ * it, or -1 if there is no such bucket.
+ */
+static long find_bucket(const struct buckets* b, long sum)
+{
+    size_t lo;  /* Lowest bucket that might hold the sum. */
+    size_t hi;  /* One past the highest bucket that might hold the sum. */
+    size_t mid; /* The bucket being checked. */
+
+    lo = 0;
+    hi = b->nbuckets;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (b->sums[mid] == sum)
+            return mid;
+        if (b->sums[mid] < sum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+/**
+ * This function adds a phrase of the n words provided to it to the result,
+ * with the words in the order they appear in the wordlist. It returns false
+ * if the result now holds as many phrases as the search may find.
+ */
+static bool add_phrase(struct search* s, struct result* r,
+                       const struct word** w, unsigned n)
+{
+    const struct word* tmp; /* Used when swapping words. */
+    size_t len;             /* Length of the phrase. */
+    unsigned i;
+    unsigned j;
+
+    /* Putting the words in wordlist order. */
+    for (i = 1; i < n; i++)
+    {
+        for (j = i; j > 0 && w[j]->str < w[j - 1]->str; j--)
+        {
+            tmp = w[j];
+            w[j] = w[j - 1];
+            w[j - 1] = tmp;
+        }
+    }
+
+    /* Making room for the phrase. */
+    len = n;
+    for (i = 0; i < n; i++)
+        len += w[i]->len;
+
+    if (r->len + len > r->cap)
+    {
+        r->cap = r->cap * 2 > r->len + len ? r->cap * 2 : r->len + len + 4096;
+        if ((r->buf = realloc(r->buf, r->cap)) == NULL)
+            phrase_error("add_phrase", errno);
+    }
+
+    /* Adding the words separated by spaces. */
+    for (i = 0; i < n; i++)
+    {
+        memcpy(r->buf + r->len, w[i]->str, w[i]->len);
+        r->len += w[i]->len;
+        r->buf[r->len++] = i + 1 < n ? ' ' : '\n';
+    }
+
+    r->count++;
+
+    return s->opts->max_results == 0 || r->count < s->opts->max_results;
+}
+
+/**
+ * This function finds the pairs whose first word is in bucket i.
+ */
+static void search_pairs(struct search* s, size_t i, struct result* r)
+{
+    const struct buckets* b = s->b;
+    const struct word* w[2];    /* The words of the current phrase. */
+    long gap;                   /* Sum of the space between the words. */
+    long j;                     /* The bucket of the second word. */
+    size_t x;                   /* Index of the first word. */
+    size_t y;                   /* Index of the second word. */
+
+    gap = s->opts->space;
+
+    /* The second word's sum must be at least the first's, so each pair of
+     * buckets is only visited once. */
+    if (s->target - gap - b->sums[i] < b->sums[i])
+        return;
+
+    if ((j = find_bucket(b, s->target - gap - b->sums[i])) == -1)
+        return;
+
+    for (x = b->starts[i]; x < b->starts[i + 1]; x++)
+    {
+        /* In the same bucket, each pair is only taken once. */
+        for (y = (size_t) j == i ? x + 1 : b->starts[j]; y < b->starts[j + 1]; y++)
+        {
+            w[0] = &b->words[x];
+            w[1] = &b->words[y];
+            if (!add_phrase(s, r, w, 2))
+                return;
+        }
+    }
+}
+
+/**
+ * This function finds the triples whose first word is in bucket i.
+ */
+static void search_triples(struct search* s, size_t i, struct result* r)
+{
+    const struct buckets* b = s->b;
+    const struct word* w[3];    /* The words of the current phrase. */
+    long gap;                   /* Sum of the spaces between the words. */
+    long rest;                  /* Sum the third word needs. */
+    long k;                     /* The bucket of the third word. */
+    size_t j;                   /* The bucket of the second word. */
+    size_t x;                   /* Index of the first word. */
+    size_t y;                   /* Index of the second word. */
+    size_t z;                   /* Index of the third word. */
+
+    gap = 2 * s->opts->space;
+
+    /* The words' sums never decrease from first to third, so each set of
+     * buckets is only visited once. */
+    for (j = i; j < b->nbuckets; j++)
+    {
+        rest = s->target - gap - b->sums[i] - b->sums[j];
+        if (rest < b->sums[j])
+            break;
+
+        if ((k = find_bucket(b, rest)) == -1)
+            continue;
+
+        for (x = b->starts[i]; x < b->starts[i + 1]; x++)
+        {
+            for (y = j == i ? x + 1 : b->starts[j]; y < b->starts[j + 1]; y++)
+            {
+                for (z = (size_t) k == j ? y + 1 : b->starts[k];
+                     z < b->starts[k + 1]; z++)
+                {
+                    w[0] = &b->words[x];
+                    w[1] = &b->words[y];
+                    w[2] = &b->words[z];
+                    if (!add_phrase(s, r, w, 3))
+                        return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * This function is run by each search thread. It takes buckets in ascending
+ * order until there are none left and searches each one unless the buckets
+ * before it have already found enough phrases. Only the buckets before it
+ * are counted, so a bucket is never skipped because of the phrases a later
+ * one found first.
+ */
+static void* search_worker(void* arg)
+{
+    struct search* s = arg;
+    uint64_t max = s->opts->max_results;
+    size_t i;   /* The bucket being searched. */
+
+    while ((i = atomic_fetch_add(&s->next, 1)) < s->b->nbuckets)
+    {
+        /* found only counts buckets before this one, since this one isn't
+         * done, so if they have found enough phrases it isn't needed. */
+        if (max == 0 || atomic_load(&s->found) < max)
+        {
+            if (s->opts->nwords == 2)
+                search_pairs(s, i, &s->results[i]);
+            else
+                search_triples(s, i, &s->results[i]);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        s->results[i].done = true;
+
+        /* Counting the phrases of the buckets that are now done in order. */
+        while (s->ndone < s->b->nbuckets && s->results[s->ndone].done)
+            atomic_fetch_add(&s->found, s->results[s->ndone++].count);
+
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * This function finds every phrase of opts->nwords different words whose
+ * combined sum is target and calls save for each bucket's phrases. The
+ * buckets are searched by opts->nthreads threads while this thread saves
+ * the results of each bucket, in order, as soon as it is done, so the
+ * phrases are always saved in the same order.
+ */
+uint64_t find_phrases(const struct buckets* b, long target,
+                      const struct phrase_opts* opts, phrase_fn save, void* arg)
+{
+    struct search s;        /* The state of the search. */
+    pthread_t* threads;     /* The search threads. */
+    unsigned nthreads;      /* Number of search threads. */
+    uint64_t saved;         /* Number of phrases saved. */
+    uint64_t keep;          /* Number of the bucket's phrases to save. */
+    const char* end;        /* End of the phrases to save. */
+    size_t i;               /* Index of the current thread or bucket. */
+    int err;                /* Error returned by pthread_create(). */
+
+    s.b = b;
+    s.opts = opts;
+    s.target = target;
+    atomic_init(&s.next, 0);
+    s.ndone = 0;
+    atomic_init(&s.found, 0);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+
+    nthreads = opts->nthreads > 0 ? opts->nthreads : 1;
+    s.results = calloc(b->nbuckets + 1, sizeof(struct result));
+    threads = malloc(sizeof(pthread_t) * nthreads);
+    if (s.results == NULL || threads == NULL)
+        phrase_error("find_phrases", errno);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        if ((err = pthread_create(&threads[i], NULL, search_worker, &s)) != 0)
+            phrase_error("find_phrases", err);
+    }
+
+    /* Saving each bucket's phrases in order. */
+    saved = 0;
+    for (i = 0; i < b->nbuckets; i++)
+    {
+        pthread_mutex_lock(&s.lock);
+        while (!s.results[i].done)
+            pthread_cond_wait(&s.cond, &s.lock);
+        pthread_mutex_unlock(&s.lock);
+
+        /* Cutting the phrases off at the limit. */
+        keep = s.results[i].count;
+        end = s.results[i].buf + s.results[i].len;
+        if (opts->max_results != 0 && saved + keep > opts->max_results)
+        {
+            keep = opts->max_results - saved;
+            for (end = s.results[i].buf; end < s.results[i].buf + s.results[i].len
+                                         && keep > 0; end++)
+            {
+                if (*end == '\n')
+                    keep--;
+            }
+            keep = opts->max_results - saved;
+        }
+
+        if (end > s.results[i].buf)
+            save(s.results[i].buf, end - s.results[i].buf, arg);
+
+        saved += keep;
+        free(s.results[i].buf);
+    }
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.cond);
+    free(s.results);
+    free(threads);
+
+    return saved;
+}
@@ -0,0 +1,81 @@
+/**
+ * phrase.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for finding phrases of two or three words from a wordlist
+ * whose combined sum is a target.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef PHRASE_H
+#define PHRASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cipher.h"
+
+/**
+ * This is one word of a wordlist.
+ */
+struct word {
+    const char* str;    /* The word, which isn't null terminated. */
+    size_t len;         /* Length of the word. */
+    long sum;           /* Sum of the word. */
+};
+
+/**
+ * These are the words of a wordlist bucketed by their sums. The buckets are
+ * in ascending order of sum and the words in each bucket are in the order
+ * they appear in the wordlist.
+ */
+struct buckets {
+    struct word* words;     /* Every word, grouped by sum. */
+    size_t nwords;          /* Number of words. */
+    long* sums;             /* The sum of each bucket. */
+    size_t* starts;         /* Index of each bucket's first word. */
+    size_t nbuckets;        /* Number of buckets. */
+};
+
+/**
+ * These are the settings of a phrase search.
+ */
+struct phrase_opts {
+    unsigned nwords;        /* Words per phrase, 2 or 3. */
+    long space;             /* Sum of each space between words, or 0. */
+    uint64_t max_results;   /* Most phrases to find, or 0 for no limit. */
+    unsigned nthreads;      /* Number of threads that search. */
+};
+
+/**
+ * This is the type of the functions that are given the phrases that are
+ * found. They are given one or more whole phrases at a time, each one being
+ * its words separated by spaces and ending with a newline.
+ */
+typedef void (*phrase_fn)(const char* phrase, size_t len, void* arg);
+
+/**
+ * This function sums every non-empty line of the buffer provided to it and
+ * buckets the words by their sums. If c isn't NULL the words are summed with
+ * it instead of their ascii values. The words point into the buffer so it
+ * must outlive the buckets. If an error occurs the program will exit.
+ */
+struct buckets* bucket_words(const char* buf, size_t len, const struct cipher* c);
+
+/**
+ * This function frees buckets that were made by bucket_words().
+ */
+void free_buckets(struct buckets* b);
+
+/**
+ * This function finds every phrase of opts->nwords different words whose
+ * combined sum is target and gives them to save, in the same order no matter
+ * how many threads search. Each combination of words is found once,
+ * with its words in wordlist order. It returns the number of phrases found.
+ */
+uint64_t find_phrases(const struct buckets* b, long target,
+                      const struct phrase_opts* opts, phrase_fn save, void* arg);
+
+#endif // PHRASE_H
@@ -0,0 +1,292 @@
+/**
+ * pool.c
+ *
+ * This file contains the definitions of the functions of the work-stealing
+ * thread pool. The deques are guarded by their own locks rather than being
+ * lock-free, since the pool's tasks are whole wordlists or megabytes of one,
+ * so a lock per task costs nothing next to the task itself.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "pool.h"
+
+/**
+ * This is the number of tasks each deque has room for at first.
+ */
+#define DEQUE_INITIAL_CAP 64
+
+/**
+ * This is the pool of the current thread, if it is a worker thread.
+ */
+static _Thread_local struct pool* self_pool;
+
+/**
+ * This is the index of the current thread in its pool.
+ */
+static _Thread_local unsigned self_id;
+
+/**
+ * This is what each worker thread is started with.
+ */
+struct worker_arg {
+    struct pool* p;     /* The pool. */
+    unsigned id;        /* Index of the worker. */
+};
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void pool_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function puts a task on the back of a deque.
+ */
+static void push_back(struct deque* d, struct task t)
+{
+    struct task* tasks;     /* The grown ring buffer. */
+    size_t i;
+
+    pthread_mutex_lock(&d->lock);
+
+    if (d->len == d->cap)
+    {
+        if ((tasks = malloc(sizeof(struct task) * d->cap * 2)) == NULL)
+            pool_error("push_back", strerror(errno));
+        for (i = 0; i < d->len; i++)
+            tasks[i] = d->tasks[(d->head + i) & (d->cap - 1)];
+        free(d->tasks);
+        d->tasks = tasks;
+        d->head = 0;
+        d->cap *= 2;
+    }
+
+    d->tasks[(d->head + d->len) & (d->cap - 1)] = t;
+    d->len++;
+
+    pthread_mutex_unlock(&d->lock);
+}
+
+/**
+ * This function takes the newest task from the back of a deque, or the
+ * oldest from its front if steal is true. It returns false if the deque is
+ * empty.
+ */
+static bool take(struct deque* d, bool steal, struct task* t)
+{
+    pthread_mutex_lock(&d->lock);
+
+    if (d->len == 0)
+    {
+        pthread_mutex_unlock(&d->lock);
+        return false;
+    }
+
+    if (steal)
+    {
+        *t = d->tasks[d->head];
+        d->head = (d->head + 1) & (d->cap - 1);
+    }
+    else
+    {
+        *t = d->tasks[(d->head + d->len - 1) & (d->cap - 1)];
+    }
+    d->len--;
+
+    pthread_mutex_unlock(&d->lock);
+
+    return true;
+}
+
+/**
+ * This function finds a task for worker id, from its own deque or else by
+ * stealing one from the other workers' deques, starting with the next
+ * worker's. It returns false if every deque is empty.
+ */
+static bool find_task(struct pool* p, unsigned id, struct task* t)
+{
+    unsigned i;
+
+    if (take(&p->deques[id], false, t))
+        return true;
+
+    for (i = 1; i < p->nthreads; i++)
+    {
+        if (take(&p->deques[(id + i) % p->nthreads], true, t))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * This function is run by each worker thread. It runs tasks until the pool
+ * is stopped, and sleeps while there are none.
+ */
+static void* pool_worker(void* arg)
+{
+    struct worker_arg* wa = arg;
+    struct pool* p = wa->p;
+    struct task t;      /* The current task. */
+
+    self_pool = p;
+    self_id = wa->id;
+    free(wa);
+
+    for (;;)
+    {
+        if (!find_task(p, self_id, &t))
+        {
+            /* A task that was counted but not yet pushed, or taken by
+             * another worker but not yet uncounted, makes this look again
+             * rather than sleep. */
+            pthread_mutex_lock(&p->lock);
+            while (p->queued == 0 && !p->stop)
+                pthread_cond_wait(&p->work, &p->lock);
+            if (p->stop)
+            {
+                pthread_mutex_unlock(&p->lock);
+                break;
+            }
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        p->queued--;
+        pthread_mutex_unlock(&p->lock);
+
+        t.fn(t.arg);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->pending == 0)
+            pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * This function starts a pool of nthreads worker threads.
+ */
+struct pool* open_pool(unsigned nthreads)
+{
+    struct worker_arg* wa;  /* What the current worker is started with. */
+    struct pool* p;         /* The pool. */
+    unsigned i;
+    int err;                /* Error returned by pthread_create(). */
+
+    if (nthreads == 0)
+        nthreads = 1;
+
+    if ((p = calloc(1, sizeof(struct pool))) == NULL
+        || (p->deques = calloc(nthreads, sizeof(struct deque))) == NULL
+        || (p->threads = malloc(sizeof(pthread_t) * nthreads)) == NULL)
+        pool_error("open_pool", strerror(errno));
+
+    p->nthreads = nthreads;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        p->deques[i].cap = DEQUE_INITIAL_CAP;
+        if ((p->deques[i].tasks = malloc(sizeof(struct task)
+                                         * DEQUE_INITIAL_CAP)) == NULL)
+            pool_error("open_pool", strerror(errno));
+        pthread_mutex_init(&p->deques[i].lock, NULL);
+    }
+
+    for (i = 0; i < nthreads; i++)
+    {
+        if ((wa = malloc(sizeof(struct worker_arg))) == NULL)
+            pool_error("open_pool", strerror(errno));
+        wa->p = p;
+        wa->id = i;
+        if ((err = pthread_create(&p->threads[i], NULL, pool_worker, wa)) != 0)
+            pool_error("open_pool", strerror(err));
+    }
+
+    return p;
+}
+
+/**
+ * This function submits a task to the pool.
+ */
+void submit_task(struct pool* p, task_fn fn, void* arg)
+{
+    struct task t = { fn, arg };
+    unsigned id;    /* The worker whose deque the task goes on. */
+
+    /* The task is counted as pending and queued before it can be run, so the
+     * pool can never look finished while it is being pushed, and a worker
+     * that takes it can't uncount it before it is counted. */
+    pthread_mutex_lock(&p->lock);
+    p->pending++;
+    p->queued++;
+    if (self_pool == p)
+        id = self_id;
+    else
+        id = p->next++ % p->nthreads;
+    pthread_mutex_unlock(&p->lock);
+
+    push_back(&p->deques[id], t);
+
+    /* The signal comes after the push, so the woken worker finds it. */
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * This function waits until every task is done.
+ */
+void wait_pool(struct pool* p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > 0)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * This function stops the pool's worker threads and frees it.
+ */
+void close_pool(struct pool* p)
+{
+    unsigned i;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    for (i = 0; i < p->nthreads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    for (i = 0; i < p->nthreads; i++)
+    {
+        pthread_mutex_destroy(&p->deques[i].lock);
+        free(p->deques[i].tasks);
+    }
+
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+    free(p->deques);
+    free(p->threads);
+    free(p);
+}
@@ -0,0 +1,91 @@
+/**
+ * pool.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for a work-stealing thread pool.
+ *
+ * Each worker thread has its own deque of tasks. A worker takes the newest
+ * task from the back of its own deque, and when its deque is empty it steals
+ * the oldest task from the front of another worker's. Tasks that are
+ * submitted by a task go on the back of its worker's deque, so a task that
+ * splits its work into smaller tasks (e.g. a huge wordlist into chunks)
+ * keeps working through them itself while idle workers steal the rest.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * This is the type of the functions that run a task.
+ */
+typedef void (*task_fn)(void* arg);
+
+/**
+ * This is a task.
+ */
+struct task {
+    task_fn fn;     /* The function that runs the task. */
+    void* arg;      /* The argument given to fn. */
+};
+
+/**
+ * This is one worker thread's deque of tasks. It is a ring buffer whose
+ * front is the oldest task.
+ */
+struct deque {
+    struct task* tasks;     /* The tasks. */
+    size_t cap;             /* Number of tasks allocated, a power of two. */
+    size_t head;            /* Index of the front task. */
+    size_t len;             /* Number of tasks. */
+    pthread_mutex_t lock;   /* Guards the deque. */
+};
+
+/**
+ * This is a work-stealing thread pool.
+ */
+struct pool {
+    struct deque* deques;   /* The deque of each worker. */
+    pthread_t* threads;     /* The worker threads. */
+    unsigned nthreads;      /* Number of worker threads. */
+    unsigned next;          /* The deque the next task from outside goes on. */
+
+    pthread_mutex_t lock;   /* Guards the counts and stop. */
+    pthread_cond_t work;    /* Signalled when a task is submitted. */
+    pthread_cond_t done;    /* Signalled when every task is done. */
+    size_t queued;          /* Number of tasks in the deques. */
+    size_t pending;         /* Number of tasks submitted but not done. */
+    bool stop;              /* Whether the workers should stop. */
+};
+
+/**
+ * This function starts a pool of nthreads worker threads. If an error
+ * occurs the program will exit.
+ */
+struct pool* open_pool(unsigned nthreads);
+
+/**
+ * This function submits a task to the pool. A task submitted by one of the
+ * pool's tasks goes on its own worker's deque, and any other task on the
+ * next worker's deque in turn. If an error occurs the program will exit.
+ */
+void submit_task(struct pool* p, task_fn fn, void* arg);
+
+/**
+ * This function waits until every task that has been submitted to the pool,
+ * including tasks submitted by tasks, is done.
+ */
+void wait_pool(struct pool* p);
+
+/**
+ * This function stops the pool's worker threads and frees it. Tasks that
+ * haven't started are never run.
+ */
+void close_pool(struct pool* p);
+
+#endif // POOL_H
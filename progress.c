@@ -0,0 +1,215 @@
+/**
+ * progress.c
+ *
+ * This file contains the definitions of the functions that draw the progress
+ * line. It is drawn with the terminal functions in mycutils, writing to
+ * stderr so the progress line doesn't get mixed into a savefile of -.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "progress.h"
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void progress_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function formats a number of bytes with a binary unit into the
+ * buffer provided to it.
+ */
+static void format_bytes(char* buf, size_t size, double bytes)
+{
+    const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    size_t u;
+
+    for (u = 0; bytes >= 1024 && u < sizeof(units) / sizeof(units[0]) - 1; u++)
+        bytes /= 1024;
+
+    snprintf(buf, size, u == 0 ? "%.0f %s" : "%.1f %s", bytes, units[u]);
+}
+
+/**
+ * This function formats a number of seconds as H:MM:SS into the buffer
+ * provided to it.
+ */
+static void format_time(char* buf, size_t size, uint64_t secs)
+{
+    snprintf(buf, size, "%llu:%02llu:%02llu",
+             (unsigned long long) (secs / 3600),
+             (unsigned long long) (secs / 60 % 60),
+             (unsigned long long) (secs % 60));
+}
+
+/**
+ * This function draws the progress line. If final is true, the throughput is
+ * the scan's average and the time taken is shown instead of the time left.
+ */
+static void draw_progress(struct progress* p, bool final)
+{
+    char line[256];     /* The progress line. */
+    char done[32];      /* The bytes scanned. */
+    char total[32];     /* The length of the wordlist. */
+    char rate[32];      /* The throughput. */
+    char eta[32];       /* The time left, or taken. */
+    uint64_t bytes;     /* Number of bytes scanned. */
+    uint64_t matches;   /* Number of matches found. */
+    uint64_t now;       /* Nano-seconds since the scan started. */
+    double secs;        /* Seconds the throughput is measured over. */
+    double bps;         /* The throughput in bytes per second. */
+    double avg;         /* The average throughput in bytes per second. */
+    vec2d res;          /* Size of the terminal. */
+    int n;              /* Length of the progress line. */
+
+    bytes = atomic_load_explicit(&p->bytes, memory_order_relaxed);
+    matches = atomic_load_explicit(&p->matches, memory_order_relaxed);
+    now = elapsed_timer(p->start);
+
+    /* The current throughput is measured since the line was last drawn. */
+    avg = now > 0 ? (double) bytes * NANOS_PER_SEC / now : 0;
+    secs = (double) (now - p->last_ns) / NANOS_PER_SEC;
+    bps = final ? avg : secs > 0 ? (bytes - p->last_bytes) / secs : 0;
+    p->last_bytes = bytes;
+    p->last_ns = now;
+
+    format_bytes(done, sizeof(done), bytes);
+    format_bytes(rate, sizeof(rate), bps);
+
+    if (final)
+        format_time(eta, sizeof(eta), now / NANOS_PER_SEC);
+    else if (p->total > bytes && avg > 0)
+        format_time(eta, sizeof(eta), (p->total - bytes) / avg);
+    else
+        snprintf(eta, sizeof(eta), "-:--:--");
+
+    if (p->total > 0)
+    {
+        format_bytes(total, sizeof(total), p->total);
+        n = snprintf(line, sizeof(line),
+                     "%5.1f%%  %s of %s  %s/s  %llu matches  %s %s",
+                     bytes < p->total ? 100.0 * bytes / p->total : 100.0,
+                     done, total, rate, (unsigned long long) matches,
+                     final ? "took" : "ETA", eta);
+    }
+    else
+    {
+        n = snprintf(line, sizeof(line), "%s  %s/s  %llu matches%s%s",
+                     done, rate, (unsigned long long) matches,
+                     final ? "  took " : "", final ? eta : "");
+    }
+
+    if (!p->tty)
+    {
+        fprintf(stderr, "%s\n", line);
+        return;
+    }
+
+    /* Redrawing the line in place, cut to the width of the terminal so it
+     * doesn't wrap onto another line. */
+    res = get_res();
+    if (res.x > 1 && n >= res.x)
+        line[res.x - 1] = '\0';
+    fputc('\r', stderr);
+    fputs(line, stderr);
+    clearf();
+    if (final)
+        fputc('\n', stderr);
+    flush_term();
+}
+
+/**
+ * This function is run by the progress line's thread. It draws the progress
+ * line at a fixed interval until it is told to stop.
+ */
+static void* progress_thread(void* arg)
+{
+    struct progress* p = arg;
+    struct timespec wake;   /* When to draw the line next. */
+    uint64_t interval;      /* Nano-seconds between drawing the line. */
+
+    interval = (uint64_t) (p->tty ? PROGRESS_INTERVAL_MS
+                                  : PROGRESS_LOG_INTERVAL_MS) * 1000000;
+
+    /* The deadlines are on the monotonic clock, like the wake condition,
+     * so a step of the wall clock doesn't stall or hurry the line. */
+    pthread_mutex_lock(&p->lock);
+    clock_gettime(CLOCK_MONOTONIC, &wake);
+    while (!p->stop)
+    {
+        wake.tv_nsec += interval % NANOS_PER_SEC;
+        wake.tv_sec += interval / NANOS_PER_SEC + wake.tv_nsec / NANOS_PER_SEC;
+        wake.tv_nsec %= NANOS_PER_SEC;
+
+        while (!p->stop
+               && pthread_cond_timedwait(&p->wake, &p->lock, &wake) == 0)
+            ;
+
+        if (!p->stop)
+            draw_progress(p, false);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/**
+ * This function starts drawing a progress line.
+ */
+struct progress* start_progress(uint64_t total)
+{
+    struct progress* p;
+    pthread_condattr_t attr;    /* Attributes of the wake condition. */
+
+    if ((p = calloc(1, sizeof(struct progress))) == NULL)
+        progress_error("start_progress", strerror(errno));
+
+    atomic_init(&p->bytes, 0);
+    atomic_init(&p->matches, 0);
+    p->total = total;
+    p->tty = isatty(STDERR_FILENO);
+    p->stop = false;
+    start_timer(&p->start);
+
+    set_term(stderr);
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    if ((errno = pthread_create(&p->thread, NULL, progress_thread, p)) != 0)
+        progress_error("start_progress", strerror(errno));
+
+    return p;
+}
+
+/**
+ * This function stops the progress line and frees it.
+ */
+void stop_progress(struct progress* p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+
+    draw_progress(p, true);
+
+    set_term(NULL);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
@@ -0,0 +1,80 @@
+/**
+ * progress.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for the progress line. The progress line shows how much of
+ * the wordlist has been scanned, how fast, how many matches have been found
+ * and how long the scan has left. It is drawn on stderr by its own thread at
+ * a fixed interval.
+ *
+ * The scanners add to the progress line's counters once per batch of words,
+ * with relaxed atomic adds, so the progress line costs the scan nothing per
+ * word and never makes it wait.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * This is how often the progress line is redrawn on a terminal, in
+ * milli-seconds.
+ */
+#define PROGRESS_INTERVAL_MS 250
+
+/**
+ * This is how often a new progress line is printed when stderr isn't a
+ * terminal (e.g. it is a log file), in milli-seconds.
+ */
+#define PROGRESS_LOG_INTERVAL_MS 5000
+
+/**
+ * This is a progress line.
+ */
+struct progress {
+    _Atomic uint64_t bytes;     /* Number of bytes scanned. */
+    _Atomic uint64_t matches;   /* Number of matches found. */
+    uint64_t total;             /* Length of the wordlist, or 0 if unknown. */
+    bool tty;                   /* Whether stderr is a terminal. */
+    struct timespec start;      /* When the scan started. */
+    uint64_t last_bytes;        /* Bytes scanned when it was last drawn. */
+    uint64_t last_ns;           /* Nano-seconds since start it was last drawn. */
+
+    pthread_t thread;           /* The thread that draws the progress line. */
+    pthread_mutex_t lock;       /* Guards stop. */
+    pthread_cond_t wake;        /* Signalled when the thread should stop. */
+    bool stop;                  /* Whether the thread has been told to stop. */
+};
+
+/**
+ * This function starts drawing a progress line for a wordlist of total bytes,
+ * or of unknown length if total is 0, in which case the percentage and time
+ * left aren't shown. If an error occurs the program will exit.
+ */
+struct progress* start_progress(uint64_t total);
+
+/**
+ * This function adds the bytes scanned and matches found by a batch of words
+ * to the progress line. It can be called from any thread.
+ */
+static inline void add_progress(struct progress* p, uint64_t bytes,
+                                                    uint64_t matches)
+{
+    atomic_fetch_add_explicit(&p->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&p->matches, matches, memory_order_relaxed);
+}
+
+/**
+ * This function stops the progress line's thread, draws the line one last
+ * time with the scan's average throughput and frees it.
+ */
+void stop_progress(struct progress* p);
+
+#endif // PROGRESS_H
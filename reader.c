@@ -0,0 +1,618 @@
+/**
+ * reader.c
+ *
+ * This file contains the definitions of the functions of the asynchronous
+ * wordlist readers.
+ *
+ * The reader's blocks are a ring. Every block the scanner doesn't have is
+ * being read, or has been read and is waiting its turn, and the block the
+ * scanner hands back is read again straight away at the next offset of the
+ * file. Reads can finish out of order, so each finished read is matched to
+ * its block by the block's index, and a read that comes back short is sent
+ * again for the rest of its block.
+ *
+ * Author: Richard Gale
+ */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+
+#include "mycutils.h"
+#include "reader.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define HAVE_URING
+#endif
+#endif
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void reader_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+#ifdef HAVE_URING
+
+/**
+ * This is an io_uring instance and the rings it shares with the kernel.
+ */
+struct uring {
+    int fd;                         /* The ring's file descriptor. */
+    void* sq_map;                   /* The submission ring's mapping. */
+    size_t sq_size;                 /* Size of the submission ring. */
+    void* cq_map;                   /* The completion ring's mapping. */
+    size_t cq_size;                 /* Size of the completion ring. */
+    struct io_uring_sqe* sqes;      /* The submission queue entries. */
+    size_t sqes_size;               /* Size of the entries. */
+
+    _Atomic unsigned* sq_head;      /* Next entry the kernel will take. */
+    _Atomic unsigned* sq_tail;      /* Next entry to fill. */
+    unsigned sq_mask;               /* Mask of the submission ring. */
+    unsigned* sq_array;             /* Indexes of the queued entries. */
+    _Atomic unsigned* cq_head;      /* Next completion to take. */
+    _Atomic unsigned* cq_tail;      /* Next completion the kernel will fill. */
+    unsigned cq_mask;               /* Mask of the completion ring. */
+    struct io_uring_cqe* cqes;      /* The completions. */
+
+    unsigned queued;                /* Entries queued but not submitted. */
+};
+
+/**
+ * This function unmaps the rings of an io_uring instance, closes it and
+ * frees it.
+ */
+static void close_uring(struct uring* u)
+{
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->sqes_size);
+    if (u->cq_map != NULL && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_size);
+    if (u->sq_map != NULL)
+        munmap(u->sq_map, u->sq_size);
+    close(u->fd);
+    free(u);
+}
+
+/**
+ * This function sets up an io_uring instance with room for entries reads in
+ * flight. It returns NULL if io_uring isn't available, or is too old to read
+ * into a plain buffer (before Linux 5.6), so the caller can use pread()
+ * instead.
+ */
+static struct uring* open_uring(unsigned entries)
+{
+    struct io_uring_params p;   /* The ring's parameters. */
+    struct uring* u;            /* The instance. */
+    char* sq;                   /* The submission ring. */
+    char* cq;                   /* The completion ring. */
+    int fd;                     /* The ring's file descriptor. */
+
+    memset(&p, 0, sizeof(p));
+    if ((fd = syscall(__NR_io_uring_setup, entries, &p)) == -1)
+        return NULL;
+
+    if ((u = calloc(1, sizeof(struct uring))) == NULL)
+        reader_error("open_uring", strerror(errno));
+    u->fd = fd;
+
+    /* IORING_OP_READ came in the same release as IORING_FEAT_RW_CUR_POS. */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close_uring(u);
+        return NULL;
+    }
+
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (u->cq_size > u->sq_size)
+            u->sq_size = u->cq_size;
+        u->cq_size = u->sq_size;
+    }
+
+    u->sq_map = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED)
+    {
+        u->sq_map = NULL;
+        close_uring(u);
+        return NULL;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        u->cq_map = u->sq_map;
+    else if ((u->cq_map = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING)) == MAP_FAILED)
+    {
+        u->cq_map = NULL;
+        close_uring(u);
+        return NULL;
+    }
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    {
+        u->sqes = NULL;
+        close_uring(u);
+        return NULL;
+    }
+
+    sq = u->sq_map;
+    cq = u->cq_map;
+    u->sq_head = (_Atomic unsigned*) (sq + p.sq_off.head);
+    u->sq_tail = (_Atomic unsigned*) (sq + p.sq_off.tail);
+    u->sq_mask = *(unsigned*) (sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*) (sq + p.sq_off.array);
+    u->cq_head = (_Atomic unsigned*) (cq + p.cq_off.head);
+    u->cq_tail = (_Atomic unsigned*) (cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned*) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    return u;
+}
+
+/**
+ * This function registers the n buffers provided to it with the ring, so
+ * they can be read into with IORING_OP_READ_FIXED. It returns false if they
+ * couldn't be registered.
+ */
+static bool register_uring(struct uring* u, struct iovec* iov, unsigned n)
+{
+    return syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS,
+                   iov, n) == 0;
+}
+
+/**
+ * This function queues a read of len bytes at offset off of the file fd into
+ * buf. If fixed is not -1 buf is part of the registered buffer with that
+ * index. data is given back with the read's completion.
+ */
+static void queue_read(struct uring* u, int fd, char* buf, size_t len,
+                       off_t off, int fixed, uint64_t data)
+{
+    struct io_uring_sqe* sqe;   /* The entry. */
+    unsigned tail;              /* The submission ring's tail. */
+    unsigned i;                 /* Index of the entry. */
+
+    tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+    i = tail & u->sq_mask;
+    sqe = &u->sqes[i];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = fixed == -1 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = fixed == -1 ? 0 : fixed;
+    sqe->user_data = data;
+
+    u->sq_array[i] = i;
+    atomic_store_explicit(u->sq_tail, tail + 1, memory_order_release);
+    u->queued++;
+}
+
+/**
+ * This function submits the queued reads and, if wait is true, waits until
+ * at least one read has finished.
+ */
+static void enter_uring(struct uring* u, bool wait)
+{
+    int n;  /* Number of entries the kernel took. */
+
+    if (u->queued == 0 && !wait)
+        return;
+
+    while ((n = syscall(__NR_io_uring_enter, u->fd, u->queued, wait ? 1 : 0,
+                        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0)) == -1)
+    {
+        if (errno != EINTR)
+            reader_error("enter_uring", strerror(errno));
+    }
+
+    u->queued -= n;
+}
+
+/**
+ * This function takes the next finished read, if there is one, storing its
+ * data and result. It returns false if no read has finished.
+ */
+static bool reap_uring(struct uring* u, uint64_t* data, int* res)
+{
+    struct io_uring_cqe* cqe;   /* The completion. */
+    unsigned head;              /* The completion ring's head. */
+
+    head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(u->cq_tail, memory_order_acquire))
+        return false;
+
+    cqe = &u->cqes[head & u->cq_mask];
+    *data = cqe->user_data;
+    *res = cqe->res;
+    atomic_store_explicit(u->cq_head, head + 1, memory_order_release);
+
+    return true;
+}
+
+#else // HAVE_URING
+
+/**
+ * Without io_uring the functions that use it are never reached, since
+ * open_uring() always fails.
+ */
+struct uring;
+
+static void close_uring(struct uring* u) { (void) u; }
+
+static struct uring* open_uring(unsigned entries)
+{
+    (void) entries;
+    return NULL;
+}
+
+static bool register_uring(struct uring* u, struct iovec* iov, unsigned n)
+{
+    (void) u; (void) iov; (void) n;
+    return false;
+}
+
+static void queue_read(struct uring* u, int fd, char* buf, size_t len,
+                       off_t off, int fixed, uint64_t data)
+{
+    (void) u; (void) fd; (void) buf; (void) len; (void) off; (void) fixed;
+    (void) data;
+}
+
+static void enter_uring(struct uring* u, bool wait) { (void) u; (void) wait; }
+
+static bool reap_uring(struct uring* u, uint64_t* data, int* res)
+{
+    (void) u; (void) data; (void) res;
+    return false;
+}
+
+#endif // HAVE_URING
+
+/**
+ * This function reads up to len bytes at offset off of the file fd into buf
+ * with pread(), retrying if it is interrupted. It returns the number of
+ * bytes read, which is only 0 at the end of the file. If an error occurs the
+ * program will exit.
+ */
+static size_t pread_block(int fd, char* buf, size_t len, off_t off)
+{
+    ssize_t n;  /* Number of bytes read. */
+
+    while ((n = pread(fd, buf, len, off)) == -1)
+    {
+        if (errno != EINTR)
+            reader_error("pread_block", strerror(errno));
+    }
+
+    return n;
+}
+
+/**
+ * This function queues the read of the rest of a block, which is at offset
+ * b->off of the file and held in buf.
+ */
+static void queue_block(struct uring* u, int fd, struct reader_block* b,
+                        char* buf, int fixed, uint64_t data)
+{
+    queue_read(u, fd, buf + b->len, b->want - b->len, b->off + b->len, fixed,
+               data);
+    b->busy = true;
+}
+
+/**
+ * This function handles the result of a read into a block. A read that
+ * failed to start is sent again, one that came back short is sent again for
+ * the rest of the block and one that read nothing means the file has
+ * shrunk, so the block ends there. It returns true if the block is still
+ * being read.
+ */
+static bool finish_read(struct uring* u, int fd, struct reader_block* b,
+                        char* buf, int fixed, uint64_t data, int res,
+                        const char* func)
+{
+    if (res < 0 && res != -EINTR && res != -EAGAIN)
+        reader_error(func, strerror(-res));
+
+    if (res == 0)
+        b->want = b->len;
+    else if (res > 0)
+        b->len += res;
+
+    b->busy = false;
+    if (b->len < b->want)
+    {
+        queue_block(u, fd, b, buf, fixed, data);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * This function starts reading block i of the reader at the next offset of
+ * the file. Past the end of the file the block is left empty.
+ */
+static void start_block(struct reader* r, size_t i)
+{
+    struct reader_block* b = &r->blocks[i];
+
+    b->off = r->next_off;
+    b->len = 0;
+    b->want = r->size - r->next_off < READER_BLOCK_SIZE
+            ? r->size - r->next_off : READER_BLOCK_SIZE;
+    b->busy = false;
+    r->next_off += b->want;
+
+    if (b->want > 0)
+        queue_block(r->ring, r->fd, b, r->bufs + i * READER_BLOCK_SIZE,
+                    r->mode == READER_URING_FIXED ? (int) i : -1, i);
+}
+
+/**
+ * This function takes every finished read of the reader and handles it.
+ */
+static void reap_reader(struct reader* r)
+{
+    uint64_t i;     /* Index of the block a read was into. */
+    int res;        /* Result of the read. */
+
+    while (reap_uring(r->ring, &i, &res))
+    {
+        finish_read(r->ring, r->fd, &r->blocks[i],
+                    r->bufs + i * READER_BLOCK_SIZE,
+                    r->mode == READER_URING_FIXED ? (int) i : -1, i, res,
+                    "next_block");
+    }
+}
+
+/**
+ * This function opens a reader of the regular file with the file descriptor
+ * provided to it and starts reading its first blocks.
+ */
+struct reader* open_reader(int fd, bool uring)
+{
+    struct iovec iov[READER_DEPTH];     /* The blocks, to register them. */
+    struct stat st;                     /* Status of the file. */
+    struct reader* r;                   /* The reader. */
+    size_t i;
+
+    if (fstat(fd, &st) == -1)
+        reader_error("open_reader", strerror(errno));
+    if (!S_ISREG(st.st_mode))
+        reader_error("open_reader", "The wordlist isn't a regular file.");
+
+    if ((r = calloc(1, sizeof(struct reader))) == NULL
+        || posix_memalign((void**) &r->bufs, sysconf(_SC_PAGESIZE),
+                          READER_DEPTH * READER_BLOCK_SIZE) != 0)
+        reader_error("open_reader", strerror(errno));
+
+    r->fd = fd;
+    r->size = st.st_size;
+    r->held = READER_DEPTH;
+    r->mode = READER_PREAD;
+
+    /* Telling the kernel we'll be reading the file from start to end. This
+     * is only advice so a failure here isn't an error. */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (uring && (r->ring = open_uring(READER_DEPTH)) != NULL)
+    {
+        for (i = 0; i < READER_DEPTH; i++)
+        {
+            iov[i].iov_base = r->bufs + i * READER_BLOCK_SIZE;
+            iov[i].iov_len = READER_BLOCK_SIZE;
+        }
+        r->mode = register_uring(r->ring, iov, READER_DEPTH)
+                ? READER_URING_FIXED : READER_URING;
+
+        for (i = 0; i < READER_DEPTH; i++)
+            start_block(r, i);
+        enter_uring(r->ring, false);
+    }
+
+    return r;
+}
+
+/**
+ * This function waits for the next block of the file and points block at
+ * it.
+ */
+size_t next_block(struct reader* r, const char** block)
+{
+    struct reader_block* b;     /* The next block. */
+    size_t n;                   /* Number of bytes read. */
+
+    if (r->mode == READER_PREAD)
+    {
+        n = pread_block(r->fd, r->bufs, READER_BLOCK_SIZE, r->next_off);
+        r->next_off += n;
+        *block = r->bufs;
+        return n;
+    }
+
+    /* The scanner is finished with the block it had, so it is read again
+     * at the next offset. */
+    if (r->held != READER_DEPTH)
+    {
+        start_block(r, r->held);
+        r->held = READER_DEPTH;
+    }
+
+    b = &r->blocks[r->next];
+    reap_reader(r);
+    while (b->busy)
+    {
+        enter_uring(r->ring, true);
+        reap_reader(r);
+    }
+    enter_uring(r->ring, false);
+
+    /* An empty block is the end of the file. It isn't read again, so every
+     * later call ends here too. */
+    if (b->len == 0)
+        return 0;
+
+    *block = r->bufs + r->next * READER_BLOCK_SIZE;
+    r->held = r->next;
+    r->next = (r->next + 1) % READER_DEPTH;
+
+    return b->len;
+}
+
+/**
+ * This function returns the name of the way the reader reads.
+ */
+const char* reader_mode_name(const struct reader* r)
+{
+    switch (r->mode)
+    {
+        case READER_URING_FIXED:
+            return "io_uring with registered buffers";
+        case READER_URING:
+            return "io_uring";
+        default:
+            return "pread";
+    }
+}
+
+/**
+ * This function frees the reader, first waiting for the reads still in
+ * flight, since they are into its blocks.
+ */
+void close_reader(struct reader* r)
+{
+    size_t i;
+    bool busy;  /* Whether a read is still in flight. */
+
+    if (r->ring != NULL)
+    {
+        for (;;)
+        {
+            reap_reader(r);
+            busy = false;
+            for (i = 0; i < READER_DEPTH; i++)
+                busy |= r->blocks[i].busy;
+            if (!busy)
+                break;
+            enter_uring(r->ring, true);
+        }
+        close_uring(r->ring);
+    }
+
+    free(r->bufs);
+    free(r);
+}
+
+/**
+ * This function reads the whole of a regular file into memory with many
+ * reads in flight. The reads go straight into the buffer that is returned,
+ * so it isn't registered: a buffer that is only read into once would cost
+ * more to register than it would save.
+ */
+char* read_file_async(int fd, size_t* len, bool uring)
+{
+    struct reader_block slots[READER_DEPTH];    /* The reads in flight. */
+    struct reader_block* s;     /* The current read. */
+    struct uring* u;            /* The ring, if io_uring is used. */
+    struct stat st;             /* Status of the file. */
+    char* buf;                  /* The file. */
+    size_t size;                /* Size of the file. */
+    size_t next;                /* Offset of the next read. */
+    size_t end;                 /* Where the file turned out to end. */
+    size_t busy;                /* Number of reads in flight. */
+    size_t n;                   /* Number of bytes read by pread(). */
+    uint64_t i;                 /* Index of the current read. */
+    int res;                    /* Result of the current read. */
+
+    *len = 0;
+
+    if (fstat(fd, &st) == -1)
+        reader_error("read_file_async", strerror(errno));
+    if (!S_ISREG(st.st_mode) || st.st_size == 0)
+        return NULL;
+
+    size = st.st_size;
+    if ((buf = malloc(size)) == NULL)
+        reader_error("read_file_async", strerror(errno));
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (!uring || (u = open_uring(READER_DEPTH)) == NULL)
+    {
+        for (end = 0; end < size; end += n)
+        {
+            if ((n = pread_block(fd, buf + end, size - end, end)) == 0)
+                break;
+        }
+        *len = end;
+        return buf;
+    }
+
+    /* Every slot reads a block, and starts on the next one when it is
+     * done, until the whole file has been asked for. */
+    next = 0;
+    end = size;
+    busy = 0;
+    for (i = 0; i < READER_DEPTH && next < size; i++, busy++)
+    {
+        slots[i] = (struct reader_block) { next, 0, 0, false };
+        slots[i].want = size - next < READER_BLOCK_SIZE ? size - next
+                                                        : READER_BLOCK_SIZE;
+        next += slots[i].want;
+        queue_block(u, fd, &slots[i], buf + slots[i].off, -1, i);
+    }
+
+    while (busy > 0)
+    {
+        enter_uring(u, true);
+        while (reap_uring(u, &i, &res))
+        {
+            s = &slots[i];
+            if (finish_read(u, fd, s, buf + s->off, -1, i, res,
+                            "read_file_async"))
+                continue;
+
+            if (s->len < READER_BLOCK_SIZE && s->off + s->len < end)
+                end = s->off + s->len;
+
+            if (next < end)
+            {
+                *s = (struct reader_block) { next, 0, 0, false };
+                s->want = end - next < READER_BLOCK_SIZE ? end - next
+                                                         : READER_BLOCK_SIZE;
+                next += s->want;
+                queue_block(u, fd, s, buf + s->off, -1, i);
+            }
+            else
+            {
+                busy--;
+            }
+        }
+    }
+
+    close_uring(u);
+
+    *len = end;
+    return buf;
+}
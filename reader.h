@@ -0,0 +1,110 @@
+/**
+ * reader.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for asynchronous wordlist readers. A reader keeps many reads
+ * of a regular file in flight at once with io_uring, so the disk is kept
+ * busy while the blocks that have already been read are scanned. A single
+ * read at a time leaves most of a fast disk's bandwidth unused.
+ *
+ * io_uring is used through its system calls, so no library is needed. The
+ * reader's blocks are registered with the kernel once so they aren't mapped
+ * again for every read, and if they can't be (e.g. the locked memory limit
+ * is too low) they are read into unregistered. If io_uring isn't available
+ * at all (the kernel is too old or it has been disabled) the blocks are read
+ * one at a time with pread().
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * This is the size of each block a reader reads.
+ */
+#define READER_BLOCK_SIZE (1 << 18)
+
+/**
+ * This is the number of blocks a reader has, and so the number of reads it
+ * keeps in flight while the scanner has none of them.
+ */
+#define READER_DEPTH 16
+
+/**
+ * These are the ways a reader can read.
+ */
+enum reader_mode {
+    READER_PREAD,           /* One pread() at a time. */
+    READER_URING,           /* io_uring into unregistered blocks. */
+    READER_URING_FIXED      /* io_uring into registered blocks. */
+};
+
+/**
+ * This is one block of a reader.
+ */
+struct reader_block {
+    off_t off;          /* Offset of the block in the file. */
+    size_t want;        /* Number of bytes the block should hold. */
+    size_t len;         /* Number of bytes read into it so far. */
+    bool busy;          /* Whether a read into it is in flight. */
+};
+
+/**
+ * This is an asynchronous reader of a regular file.
+ */
+struct reader {
+    int fd;                     /* The file's file descriptor. */
+    enum reader_mode mode;      /* How the reader reads. */
+    off_t size;                 /* Size of the file when it was opened. */
+    off_t next_off;             /* Offset of the next block to read. */
+    char* bufs;                 /* The blocks' bytes, one after another. */
+    struct reader_block blocks[READER_DEPTH];
+    size_t next;                /* Index of the next block to hand out. */
+    size_t held;                /* Index of the block the scanner has, or
+                                 * READER_DEPTH if it has none. */
+    size_t inflight;            /* Number of reads in flight. */
+    struct uring* ring;         /* The ring, if io_uring is used. */
+};
+
+/**
+ * This function opens a reader of the regular file with the file descriptor
+ * provided to it, from its start, and starts reading its first blocks. If
+ * uring is false, or io_uring isn't available, it reads with pread(). If an
+ * error occurs the program will exit.
+ */
+struct reader* open_reader(int fd, bool uring);
+
+/**
+ * This function waits for the next block of the file and points block at
+ * it. The block is valid until the next call. It returns the number of bytes
+ * in the block, which is only 0 at the end of the file. If an error occurs
+ * the program will exit.
+ */
+size_t next_block(struct reader* r, const char** block);
+
+/**
+ * This function returns the name of the way the reader reads.
+ */
+const char* reader_mode_name(const struct reader* r);
+
+/**
+ * This function frees the reader. It doesn't close the file descriptor.
+ */
+void close_reader(struct reader* r);
+
+/**
+ * This function reads the whole of the regular file with the file descriptor
+ * provided to it into memory, with many reads in flight if uring is true and
+ * io_uring is available, and stores its length in len. It returns NULL if
+ * the file isn't a regular file or is empty, like mapfs(). If an error
+ * occurs the program will exit. Make sure to free() it when you're finished
+ * with it.
+ */
+char* read_file_async(int fd, size_t* len, bool uring);
+
+#endif // READER_H
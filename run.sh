@@ -1,5 +1,5 @@
 #!/bin/bash
 
-gcc -o sums666 mycutils.h mycutils.c sums666.c
+gcc -O2 -pthread -o sums666 mycutils.h mycutils.c linesum.h linesum.c sumindex.h sumindex.c phrase.h phrase.c cipher.h cipher.c checkpoint.h checkpoint.c source.h source.c sorter.h sorter.c progress.h progress.c text.h text.c serve.h serve.c pool.h pool.c reader.h reader.c sums666.c -lz
 
 ./sums666 words.txt sums666.txt
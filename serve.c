@@ -0,0 +1,963 @@
+/**
+ * serve.c
+ *
+ * This file contains the definitions of the functions of the sums666
+ * daemon.
+ *
+ * Every wordlist is bucketed by its words' sums when it is loaded, as
+ * phrase.c does, so a query is a binary search for its first bucket followed
+ * by a copy of the words in its buckets. Sum indexes are mapped and their
+ * own buckets are searched. Other ciphers' buckets are made the first time
+ * they are asked for and kept.
+ *
+ * One thread waits for connections and requests with epoll. Each connection
+ * is registered with EPOLLONESHOT, so when it has something to read it is
+ * handed to one worker thread, which reads and answers every request it has
+ * sent and then registers it again. A connection is therefore only ever
+ * handled by one thread at a time, and no thread ever waits for a slow
+ * client to send a request.
+ *
+ * The latency of each request, from when the event loop saw it to when its
+ * reply was sent, is counted in a histogram of log-linear buckets, which is
+ * small enough to update with relaxed atomic adds and precise enough to give
+ * percentiles to within 1/8th.
+ *
+ * Author: Richard Gale
+ */
+
+/* accept4() is a GNU extension. */
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mycutils.h"
+#include "cipher.h"
+#include "phrase.h"
+#include "sumindex.h"
+#include "source.h"
+#include "serve.h"
+
+/**
+ * This is the most events the event loop takes from epoll at a time.
+ */
+#define SERVE_MAX_EVENTS 64
+
+/**
+ * This is the number of connections that can wait to be accepted.
+ */
+#define SERVE_BACKLOG 128
+
+/**
+ * This is the number of ciphers each wordlist can be bucketed by.
+ */
+#define SERVE_CIPHERS 8
+
+/**
+ * This is how long a reply waits for a client to make room for it, in
+ * milli-seconds, before the client is dropped.
+ */
+#define SERVE_WRITE_TIMEOUT_MS 10000
+
+/**
+ * Each power of two of nano-seconds of latency is split into this many
+ * buckets, as a power of two.
+ */
+#define LATENCY_SUB_BITS 3
+
+/**
+ * This is the number of buckets of the latency histogram.
+ */
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+
+/**
+ * This is a wordlist, or a sum index, that has been loaded.
+ */
+struct corpus {
+    const char* name;   /* Name of the file it was loaded from. */
+    char* buf;          /* The wordlist or index. */
+    size_t len;         /* Length of the wordlist or index. */
+    bool mapped;        /* Whether it was mapped. */
+    const struct index_bucket* index;   /* The buckets of an index, or NULL. */
+    size_t nindex;      /* Number of buckets of the index. */
+    const char* words;  /* The words, one per line. */
+    size_t wordslen;    /* Length of the words. */
+    const struct cipher* ciphers[SERVE_CIPHERS];    /* Ciphers bucketed by. */
+    struct buckets* buckets[SERVE_CIPHERS];     /* The words of each. */
+    size_t nciphers;    /* Number of ciphers bucketed by. */
+    pthread_mutex_t lock;   /* Guards the ciphers and their buckets. */
+};
+
+/**
+ * This is a walk through the words of a wordlist or index, in ascending
+ * order of their ascii sums and in wordlist order for each sum, which is the
+ * order both hold them in once they are bucketed.
+ */
+struct word_walk {
+    const struct corpus* c; /* The wordlist or index. */
+    size_t bucket;          /* Index of the current bucket of an index. */
+    size_t pos;             /* Offset of the next word in the bucket, or
+                             * index of the next word of a wordlist. */
+};
+
+/**
+ * This is a connection to a client.
+ */
+struct conn {
+    int fd;                     /* The connection's socket. */
+    char in[SERVE_LINE_MAX];    /* The requests that have been read. */
+    size_t len;                 /* Number of bytes of requests read. */
+    uint64_t ready;             /* When it had something to read. */
+    struct conn* next;          /* The next connection in the queue. */
+};
+
+/**
+ * This is the reply to a request.
+ */
+struct reply {
+    char* buf;          /* The reply. */
+    size_t len;         /* Length of the reply. */
+    size_t cap;         /* Number of bytes allocated. */
+};
+
+/**
+ * This is the state of the daemon that is shared by its threads.
+ */
+struct server {
+    struct corpus* corpora;     /* The loaded wordlists and indexes. */
+    size_t ncorpora;            /* Number of them. */
+    int epfd;                   /* The epoll instance. */
+    struct timespec start;      /* When the daemon started. */
+
+    struct conn* head;          /* The first connection waiting for a worker. */
+    struct conn* tail;          /* The last connection waiting for a worker. */
+    pthread_mutex_t lock;       /* Guards the queue and stop. */
+    pthread_cond_t ready;       /* Signalled when a connection is queued. */
+    bool stop;                  /* Whether the workers should stop. */
+
+    _Atomic uint64_t latency[LATENCY_BUCKETS];  /* The latency histogram. */
+    _Atomic uint64_t requests;  /* Number of requests answered. */
+    _Atomic uint64_t max_ns;    /* The longest latency. */
+};
+
+/**
+ * These mark the listening socket and the signal fd in epoll's events.
+ */
+static char listener_mark;
+static char signal_mark;
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void serve_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function loads the wordlist or sum index with the name provided to
+ * it, and buckets a wordlist's words by their ascii sums.
+ */
+static void load_corpus(struct corpus* c, char* fname)
+{
+    const struct index_header* header;  /* The header of an index. */
+    struct source* src;     /* The file, if it can't be mapped. */
+    FILE* fs;               /* The file. */
+
+    c->name = fname;
+    fs = openfs(fname, "r");
+    src = open_source(fileno(fs));
+    c->mapped = !source_compressed(src) && (c->buf = mapfs(fs, &c->len)) != NULL;
+    if (!c->mapped)
+        c->buf = read_source_all(src, &c->len);
+    close_source(src);
+    closefs(fs);
+
+    pthread_mutex_init(&c->lock, NULL);
+
+    header = (const struct index_header*) c->buf;
+    if (c->len < sizeof(*header)
+        || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0)
+    {
+        c->words = c->buf;
+        c->wordslen = c->len;
+        c->ciphers[0] = ascii_cipher();
+        c->buckets[0] = bucket_words(c->words, c->wordslen, NULL);
+        c->nciphers = 1;
+        return;
+    }
+
+    if (header->version != INDEX_VERSION)
+        serve_error("load_corpus", "Unsupported index version");
+
+    if (header->blob_off != sizeof(*header)
+                        + sizeof(*c->index) * (uint64_t) header->nbuckets
+        || header->blob_off > c->len)
+        serve_error("load_corpus", "Index file is corrupt");
+
+    /* A mapped index is aligned for its buckets, and so is one that was read
+     * into memory by malloc(). */
+    c->index = (const struct index_bucket*) (c->buf + sizeof(*header));
+    c->nindex = header->nbuckets;
+    c->words = c->buf + header->blob_off;
+    c->wordslen = c->len - header->blob_off;
+}
+
+/**
+ * This function frees a loaded wordlist or index.
+ */
+static void free_corpus(struct corpus* c)
+{
+    size_t i;
+
+    for (i = 0; i < c->nciphers; i++)
+        free_buckets(c->buckets[i]);
+    pthread_mutex_destroy(&c->lock);
+
+    if (c->mapped)
+        unmapfs(c->buf, c->len);
+    else
+        free(c->buf);
+}
+
+/**
+ * This function points word at the next word of a walk, without its
+ * newline, and stores its length in len. Empty lines are skipped, since
+ * wordlists aren't bucketed with them. It returns false at the end of the
+ * words.
+ */
+static bool next_word(struct word_walk* ww, const char** word, size_t* len)
+{
+    const struct index_bucket* b;   /* The current bucket of an index. */
+    const struct buckets* bk;       /* The buckets of a wordlist. */
+    const char* start;  /* Start of the bucket's words. */
+    const char* nl;     /* The newline that ends the word. */
+
+    if (ww->c->index == NULL)
+    {
+        bk = ww->c->buckets[0];
+        if (ww->pos == bk->nwords)
+            return false;
+        *word = bk->words[ww->pos].str;
+        *len = bk->words[ww->pos].len;
+        ww->pos++;
+        return true;
+    }
+
+    for (; ww->bucket < ww->c->nindex; ww->bucket++, ww->pos = 0)
+    {
+        b = &ww->c->index[ww->bucket];
+        if (b->off + b->len > ww->c->wordslen)
+            continue;
+
+        start = ww->c->words + b->off;
+        while (ww->pos < b->len)
+        {
+            nl = memchr(start + ww->pos, '\n', b->len - ww->pos);
+            *word = start + ww->pos;
+            *len = nl != NULL ? (size_t) (nl - *word) : b->len - ww->pos;
+            ww->pos += *len + (nl != NULL);
+            if (*len > 0)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * This function returns true if two wordlists or indexes hold the same
+ * words, e.g. a wordlist and an index of it, or the same wordlist twice.
+ */
+static bool same_words(const struct corpus* a, const struct corpus* b)
+{
+    struct word_walk wa = { a, 0, 0 };  /* The walk through a's words. */
+    struct word_walk wb = { b, 0, 0 };  /* The walk through b's words. */
+    const char* x;      /* The current word of a. */
+    const char* y;      /* The current word of b. */
+    size_t xlen;        /* Length of x. */
+    size_t ylen;        /* Length of y. */
+    bool more;          /* Whether a has another word. */
+
+    for (;;)
+    {
+        more = next_word(&wa, &x, &xlen);
+        if (more != next_word(&wb, &y, &ylen))
+            return false;
+        if (!more)
+            return true;
+        if (xlen != ylen || memcmp(x, y, xlen) != 0)
+            return false;
+    }
+}
+
+/**
+ * This function returns the words of a wordlist or index bucketed by the
+ * cipher provided to it, bucketing them if they haven't been already. It
+ * returns NULL if the wordlist has been bucketed by too many ciphers.
+ */
+static struct buckets* corpus_buckets(struct corpus* c, const struct cipher* cph)
+{
+    struct buckets* b;  /* The buckets. */
+    size_t i;
+
+    pthread_mutex_lock(&c->lock);
+    for (i = 0; i < c->nciphers && c->ciphers[i] != cph; i++)
+        ;
+
+    if (i == c->nciphers && i < SERVE_CIPHERS)
+    {
+        c->buckets[i] = bucket_words(c->words, c->wordslen,
+                                     cph == ascii_cipher() ? NULL : cph);
+        c->ciphers[i] = cph;
+        c->nciphers++;
+    }
+
+    b = i < c->nciphers ? c->buckets[i] : NULL;
+    pthread_mutex_unlock(&c->lock);
+
+    return b;
+}
+
+/**
+ * This function adds the len bytes provided to it to the reply.
+ */
+static void add_reply(struct reply* r, const char* buf, size_t len)
+{
+    if (r->len + len > r->cap)
+    {
+        r->cap = r->cap * 2 > r->len + len ? r->cap * 2 : r->len + len + 4096;
+        if ((r->buf = realloc(r->buf, r->cap)) == NULL)
+            serve_error("add_reply", strerror(errno));
+    }
+
+    memcpy(r->buf + r->len, buf, len);
+    r->len += len;
+}
+
+/**
+ * This function adds the words of every corpus whose sum under the cipher
+ * provided to it is from lo to hi to the reply, or only counts them if r is
+ * NULL. It returns the number of words, or -1 if a corpus couldn't be
+ * bucketed by the cipher.
+ */
+static int64_t find_words(struct server* sv, const struct cipher* cph,
+                          long lo, long hi, struct reply* r)
+{
+    const struct corpus* c; /* The current corpus. */
+    struct buckets* b;      /* The corpus's words bucketed by the cipher. */
+    size_t first;           /* The first bucket whose sum isn't below lo. */
+    size_t last;            /* One past the last bucket to search. */
+    size_t mid;             /* The bucket being checked. */
+    size_t i;               /* Index of the current corpus or bucket. */
+    size_t w;               /* Index of the current word. */
+    int64_t count;          /* Number of words found. */
+
+    count = 0;
+    for (i = 0; i < sv->ncorpora; i++)
+    {
+        c = &sv->corpora[i];
+
+        /* An index's own buckets are summed with the ascii cipher. */
+        if (c->index != NULL && cph == ascii_cipher())
+        {
+            for (first = 0, last = c->nindex; first < last; )
+            {
+                mid = first + (last - first) / 2;
+                if (c->index[mid].sum < lo)
+                    first = mid + 1;
+                else
+                    last = mid;
+            }
+
+            for (w = first; w < c->nindex && c->index[w].sum <= hi; w++)
+            {
+                if (c->index[w].off + c->index[w].len > c->wordslen)
+                    continue;
+                count += c->index[w].count;
+                if (r != NULL)
+                    add_reply(r, c->words + c->index[w].off, c->index[w].len);
+            }
+            continue;
+        }
+
+        if ((b = corpus_buckets(&sv->corpora[i], cph)) == NULL)
+            return -1;
+
+        for (first = 0, last = b->nbuckets; first < last; )
+        {
+            mid = first + (last - first) / 2;
+            if (b->sums[mid] < lo)
+                first = mid + 1;
+            else
+                last = mid;
+        }
+
+        for (; first < b->nbuckets && b->sums[first] <= hi; first++)
+        {
+            count += b->starts[first + 1] - b->starts[first];
+            if (r == NULL)
+                continue;
+
+            for (w = b->starts[first]; w < b->starts[first + 1]; w++)
+            {
+                add_reply(r, b->words[w].str, b->words[w].len);
+                add_reply(r, "\n", 1);
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * This function returns the histogram bucket of a latency of ns
+ * nano-seconds.
+ */
+static inline size_t latency_bucket(uint64_t ns)
+{
+    unsigned e;     /* The power of two of the latency. */
+
+    if (ns < (1 << LATENCY_SUB_BITS))
+        return ns;
+
+    e = 63 - __builtin_clzll(ns);
+
+    return ((size_t) (e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+         + ((ns >> (e - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/**
+ * This function returns the largest latency, in nano-seconds, in the
+ * histogram bucket provided to it.
+ */
+static uint64_t latency_upper(size_t bucket)
+{
+    unsigned e;     /* The power of two of the bucket's latencies. */
+    uint64_t sub;   /* The bucket's part of the power of two. */
+
+    if (bucket < (1 << LATENCY_SUB_BITS))
+        return bucket;
+
+    e = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+
+    return (((1ULL << LATENCY_SUB_BITS) + sub + 1) << (e - LATENCY_SUB_BITS)) - 1;
+}
+
+/**
+ * This function counts a request that took ns nano-seconds to answer.
+ */
+static void add_latency(struct server* sv, uint64_t ns)
+{
+    uint64_t max;   /* The longest latency so far. */
+
+    atomic_fetch_add_explicit(&sv->latency[latency_bucket(ns)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&sv->requests, 1, memory_order_relaxed);
+
+    max = atomic_load_explicit(&sv->max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&sv->max_ns,
+                            &max, ns, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+/**
+ * This function formats the number of requests answered and their latency
+ * percentiles into the buffer provided to it. The percentiles are the
+ * largest latency of the bucket they fall in, so they are never too low.
+ */
+static void format_latency(struct server* sv, char* buf, size_t size)
+{
+    const double pcts[] = { 0.50, 0.90, 0.99 };
+    uint64_t counts[LATENCY_BUCKETS];   /* A copy of the histogram. */
+    double us[3];       /* The latency of each percentile, in micro-seconds. */
+    uint64_t max;       /* The longest latency. */
+    uint64_t upper;     /* The largest latency in a percentile's bucket. */
+    uint64_t total;     /* Number of requests in the copy. */
+    uint64_t seen;      /* Number of requests in the buckets so far. */
+    uint64_t rank;      /* The rank of the current percentile. */
+    size_t i;           /* The current bucket. */
+    size_t p;           /* The current percentile. */
+
+    total = 0;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        counts[i] = atomic_load_explicit(&sv->latency[i], memory_order_relaxed);
+        total += counts[i];
+    }
+
+    /* A bucket's largest latency can be more than the longest one seen. */
+    max = atomic_load_explicit(&sv->max_ns, memory_order_relaxed);
+    for (p = 0, i = 0, seen = 0; p < 3; p++)
+    {
+        rank = (uint64_t) (pcts[p] * total + 0.999999);
+        for (; i < LATENCY_BUCKETS && seen + counts[i] < rank; i++)
+            seen += counts[i];
+        upper = latency_upper(i) < max ? latency_upper(i) : max;
+        us[p] = total == 0 ? 0 : upper / 1000.0;
+    }
+
+    snprintf(buf, size, "requests %llu p50 %.1fus p90 %.1fus p99 %.1fus "
+                        "max %.1fus", (unsigned long long) total,
+             us[0], us[1], us[2], max / 1000.0);
+}
+
+/**
+ * This function parses a number of a request. It returns false if the token
+ * isn't a number.
+ */
+static bool parse_number(const char* tok, long* n)
+{
+    char* end;
+
+    if (tok == NULL || *tok == '\0')
+        return false;
+
+    errno = 0;
+    *n = strtol(tok, &end, 10);
+
+    return *end == '\0' && errno == 0;
+}
+
+/**
+ * This function answers the request provided to it, storing the reply in r.
+ * It returns false if the connection should be closed after the reply.
+ */
+static bool answer(struct server* sv, char* line, struct reply* r)
+{
+    const struct cipher* cph;   /* The cipher to sum with. */
+    char stats[256];            /* The statistics line. */
+    char head[64];              /* The first line of the reply. */
+    char* save;                 /* State of strtok_r(). */
+    char* cmd;                  /* The request's command. */
+    char* name;                 /* The name of the cipher, or NULL. */
+    long lo;                    /* The smallest sum. */
+    long hi;                    /* The largest sum. */
+    int64_t count;              /* Number of words in the reply. */
+    const char* err;            /* The error to reply with, or NULL. */
+
+    r->len = 0;
+    err = NULL;
+    name = NULL;
+
+    if ((cmd = strtok_r(line, " \t\r", &save)) == NULL)
+    {
+        err = "Empty request";
+    }
+    else if (strcmp(cmd, "PING") == 0 || strcmp(cmd, "QUIT") == 0)
+    {
+        add_reply(r, "OK 0\n", 5);
+        return strcmp(cmd, "QUIT") != 0;
+    }
+    else if (strcmp(cmd, "STATS") == 0)
+    {
+        format_latency(sv, stats, sizeof(stats));
+        add_reply(r, "OK 1\n", 5);
+        add_reply(r, stats, strlen(stats));
+        add_reply(r, "\n", 1);
+        return true;
+    }
+    else if (strcmp(cmd, "SUM") == 0)
+    {
+        if (!parse_number(strtok_r(NULL, " \t\r", &save), &lo))
+            err = "Usage: SUM <target> [cipher]";
+        hi = lo;
+        name = strtok_r(NULL, " \t\r", &save);
+    }
+    else if (strcmp(cmd, "RANGE") == 0)
+    {
+        if (!parse_number(strtok_r(NULL, " \t\r", &save), &lo)
+            || !parse_number(strtok_r(NULL, " \t\r", &save), &hi))
+            err = "Usage: RANGE <min> <max> [cipher]";
+        name = strtok_r(NULL, " \t\r", &save);
+    }
+    else
+    {
+        err = "Unknown request";
+    }
+
+    cph = ascii_cipher();
+    if (err == NULL && name != NULL && (cph = find_cipher(name)) == NULL)
+        err = "Unknown cipher";
+
+    /* The words are counted before they are added, since the count is the
+     * first line of the reply. Counting only reads the buckets' sizes. */
+    if (err == NULL && (count = find_words(sv, cph, lo, hi, NULL)) < 0)
+        err = "Too many ciphers";
+
+    if (err == NULL)
+    {
+        snprintf(head, sizeof(head), "OK %lld\n", (long long) count);
+        add_reply(r, head, strlen(head));
+        find_words(sv, cph, lo, hi, r);
+        return true;
+    }
+
+    r->len = 0;
+    snprintf(head, sizeof(head), "ERR %s\n", err);
+    add_reply(r, head, strlen(head));
+
+    return true;
+}
+
+/**
+ * This function sends the reply provided to it. It returns false if the
+ * client has gone or didn't make room for the reply in time.
+ */
+static bool send_reply(int fd, const struct reply* r)
+{
+    struct pollfd pfd;  /* Used to wait for room in the socket. */
+    size_t sent;        /* Number of bytes sent. */
+    ssize_t n;          /* Number of bytes sent by one call. */
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    for (sent = 0; sent < r->len; sent += n)
+    {
+        /* MSG_NOSIGNAL stops a client that has gone raising SIGPIPE. */
+        while ((n = send(fd, r->buf + sent, r->len - sent, MSG_NOSIGNAL)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            if (poll(&pfd, 1, SERVE_WRITE_TIMEOUT_MS) != 1)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * This function reads every request a connection has sent and answers them
+ * in order. It returns false if the connection should be closed.
+ */
+static bool handle_conn(struct server* sv, struct conn* c, struct reply* r)
+{
+    uint64_t since;     /* When the requests being answered were seen. */
+    char* nl;           /* The newline that ends the current request. */
+    ssize_t n;          /* Number of bytes read. */
+    bool keep;          /* Whether the connection should stay open. */
+
+    since = c->ready;
+    for (;;)
+    {
+        n = read(c->fd, c->in + c->len, sizeof(c->in) - c->len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n <= 0)
+            return false;
+        c->len += n;
+
+        while ((nl = memchr(c->in, '\n', c->len)) != NULL)
+        {
+            *nl = '\0';
+            keep = answer(sv, c->in, r);
+            if (!send_reply(c->fd, r))
+                return false;
+            add_latency(sv, elapsed_timer(sv->start) - since);
+            if (!keep)
+                return false;
+
+            c->len -= nl + 1 - c->in;
+            memmove(c->in, nl + 1, c->len);
+        }
+
+        /* A request that doesn't fit is refused rather than split. */
+        if (c->len == sizeof(c->in))
+        {
+            r->len = 0;
+            add_reply(r, "ERR Request too long\n", 21);
+            send_reply(c->fd, r);
+            return false;
+        }
+
+        /* Requests that arrive later are timed from when they are read. */
+        since = elapsed_timer(sv->start);
+    }
+}
+
+/**
+ * This function is run by each worker thread. It takes connections that
+ * have something to read from the queue, answers their requests and
+ * registers them with epoll again, or closes them.
+ */
+static void* serve_worker(void* arg)
+{
+    struct server* sv = arg;
+    struct reply r = { 0 };     /* The reply to the current request. */
+    struct epoll_event ev;      /* The connection's epoll registration. */
+    struct conn* c;             /* The current connection. */
+
+    for (;;)
+    {
+        pthread_mutex_lock(&sv->lock);
+        while (sv->head == NULL && !sv->stop)
+            pthread_cond_wait(&sv->ready, &sv->lock);
+        if (sv->stop)
+        {
+            pthread_mutex_unlock(&sv->lock);
+            break;
+        }
+        c = sv->head;
+        if ((sv->head = c->next) == NULL)
+            sv->tail = NULL;
+        pthread_mutex_unlock(&sv->lock);
+
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = c;
+        if (!handle_conn(sv, c, &r)
+            || epoll_ctl(sv->epfd, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+        {
+            close(c->fd);
+            free(c);
+        }
+    }
+
+    free(r.buf);
+
+    return NULL;
+}
+
+/**
+ * This function accepts every connection that is waiting and registers them
+ * with epoll.
+ */
+static void accept_conns(struct server* sv, int lfd)
+{
+    struct epoll_event ev;  /* The connection's epoll registration. */
+    struct conn* c;         /* The new connection. */
+    int fd;                 /* The new connection's socket. */
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        if ((c = calloc(1, sizeof(struct conn))) == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = c;
+        if (epoll_ctl(sv->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            close(fd);
+            free(c);
+        }
+    }
+}
+
+/**
+ * This function makes the listening socket at path, replacing a socket that
+ * was left there but never any other kind of file.
+ */
+static int listen_at(const char* path)
+{
+    struct sockaddr_un addr;    /* The socket's address. */
+    struct stat st;             /* Status of a file already at path. */
+    int fd;                     /* The socket. */
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        serve_error("listen_at", "Socket path is too long");
+
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+            serve_error("listen_at", "A file that isn't a socket is in the way");
+        unlink(path);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1
+        || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1
+        || listen(fd, SERVE_BACKLOG) == -1)
+        serve_error("listen_at", strerror(errno));
+
+    return fd;
+}
+
+/**
+ * This function loads the wordlists and indexes and answers requests about
+ * them until it is sent SIGINT or SIGTERM.
+ */
+void serve(const char* path, char** files, size_t nfiles, unsigned nthreads)
+{
+    struct epoll_event events[SERVE_MAX_EVENTS];    /* The events to handle. */
+    struct epoll_event ev;      /* A registration with epoll. */
+    struct signalfd_siginfo si; /* The signal that was sent. */
+    struct server* sv;          /* The daemon's state. */
+    pthread_t* threads;         /* The worker threads. */
+    struct conn* c;             /* A connection with something to read. */
+    const struct corpus* dup;   /* A loaded file with the same words. */
+    sigset_t mask;              /* The signals that stop the daemon. */
+    uint64_t nwords;            /* Number of words loaded. */
+    char stats[256];            /* The latency percentiles. */
+    char* tstamp;               /* A time stamp. */
+    int lfd;                    /* The listening socket. */
+    int sfd;                    /* The signal fd. */
+    int n;                      /* Number of events. */
+    int i;                      /* Index of the current event. */
+    size_t f;                   /* Index of the current file or thread. */
+    size_t d;                   /* Index of a loaded file. */
+    int err;                    /* Error returned by pthread_create(). */
+
+    if ((sv = calloc(1, sizeof(struct server))) == NULL
+        || (sv->corpora = calloc(nfiles, sizeof(struct corpus))) == NULL
+        || (threads = malloc(sizeof(pthread_t) * nthreads)) == NULL)
+        serve_error("serve", strerror(errno));
+
+    /* Loading the wordlists before listening, so no request is ever kept
+     * waiting for one. A file with the same words as one that is already
+     * loaded (e.g. a wordlist and its index) would only repeat them in
+     * every reply, so it is dropped. */
+    nwords = 0;
+    for (f = 0; f < nfiles; f++)
+    {
+        dup = NULL;
+        load_corpus(&sv->corpora[sv->ncorpora], files[f]);
+        for (d = 0; d < sv->ncorpora && dup == NULL; d++)
+        {
+            if (same_words(&sv->corpora[d], &sv->corpora[sv->ncorpora]))
+                dup = &sv->corpora[d];
+        }
+
+        if (dup != NULL)
+        {
+            fprintf(stderr, "[ %s ] Skipping %s, which has the same words as "
+                            "%s.\n", (tstamp = timestamp()), files[f],
+                    dup->name);
+            free(tstamp);
+            free_corpus(&sv->corpora[sv->ncorpora]);
+            memset(&sv->corpora[sv->ncorpora], 0, sizeof(struct corpus));
+            continue;
+        }
+
+        nwords += sv->corpora[sv->ncorpora].index != NULL
+                ? ((const struct index_header*)
+                                sv->corpora[sv->ncorpora].buf)->nwords
+                : sv->corpora[sv->ncorpora].buckets[0]->nwords;
+        sv->ncorpora++;
+    }
+
+    /* The signals are blocked before the workers start, so they are only
+     * ever read from the signal fd by the event loop. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+        serve_error("serve", strerror(errno));
+
+    lfd = listen_at(path);
+    if ((sv->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        serve_error("serve", strerror(errno));
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listener_mark;
+    if (epoll_ctl(sv->epfd, EPOLL_CTL_ADD, lfd, &ev) == -1)
+        serve_error("serve", strerror(errno));
+    ev.data.ptr = &signal_mark;
+    if (epoll_ctl(sv->epfd, EPOLL_CTL_ADD, sfd, &ev) == -1)
+        serve_error("serve", strerror(errno));
+
+    pthread_mutex_init(&sv->lock, NULL);
+    pthread_cond_init(&sv->ready, NULL);
+    start_timer(&sv->start);
+
+    for (f = 0; f < nthreads; f++)
+    {
+        if ((err = pthread_create(&threads[f], NULL, serve_worker, sv)) != 0)
+            serve_error("serve", strerror(err));
+    }
+
+    fprintf(stderr, "[ %s ] Serving %llu words from %zu files on %s with %u "
+                    "threads.\n", (tstamp = timestamp()),
+            (unsigned long long) nwords, sv->ncorpora, path, nthreads);
+    free(tstamp);
+
+    /* Handing each connection with something to read to a worker. */
+    while (!sv->stop)
+    {
+        if ((n = epoll_wait(sv->epfd, events, SERVE_MAX_EVENTS, -1)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            serve_error("serve", strerror(errno));
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &listener_mark)
+            {
+                accept_conns(sv, lfd);
+            }
+            else if (events[i].data.ptr == &signal_mark)
+            {
+                if (read(sfd, &si, sizeof(si)) == sizeof(si))
+                {
+                    pthread_mutex_lock(&sv->lock);
+                    sv->stop = true;
+                    pthread_cond_broadcast(&sv->ready);
+                    pthread_mutex_unlock(&sv->lock);
+                }
+            }
+            else
+            {
+                c = events[i].data.ptr;
+                c->ready = elapsed_timer(sv->start);
+                c->next = NULL;
+
+                pthread_mutex_lock(&sv->lock);
+                if (sv->tail != NULL)
+                    sv->tail->next = c;
+                else
+                    sv->head = c;
+                sv->tail = c;
+                pthread_cond_signal(&sv->ready);
+                pthread_mutex_unlock(&sv->lock);
+            }
+        }
+    }
+
+    for (f = 0; f < nthreads; f++)
+        pthread_join(threads[f], NULL);
+
+    format_latency(sv, stats, sizeof(stats));
+    fprintf(stderr, "[ %s ] Stopped. %s\n", (tstamp = timestamp()), stats);
+    free(tstamp);
+
+    /* Connections that were still open are closed by the program exiting. */
+    close(lfd);
+    close(sfd);
+    close(sv->epfd);
+    unlink(path);
+
+    for (f = 0; f < sv->ncorpora; f++)
+        free_corpus(&sv->corpora[f]);
+    pthread_cond_destroy(&sv->ready);
+    pthread_mutex_destroy(&sv->lock);
+    free(sv->corpora);
+    free(threads);
+    free(sv);
+}
@@ -0,0 +1,49 @@
+/**
+ * serve.h
+ *
+ * This file contains the function prototype declarations for the sums666
+ * daemon, which loads wordlists and sum indexes into memory once and
+ * answers queries about them over a Unix domain socket.
+ *
+ * Each request is one line and each reply is a line of "OK n", followed by
+ * n lines, or a line of "ERR message":
+ *
+ *   SUM <target> [cipher]       The words that sum to target.
+ *   RANGE <min> <max> [cipher]  The words whose sum is from min to max, in
+ *                               ascending order of sum.
+ *   STATS                       The number of requests answered and their
+ *                               latency percentiles, on one line.
+ *   PING                        Nothing ("OK 0").
+ *   QUIT                        Nothing, then the connection is closed.
+ *
+ * Words are summed with the ascii cipher unless another built-in cipher is
+ * named. The words of each wordlist are given in the order the wordlists
+ * were loaded in, and in wordlist order for each sum. A file that holds the
+ * same words as one loaded before it (e.g. an index of a wordlist that is
+ * also loaded) is skipped, so its words aren't repeated.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+
+/**
+ * This is the longest request line, including its newline, that the daemon
+ * reads. A connection that sends a longer line is closed.
+ */
+#define SERVE_LINE_MAX 4096
+
+/**
+ * This function loads the nfiles wordlists or sum index files with the names
+ * provided to it, listens on the Unix domain socket at path and answers
+ * requests with nthreads worker threads until it is sent SIGINT or SIGTERM.
+ * It then prints the latency percentiles of the requests it answered on
+ * stderr and removes the socket. If an error occurs while it is starting
+ * the program will exit.
+ */
+void serve(const char* path, char** files, size_t nfiles, unsigned nthreads);
+
+#endif // SERVE_H
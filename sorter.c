@@ -0,0 +1,455 @@
+/**
+ * sorter.c
+ *
+ * This file contains the definitions of the functions that sort the words
+ * saved to a savefile.
+ *
+ * The radix sort distributes the words into 257 buckets by their byte at the
+ * current depth (the first bucket holding the words that end there) and then
+ * sorts each bucket by the next byte. Small buckets, and buckets of words
+ * that share a very long prefix, are finished with insertion sort or
+ * qsort() instead.
+ *
+ * Author: Richard Gale
+ */
+
+#include "sorter.h"
+
+/**
+ * Buckets with fewer words than this are insertion sorted.
+ */
+#define INSERTION_MAX 32
+
+/**
+ * Buckets this many bytes deep are finished with qsort(), so a run of long
+ * words with a common prefix can't recurse too deeply.
+ */
+#define RADIX_MAX_DEPTH 64
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void sorter_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function compares two words byte by byte. Words that are a prefix of
+ * another come first.
+ */
+static int compare_keys(const struct sortkey* a, const struct sortkey* b)
+{
+    size_t n = a->len < b->len ? a->len : b->len;
+    int c;
+
+    if ((c = memcmp(a->str, b->str, n)) != 0)
+        return c;
+
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+/**
+ * This function compares two words for qsort().
+ */
+static int compare_qsort(const void* a, const void* b)
+{
+    return compare_keys(a, b);
+}
+
+/**
+ * This function returns the bucket of a word at the depth provided to it: 0
+ * if the word ends before depth, or its byte at depth plus 1.
+ */
+static inline size_t key_byte(const struct sortkey* k, size_t depth)
+{
+    return depth < k->len ? (unsigned char) k->str[depth] + 1 : 0;
+}
+
+/**
+ * This function insertion sorts n words whose first depth bytes are equal.
+ */
+static void insertion_sort(struct sortkey* a, size_t n, size_t depth)
+{
+    struct sortkey k;   /* The word being inserted. */
+    struct sortkey x;   /* k without its first depth bytes. */
+    struct sortkey y;   /* The word being compared, likewise. */
+    size_t i, j;
+
+    for (i = 1; i < n; i++)
+    {
+        k = a[i];
+        x = (struct sortkey) { k.str + depth, k.len - depth };
+        for (j = i; j > 0; j--)
+        {
+            y = (struct sortkey) { a[j - 1].str + depth, a[j - 1].len - depth };
+            if (compare_keys(&y, &x) <= 0)
+                break;
+            a[j] = a[j - 1];
+        }
+        a[j] = k;
+    }
+}
+
+/**
+ * This function radix sorts n words whose first depth bytes are equal, using
+ * tmp, which holds n keys, to distribute them.
+ */
+static void radix_sort(struct sortkey* a, struct sortkey* tmp, size_t n,
+                                                        size_t depth)
+{
+    size_t count[257];  /* Number of words in each bucket. */
+    size_t start[257];  /* Index of the start of each bucket. */
+    size_t next[257];   /* Index of the next word of each bucket. */
+    size_t b;           /* The current bucket. */
+    size_t i;
+
+    if (n < INSERTION_MAX)
+    {
+        insertion_sort(a, n, depth);
+        return;
+    }
+
+    if (depth >= RADIX_MAX_DEPTH)
+    {
+        qsort(a, n, sizeof(struct sortkey), compare_qsort);
+        return;
+    }
+
+    /* Counting the words in each bucket. */
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+        count[key_byte(&a[i], depth)]++;
+
+    start[0] = 0;
+    for (b = 1; b < 257; b++)
+        start[b] = start[b - 1] + count[b - 1];
+
+    /* Distributing the words into their buckets. */
+    memcpy(next, start, sizeof(next));
+    for (i = 0; i < n; i++)
+        tmp[next[key_byte(&a[i], depth)]++] = a[i];
+    memcpy(a, tmp, sizeof(struct sortkey) * n);
+
+    /* The words in the first bucket are equal, so it is already sorted. */
+    for (b = 1; b < 257; b++)
+    {
+        if (count[b] > 1)
+            radix_sort(a + start[b], tmp + start[b], count[b], depth + 1);
+    }
+}
+
+/**
+ * This function sorts the words held in memory.
+ */
+static void sort_keys(struct sorter* s)
+{
+    struct sortkey* tmp;
+
+    if (s->nkeys < 2)
+        return;
+
+    if ((tmp = malloc(sizeof(struct sortkey) * s->nkeys)) == NULL)
+        sorter_error("sort_keys", strerror(errno));
+
+    radix_sort(s->keys, tmp, s->nkeys, 0);
+
+    free(tmp);
+}
+
+/**
+ * This function writes a word and a newline to the stream provided to it.
+ */
+static void write_word(FILE* fs, const char* str, size_t len)
+{
+    if (fwrite(str, sizeof(char), len, fs) != len || fputc('\n', fs) == EOF)
+        sorter_error("write_word", strerror(errno));
+}
+
+/**
+ * This function frees the words held in memory, keeping the arena's blocks
+ * for the next words.
+ */
+static void clear_keys(struct sorter* s)
+{
+    resetarena(s->words);
+    s->nkeys = 0;
+    s->bytes = 0;
+}
+
+/**
+ * This function sorts the words held in memory and writes them to a
+ * temporary file as a run.
+ */
+static void spill_run(struct sorter* s)
+{
+    FILE* fs;   /* The run. */
+    size_t i;
+
+    sort_keys(s);
+
+    if ((fs = tmpfile()) == NULL)
+        sorter_error("spill_run", strerror(errno));
+
+    for (i = 0; i < s->nkeys; i++)
+    {
+        if (s->unique && i > 0 && compare_keys(&s->keys[i], &s->keys[i - 1]) == 0)
+            continue;
+        write_word(fs, s->keys[i].str, s->keys[i].len);
+    }
+
+    if (fflush(fs) != 0)
+        sorter_error("spill_run", strerror(errno));
+    rewind(fs);
+
+    if ((s->runs = realloc(s->runs, sizeof(FILE*) * (s->nruns + 1))) == NULL)
+        sorter_error("spill_run", strerror(errno));
+    s->runs[s->nruns++] = fs;
+
+    clear_keys(s);
+}
+
+/**
+ * This function makes a sorter.
+ */
+struct sorter* open_sorter(size_t budget, bool unique)
+{
+    struct sorter* s;
+
+    if ((s = calloc(1, sizeof(struct sorter))) == NULL)
+        sorter_error("open_sorter", strerror(errno));
+
+    s->words = openarena(SORTER_BLOCK_SIZE);
+    s->budget = budget;
+    s->unique = unique;
+
+    return s;
+}
+
+/**
+ * This function copies a word into the arena and adds it to the words held
+ * in memory.
+ */
+static void add_word(struct sorter* s, const char* word, size_t len)
+{
+    /* Spilling the words if they have outgrown the budget. */
+    if (s->bytes + len + sizeof(struct sortkey) > s->budget && s->nkeys > 0)
+        spill_run(s);
+
+    if (s->nkeys == s->capkeys)
+    {
+        s->capkeys = s->capkeys > 0 ? s->capkeys * 2 : 1024;
+        s->keys = realloc(s->keys, sizeof(struct sortkey) * s->capkeys);
+        if (s->keys == NULL)
+            sorter_error("add_word", strerror(errno));
+    }
+
+    s->keys[s->nkeys].str = copyarena(s->words, word, len);
+    s->keys[s->nkeys].len = len;
+    s->nkeys++;
+    s->bytes += len + sizeof(struct sortkey);
+}
+
+/**
+ * This function adds the newline separated words in data to the sorter.
+ */
+void add_sorted(struct sorter* s, const char* data, size_t len)
+{
+    const char* end = data + len;
+    const char* nl;     /* The newline that ends the current word. */
+
+    while (data < end)
+    {
+        if ((nl = memchr(data, '\n', end - data)) == NULL)
+            nl = end;
+
+        add_word(s, data, nl - data);
+        data = nl + 1;
+    }
+}
+
+/**
+ * This is the head of a run being merged.
+ */
+struct runhead {
+    char* line;     /* The run's current word, with its newline. */
+    size_t cap;     /* Number of bytes allocated to line. */
+    size_t len;     /* Length of the current word without its newline. */
+    FILE* fs;       /* The run. */
+};
+
+/**
+ * This function reads the next word of a run. It returns false at the end of
+ * the run.
+ */
+static bool next_word(struct runhead* h)
+{
+    ssize_t n;
+
+    if ((n = getline(&h->line, &h->cap, h->fs)) == -1)
+    {
+        if (ferror(h->fs))
+            sorter_error("next_word", strerror(errno));
+        return false;
+    }
+
+    h->len = n > 0 && h->line[n - 1] == '\n' ? n - 1 : n;
+
+    return true;
+}
+
+/**
+ * This function compares the current words of two runs.
+ */
+static int compare_heads(const struct runhead* a, const struct runhead* b)
+{
+    struct sortkey x = { a->line, a->len };
+    struct sortkey y = { b->line, b->len };
+
+    return compare_keys(&x, &y);
+}
+
+/**
+ * This function moves the run at index i of the heap down until it is no
+ * greater than its children.
+ */
+static void sift_down(struct runhead** heap, size_t n, size_t i)
+{
+    struct runhead* h;  /* The run being moved. */
+    size_t c;           /* Index of the smaller child. */
+
+    h = heap[i];
+    while ((c = 2 * i + 1) < n)
+    {
+        if (c + 1 < n && compare_heads(heap[c + 1], heap[c]) < 0)
+            c++;
+        if (compare_heads(heap[c], h) >= 0)
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = h;
+}
+
+/**
+ * This function merges the sorter's runs into out with a heap of the runs'
+ * current words. It returns the number of words written.
+ */
+static uint64_t merge_runs(struct sorter* s, bufwriter* out)
+{
+    struct runhead* heads;  /* The head of each run. */
+    struct runhead** heap;  /* The runs that aren't finished, smallest first. */
+    char* last;             /* The last word written, for unique sorters. */
+    size_t lastlen;         /* Length of the last word written. */
+    size_t lastcap;         /* Number of bytes allocated to last. */
+    size_t n;               /* Number of runs in the heap. */
+    size_t i;
+    uint64_t written;       /* Number of words written. */
+    struct runhead* h;      /* The run with the smallest word. */
+
+    heads = calloc(s->nruns, sizeof(struct runhead));
+    heap = malloc(sizeof(struct runhead*) * s->nruns);
+    if (heads == NULL || heap == NULL)
+        sorter_error("merge_runs", strerror(errno));
+
+    n = 0;
+    for (i = 0; i < s->nruns; i++)
+    {
+        heads[i].fs = s->runs[i];
+        if (next_word(&heads[i]))
+            heap[n++] = &heads[i];
+    }
+    for (i = n / 2; i-- > 0; )
+        sift_down(heap, n, i);
+
+    last = NULL;
+    lastlen = 0;
+    lastcap = 0;
+    written = 0;
+    while (n > 0)
+    {
+        h = heap[0];
+
+        if (!s->unique || written == 0 || h->len != lastlen
+            || memcmp(h->line, last, lastlen) != 0)
+        {
+            writebw(out, h->line, h->len);
+            writebw(out, "\n", 1);
+            written++;
+
+            if (s->unique)
+            {
+                if (h->len > lastcap)
+                {
+                    lastcap = h->len * 2;
+                    if ((last = realloc(last, lastcap)) == NULL)
+                        sorter_error("merge_runs", strerror(errno));
+                }
+                memcpy(last, h->line, h->len);
+                lastlen = h->len;
+            }
+        }
+
+        if (!next_word(h))
+            heap[0] = heap[--n];
+        sift_down(heap, n, 0);
+    }
+
+    for (i = 0; i < s->nruns; i++)
+    {
+        free(heads[i].line);
+        fclose(s->runs[i]);
+    }
+    free(last);
+    free(heap);
+    free(heads);
+
+    return written;
+}
+
+/**
+ * This function writes the sorter's words to out in order and frees the
+ * sorter.
+ */
+uint64_t close_sorter(struct sorter* s, bufwriter* out)
+{
+    uint64_t written;   /* Number of words written. */
+    size_t i;
+
+    if (s->nruns > 0)
+    {
+        /* The words still in memory are the last run. */
+        if (s->nkeys > 0)
+            spill_run(s);
+        written = merge_runs(s, out);
+    }
+    else
+    {
+        sort_keys(s);
+
+        written = 0;
+        for (i = 0; i < s->nkeys; i++)
+        {
+            if (s->unique && i > 0
+                && compare_keys(&s->keys[i], &s->keys[i - 1]) == 0)
+                continue;
+            writebw(out, s->keys[i].str, s->keys[i].len);
+            writebw(out, "\n", 1);
+            written++;
+        }
+    }
+
+    closearena(s->words);
+    free(s->keys);
+    free(s->runs);
+    free(s);
+
+    return written;
+}
@@ -0,0 +1,76 @@
+/**
+ * sorter.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for sorters. A sorter collects the words saved to a savefile
+ * and writes them out sorted (and optionally without duplicates) when it is
+ * finished, replacing a `sort` or `sort -u` of the savefile afterwards.
+ *
+ * Words are copied into an arena of large blocks and sorted with an MSD
+ * radix sort. If the words outgrow the sorter's memory budget, they are
+ * sorted and spilled to a temporary file as a run, and the runs are merged
+ * when the sorter is finished. Words are compared byte by byte, as
+ * `LC_ALL=C sort` compares them.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef SORTER_H
+#define SORTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mycutils.h"
+
+/**
+ * This is the size of each block of a sorter's arena. Words longer than this
+ * get a block of their own.
+ */
+#define SORTER_BLOCK_SIZE (1 << 20)
+
+/**
+ * This is one word held by a sorter, without its newline.
+ */
+struct sortkey {
+    const char* str;    /* The word, in the arena. */
+    size_t len;         /* Length of the word. */
+};
+
+/**
+ * This is a sorter.
+ */
+struct sorter {
+    arena* words;           /* The arena the words are copied into. */
+    struct sortkey* keys;   /* The words held in memory. */
+    size_t nkeys;           /* Number of words held in memory. */
+    size_t capkeys;         /* Number of keys allocated. */
+    size_t bytes;           /* Memory used by the words held in memory. */
+    size_t budget;          /* Most memory the words can use before a spill. */
+    bool unique;            /* Whether duplicate words are dropped. */
+    FILE** runs;            /* The sorted runs spilled to temporary files. */
+    size_t nruns;           /* Number of runs. */
+};
+
+/**
+ * This function makes a sorter that holds at most budget bytes of words in
+ * memory before spilling them. If unique is true, duplicate words are only
+ * written once. If an error occurs the program will exit.
+ */
+struct sorter* open_sorter(size_t budget, bool unique);
+
+/**
+ * This function adds the words in the len bytes of data provided to it to
+ * the sorter. The words are separated by newlines and the last one doesn't
+ * need one.
+ */
+void add_sorted(struct sorter* s, const char* data, size_t len);
+
+/**
+ * This function writes the sorter's words to out in order, one per line, and
+ * frees the sorter. It returns the number of words written.
+ */
+uint64_t close_sorter(struct sorter* s, bufwriter* out);
+
+#endif // SORTER_H
@@ -0,0 +1,454 @@
+/**
+ * source.c
+ *
+ * This file contains the definitions of the functions that read wordlists,
+ * decompressing them if they are compressed.
+ *
+ * The decompressor thread fills free blocks of the queue and the scanner
+ * reads them in order, handing each block back once it has read all of it.
+ * The thread waits when every block is full and the scanner waits when every
+ * block is empty, so at most SOURCE_QUEUE_BLOCKS blocks are ever in memory.
+ *
+ * Author: Richard Gale
+ */
+
+#include <zlib.h>
+#ifdef SUMS666_ZSTD
+#include <zstd.h>
+#endif
+
+#include "mycutils.h"
+#include "source.h"
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void source_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function reads up to len bytes of the raw wordlist into buf, starting
+ * with any bytes that were read to detect its format. It returns the number
+ * of bytes read, 0 at the end of the wordlist or -1 if an error occurred.
+ */
+static ssize_t read_raw(struct source* src, char* buf, size_t len)
+{
+    ssize_t n;  /* Number of bytes read. */
+
+    if (src->headpos < src->headlen)
+    {
+        n = src->headlen - src->headpos < len ? src->headlen - src->headpos
+                                              : len;
+        memcpy(buf, src->head + src->headpos, n);
+        src->headpos += n;
+        return n;
+    }
+
+    while ((n = read(src->fd, buf, len)) == -1 && errno == EINTR)
+        ;
+
+    return n;
+}
+
+/**
+ * This function waits for a free block for the decompressor thread to fill
+ * and returns it, or returns NULL if the thread has been told to stop.
+ */
+static struct source_block* next_block(struct source* src)
+{
+    struct source_block* b;
+
+    pthread_mutex_lock(&src->lock);
+    while (src->count == SOURCE_QUEUE_BLOCKS && !src->stop)
+        pthread_cond_wait(&src->emptied, &src->lock);
+
+    b = src->stop ? NULL
+                  : &src->blocks[(src->first + src->count) % SOURCE_QUEUE_BLOCKS];
+    pthread_mutex_unlock(&src->lock);
+
+    if (b != NULL)
+        b->len = 0;
+
+    return b;
+}
+
+/**
+ * This function adds the block the decompressor thread has filled to the
+ * queue.
+ */
+static void push_block(struct source* src)
+{
+    pthread_mutex_lock(&src->lock);
+    src->count++;
+    pthread_cond_signal(&src->filled);
+    pthread_mutex_unlock(&src->lock);
+}
+
+/**
+ * This function marks the decompressor thread as finished, with the error
+ * provided to it or NULL if it succeeded, and returns NULL for the thread to
+ * return.
+ */
+static void* finish(struct source* src, const char* error)
+{
+    pthread_mutex_lock(&src->lock);
+    src->done = true;
+    src->error = error;
+    pthread_cond_signal(&src->filled);
+    pthread_mutex_unlock(&src->lock);
+
+    return NULL;
+}
+
+/**
+ * This function is the decompressor thread of gzip (and zlib) wordlists.
+ * Concatenated gzip members are decompressed one after the other, as gzip
+ * does.
+ */
+static void* inflate_gzip(void* arg)
+{
+    struct source* src = arg;
+    struct source_block* b; /* The block being filled. */
+    z_stream zs;            /* The zlib stream. */
+    char* in;               /* The compressed bytes. */
+    ssize_t n;              /* Number of compressed bytes read. */
+    bool ended;             /* Whether the last member was finished. */
+    int ret;                /* What inflate() returned. */
+
+    memset(&zs, 0, sizeof(zs));
+    if ((in = malloc(SOURCE_BLOCK_SIZE)) == NULL
+        || inflateInit2(&zs, 15 + 32) != Z_OK)
+        return finish(src, "Couldn't start decompressing");
+
+    if ((b = next_block(src)) == NULL)
+    {
+        inflateEnd(&zs);
+        free(in);
+        return finish(src, NULL);
+    }
+    zs.next_out = (Bytef*) b->buf;
+    zs.avail_out = SOURCE_BLOCK_SIZE;
+    ended = false;
+    n = 0;
+
+    for (;;)
+    {
+        if (zs.avail_in == 0)
+        {
+            if ((n = read_raw(src, in, SOURCE_BLOCK_SIZE)) <= 0)
+                break;
+            zs.next_in = (Bytef*) in;
+            zs.avail_in = n;
+        }
+
+        ret = inflate(&zs, Z_NO_FLUSH);
+        ended = ret == Z_STREAM_END;
+        if (ended)
+            inflateReset(&zs);
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            break;
+
+        b->len = SOURCE_BLOCK_SIZE - zs.avail_out;
+        if (zs.avail_out == 0)
+        {
+            push_block(src);
+            if ((b = next_block(src)) == NULL)
+                break;
+            zs.next_out = (Bytef*) b->buf;
+            zs.avail_out = SOURCE_BLOCK_SIZE;
+        }
+    }
+
+    inflateEnd(&zs);
+    free(in);
+
+    if (b == NULL)
+        return finish(src, NULL);
+
+    if (b->len > 0)
+        push_block(src);
+
+    if (n < 0)
+        return finish(src, strerror(errno));
+    if (!ended)
+        return finish(src, "The gzip wordlist is corrupt or truncated");
+
+    return finish(src, NULL);
+}
+
+#ifdef SUMS666_ZSTD
+/**
+ * This function is the decompressor thread of zstd wordlists.
+ */
+static void* inflate_zstd(void* arg)
+{
+    struct source* src = arg;
+    struct source_block* b; /* The block being filled. */
+    ZSTD_DStream* zs;       /* The zstd stream. */
+    ZSTD_inBuffer zin;      /* The compressed bytes. */
+    ZSTD_outBuffer zout;    /* The block being filled, as zstd sees it. */
+    char* in;               /* The compressed bytes. */
+    ssize_t n;              /* Number of compressed bytes read. */
+    size_t ret;             /* What ZSTD_decompressStream() returned. */
+
+    if ((in = malloc(SOURCE_BLOCK_SIZE)) == NULL
+        || (zs = ZSTD_createDStream()) == NULL)
+        return finish(src, "Couldn't start decompressing");
+
+    if ((b = next_block(src)) == NULL)
+    {
+        ZSTD_freeDStream(zs);
+        free(in);
+        return finish(src, NULL);
+    }
+    zin = (ZSTD_inBuffer) { in, 0, 0 };
+    zout = (ZSTD_outBuffer) { b->buf, SOURCE_BLOCK_SIZE, 0 };
+    ret = 0;
+    n = 0;
+
+    for (;;)
+    {
+        if (zin.pos == zin.size)
+        {
+            if ((n = read_raw(src, in, SOURCE_BLOCK_SIZE)) <= 0)
+                break;
+            zin.size = n;
+            zin.pos = 0;
+        }
+
+        ret = ZSTD_decompressStream(zs, &zout, &zin);
+        if (ZSTD_isError(ret))
+            break;
+
+        b->len = zout.pos;
+        if (zout.pos == zout.size)
+        {
+            push_block(src);
+            if ((b = next_block(src)) == NULL)
+                break;
+            zout = (ZSTD_outBuffer) { b->buf, SOURCE_BLOCK_SIZE, 0 };
+        }
+    }
+
+    ZSTD_freeDStream(zs);
+    free(in);
+
+    if (b == NULL)
+        return finish(src, NULL);
+
+    if (b->len > 0)
+        push_block(src);
+
+    if (n < 0)
+        return finish(src, strerror(errno));
+    if (ret != 0)
+        return finish(src, "The zstd wordlist is corrupt or truncated");
+
+    return finish(src, NULL);
+}
+#endif // SUMS666_ZSTD
+
+/**
+ * This function opens a source that reads the wordlist with the file
+ * descriptor provided to it, detecting its format from its magic bytes.
+ */
+struct source* open_source(int fd)
+{
+    static const unsigned char gzip_magic[] = { 0x1F, 0x8B };
+    static const unsigned char zstd_magic[] = { 0x28, 0xB5, 0x2F, 0xFD };
+    struct source* src;     /* The source. */
+    struct stat st;         /* Status of the wordlist. */
+    void* (*inflater)(void*);   /* The decompressor thread's function. */
+    ssize_t n;              /* Number of bytes of head read. */
+    ssize_t r;              /* Number of bytes read by one call. */
+    size_t i;               /* Index of the current block. */
+    int err;                /* Error returned by pthread_create(). */
+
+    if ((src = calloc(1, sizeof(struct source))) == NULL)
+        source_error("open_source", strerror(errno));
+    src->fd = fd;
+
+    /* A regular file's magic bytes are read without moving its position, so
+     * it can still be read from the start. Anything else has to have its
+     * magic bytes read, and they are given back by read_source(). */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        if ((n = pread(fd, src->head, sizeof(src->head), 0)) == -1)
+            source_error("open_source", strerror(errno));
+    }
+    else
+    {
+        for (n = 0; (size_t) n < sizeof(src->head); n += r)
+        {
+            while ((r = read(fd, src->head + n, sizeof(src->head) - n)) == -1
+                   && errno == EINTR)
+                ;
+            if (r == -1)
+                source_error("open_source", strerror(errno));
+            if (r == 0)
+                break;
+        }
+        src->headlen = n;
+    }
+
+    src->format = SOURCE_PLAIN;
+    if ((size_t) n >= sizeof(gzip_magic)
+        && memcmp(src->head, gzip_magic, sizeof(gzip_magic)) == 0)
+        src->format = SOURCE_GZIP;
+    if ((size_t) n >= sizeof(zstd_magic)
+        && memcmp(src->head, zstd_magic, sizeof(zstd_magic)) == 0)
+        src->format = SOURCE_ZSTD;
+
+    if (src->format == SOURCE_PLAIN)
+        return src;
+
+    inflater = inflate_gzip;
+    if (src->format == SOURCE_ZSTD)
+    {
+#ifdef SUMS666_ZSTD
+        inflater = inflate_zstd;
+#else
+        source_error("open_source", "The wordlist is compressed with zstd, "
+                     "which this build doesn't support. Rebuild with "
+                     "-DSUMS666_ZSTD -lzstd");
+#endif
+    }
+
+    /* Starting the decompressor thread. */
+    for (i = 0; i < SOURCE_QUEUE_BLOCKS; i++)
+    {
+        if ((src->blocks[i].buf = malloc(SOURCE_BLOCK_SIZE)) == NULL)
+            source_error("open_source", strerror(errno));
+    }
+    pthread_mutex_init(&src->lock, NULL);
+    pthread_cond_init(&src->filled, NULL);
+    pthread_cond_init(&src->emptied, NULL);
+
+    if ((err = pthread_create(&src->thread, NULL, inflater, src)) != 0)
+        source_error("open_source", strerror(err));
+
+    return src;
+}
+
+/**
+ * This function reads up to len decompressed bytes of the wordlist into buf.
+ * It returns the number of bytes read, which is only 0 at the end of the
+ * wordlist.
+ */
+ssize_t read_source(struct source* src, char* buf, size_t len)
+{
+    struct source_block* b;     /* The oldest queued block. */
+    const char* error;          /* Why the decompressor thread failed. */
+    ssize_t n;                  /* Number of bytes read. */
+
+    if (src->format == SOURCE_PLAIN)
+    {
+        if ((n = read_raw(src, buf, len)) == -1)
+            source_error("read_source", strerror(errno));
+        return n;
+    }
+
+    /* Waiting for a block. */
+    pthread_mutex_lock(&src->lock);
+    while (src->count == 0 && !src->done)
+        pthread_cond_wait(&src->filled, &src->lock);
+    b = src->count > 0 ? &src->blocks[src->first] : NULL;
+    error = src->error;
+    pthread_mutex_unlock(&src->lock);
+
+    if (b == NULL)
+    {
+        if (error != NULL)
+            source_error("read_source", error);
+        return 0;
+    }
+
+    n = b->len - src->pos < len ? b->len - src->pos : len;
+    memcpy(buf, b->buf + src->pos, n);
+    src->pos += n;
+
+    /* Handing the block back once all of it has been read. */
+    if (src->pos == b->len)
+    {
+        pthread_mutex_lock(&src->lock);
+        src->first = (src->first + 1) % SOURCE_QUEUE_BLOCKS;
+        src->count--;
+        src->pos = 0;
+        pthread_cond_signal(&src->emptied);
+        pthread_mutex_unlock(&src->lock);
+    }
+
+    return n;
+}
+
+/**
+ * This function reads the rest of the wordlist into memory.
+ */
+char* read_source_all(struct source* src, size_t* len)
+{
+    char* buf;      /* The wordlist. */
+    size_t cap;     /* Number of bytes allocated. */
+    ssize_t n;      /* Number of bytes read. */
+
+    cap = SOURCE_BLOCK_SIZE;
+    if ((buf = malloc(cap)) == NULL)
+        source_error("read_source_all", strerror(errno));
+
+    *len = 0;
+    while ((n = read_source(src, buf + *len, cap - *len)) > 0)
+    {
+        *len += n;
+        if (*len == cap)
+        {
+            cap *= 2;
+            if ((buf = realloc(buf, cap)) == NULL)
+                source_error("read_source_all", strerror(errno));
+        }
+    }
+
+    return buf;
+}
+
+/**
+ * This function returns true if the source's wordlist is compressed.
+ */
+bool source_compressed(const struct source* src)
+{
+    return src->format != SOURCE_PLAIN;
+}
+
+/**
+ * This function stops the decompressor thread, if there is one, and frees
+ * the source.
+ */
+void close_source(struct source* src)
+{
+    size_t i;
+
+    if (src->format != SOURCE_PLAIN)
+    {
+        pthread_mutex_lock(&src->lock);
+        src->stop = true;
+        pthread_cond_signal(&src->emptied);
+        pthread_mutex_unlock(&src->lock);
+
+        pthread_join(src->thread, NULL);
+
+        pthread_cond_destroy(&src->emptied);
+        pthread_cond_destroy(&src->filled);
+        pthread_mutex_destroy(&src->lock);
+        for (i = 0; i < SOURCE_QUEUE_BLOCKS; i++)
+            free(src->blocks[i].buf);
+    }
+
+    free(src);
+}
@@ -0,0 +1,110 @@
+/**
+ * source.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for wordlist sources. A source reads a wordlist that might be
+ * compressed. The compression is detected from the magic bytes at the start
+ * of the wordlist, and a compressed wordlist is decompressed on its own
+ * thread into a bounded queue of blocks, so decompressing and summing happen
+ * at the same time.
+ *
+ * gzip (and zlib) wordlists are always supported. zstd wordlists are
+ * supported if the program is built with -DSUMS666_ZSTD and -lzstd.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * This is the size of each block of decompressed bytes.
+ */
+#define SOURCE_BLOCK_SIZE (1 << 18)
+
+/**
+ * This is the number of blocks in the queue between the decompressor thread
+ * and the scanner. It bounds the memory a compressed wordlist uses.
+ */
+#define SOURCE_QUEUE_BLOCKS 8
+
+/**
+ * These are the formats a wordlist can be in.
+ */
+enum source_format {
+    SOURCE_PLAIN,
+    SOURCE_GZIP,
+    SOURCE_ZSTD
+};
+
+/**
+ * This is a block of decompressed bytes.
+ */
+struct source_block {
+    char* buf;      /* The bytes. */
+    size_t len;     /* Number of bytes in the block. */
+};
+
+/**
+ * This is a wordlist source.
+ */
+struct source {
+    int fd;                     /* The wordlist's file descriptor. */
+    enum source_format format;  /* The format of the wordlist. */
+    char head[4];               /* Bytes read to detect the format. */
+    size_t headlen;             /* Number of bytes in head still to be read. */
+    size_t headpos;             /* Offset of the next byte of head. */
+
+    /* The decompressor thread and its queue of blocks. */
+    pthread_t thread;           /* The decompressor thread. */
+    pthread_mutex_t lock;       /* Guards the queue. */
+    pthread_cond_t filled;      /* Signalled when a block is queued. */
+    pthread_cond_t emptied;     /* Signalled when a block is freed. */
+    struct source_block blocks[SOURCE_QUEUE_BLOCKS];
+    size_t first;               /* Index of the oldest queued block. */
+    size_t count;               /* Number of queued blocks. */
+    bool done;                  /* Whether the thread has finished. */
+    bool stop;                  /* Whether the thread has been told to stop. */
+    const char* error;          /* Why the thread failed, or NULL. */
+    size_t pos;                 /* Bytes of the oldest block already read. */
+};
+
+/**
+ * This function opens a source that reads the wordlist with the file
+ * descriptor provided to it, detecting its format. A regular file's position
+ * isn't changed, so if it isn't compressed it can still be read or mapped
+ * directly. If the wordlist is compressed the decompressor thread is
+ * started. If an error occurs the program will exit.
+ */
+struct source* open_source(int fd);
+
+/**
+ * This function reads up to len decompressed bytes of the wordlist into buf.
+ * It returns the number of bytes read, which is only 0 at the end of the
+ * wordlist. If an error occurs the program will exit.
+ */
+ssize_t read_source(struct source* src, char* buf, size_t len);
+
+/**
+ * This function reads the rest of the wordlist into memory, storing its
+ * length in len. Make sure to free() it when you're finished with it.
+ */
+char* read_source_all(struct source* src, size_t* len);
+
+/**
+ * This function returns true if the source's wordlist is compressed.
+ */
+bool source_compressed(const struct source* src);
+
+/**
+ * This function stops the decompressor thread, if there is one, and frees
+ * the source. It doesn't close the file descriptor.
+ */
+void close_source(struct source* src);
+
+#endif // SOURCE_H
@@ -0,0 +1,238 @@
+/**
+ * sumindex.c
+ *
+ * This file contains the definitions of the functions that build and query
+ * sum index files.
+ *
+ * Author: Richard Gale
+ */
+
+#include "mycutils.h"
+#include "linesum.h"
+#include "source.h"
+#include "sumindex.h"
+
+/**
+ * This is the number of words the kernel sums per call while indexing.
+ */
+#define INDEX_BATCH 4096
+
+/**
+ * This function compares two words by their sums and then by where they
+ * appear in the wordlist, for qsort().
+ */
+static int compare_words(const void* a, const void* b)
+{
+    const struct linesum* x = a;
+    const struct linesum* y = b;
+
+    if (x->sum != y->sum)
+        return (x->sum > y->sum) - (x->sum < y->sum);
+
+    return (x->off > y->off) - (x->off < y->off);
+}
+
+/**
+ * This function prints an error message that starts with the name of the
+ * function provided to it and exits the program.
+ */
+static void index_error(const char* func, const char* msg)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, msg);
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function sums every word in the wordlist provided to it and writes an
+ * index of them to the file with the name provided to it. A compressed
+ * wordlist is decompressed first. It returns the number of words indexed.
+ */
+uint64_t write_index(FILE* wordlist, char* fname)
+{
+    struct index_header header;     /* The header of the index. */
+    struct index_bucket bucket;     /* The bucket being written. */
+    struct linesum* words;          /* Every word in the wordlist. */
+    struct source* src;             /* The wordlist, if it can't be mapped. */
+    size_t nwords;                  /* Number of words in the wordlist. */
+    size_t cap;                     /* Number of words allocated. */
+    char* buf;                      /* The wordlist. */
+    size_t len;                     /* Length of the wordlist. */
+    bool mapped;                    /* Whether the wordlist was mapped. */
+    size_t pos;                     /* Offset of the current batch. */
+    size_t used;                    /* Bytes consumed by the current batch. */
+    size_t n;                       /* Number of words in the batch. */
+    size_t i;                       /* Index of the current word. */
+    size_t first;                   /* Index of the bucket's first word. */
+    FILE* fs;                       /* The index file. */
+
+    /* Getting the whole wordlist into memory. */
+    src = open_source(fileno(wordlist));
+    mapped = !source_compressed(src) && (buf = mapfs(wordlist, &len)) != NULL;
+    if (!mapped)
+        buf = read_source_all(src, &len);
+    close_source(src);
+
+    /* Summing every word. */
+    cap = INDEX_BATCH;
+    nwords = 0;
+    if ((words = malloc(sizeof(struct linesum) * cap)) == NULL)
+        index_error("write_index", strerror(errno));
+
+    pos = 0;
+    do
+    {
+        if (nwords + INDEX_BATCH > cap)
+        {
+            cap *= 2;
+            if ((words = realloc(words, sizeof(struct linesum) * cap)) == NULL)
+                index_error("write_index", strerror(errno));
+        }
+
+        n = linesums(buf + pos, len - pos, words + nwords, INDEX_BATCH, &used);
+        for (i = nwords; i < nwords + n; i++)
+            words[i].off += pos;
+
+        nwords += n;
+        pos += used;
+    } while (n > 0);
+
+    /* The kernel leaves the last word if it doesn't end with a newline. */
+    if (pos < len)
+    {
+        words[nwords].off = pos;
+        words[nwords].len = len - pos;
+        words[nwords].sum = 0;
+        for (i = pos; i < len; i++)
+            words[nwords].sum += (int) buf[i];
+        nwords++;
+    }
+
+    /* Grouping the words by their sums. */
+    qsort(words, nwords, sizeof(struct linesum), compare_words);
+
+    /* Writing the header. The number of buckets is filled in later. */
+    fs = openfs(fname, "w");
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.nwords = nwords;
+    for (i = 0; i < nwords; i++)
+    {
+        if (i == 0 || words[i].sum != words[i - 1].sum)
+            header.nbuckets++;
+    }
+    header.blob_off = sizeof(header)
+                    + sizeof(struct index_bucket) * header.nbuckets;
+
+    fwrite(&header, sizeof(header), 1, fs);
+
+    /* Writing the buckets. */
+    bucket.off = 0;
+    for (first = 0; first < nwords; first = i)
+    {
+        bucket.sum = words[first].sum;
+        bucket.len = 0;
+        for (i = first; i < nwords && words[i].sum == bucket.sum; i++)
+            bucket.len += words[i].len + 1;
+        bucket.count = i - first;
+
+        fwrite(&bucket, sizeof(bucket), 1, fs);
+        bucket.off += bucket.len;
+    }
+
+    /* Writing the words in bucket order. */
+    for (i = 0; i < nwords; i++)
+    {
+        fwrite(buf + words[i].off, sizeof(char), words[i].len, fs);
+        fputc('\n', fs);
+    }
+
+    if (ferror(fs))
+        index_error("write_index", strerror(errno));
+
+    closefs(fs);
+
+    /* Cleaning up. */
+    free(words);
+    if (mapped)
+        unmapfs(buf, len);
+    else
+        free(buf);
+
+    return nwords;
+}
+
+/**
+ * This function writes every word in the index file with the name provided to
+ * it that sums to target to the file stream provided to it, one per line.
+ * Only the header, the bucket table and the one bucket are read from the
+ * index. It returns the number of words written.
+ */
+uint64_t query_index(char* fname, long target, FILE* out)
+{
+    const struct index_header* header;  /* The header of the index. */
+    const struct index_bucket* buckets; /* The buckets of the index. */
+    const struct index_bucket* b;       /* The bucket being checked. */
+    FILE* fs;       /* The index file. */
+    char* map;      /* The mapped index. */
+    size_t len;     /* Length of the mapped index. */
+    size_t lo;      /* Lowest bucket that might hold the target. */
+    size_t hi;      /* One past the highest bucket that might hold it. */
+    size_t mid;     /* The bucket being checked. */
+    uint64_t count; /* Number of words written. */
+
+    fs = openfs(fname, "r");
+
+    /* Checking that the file is an index. */
+    map = mapfs(fs, &len);
+    header = (const struct index_header*) map;
+    if (map == NULL || len < sizeof(*header)
+        || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0)
+        index_error("query_index", "Not a sums666 index file");
+
+    if (header->version != INDEX_VERSION)
+        index_error("query_index", "Unsupported index version");
+
+    if (header->blob_off != sizeof(*header)
+                        + sizeof(*buckets) * (uint64_t) header->nbuckets
+        || header->blob_off > len)
+        index_error("query_index", "Index file is corrupt");
+
+    /* The buckets are sorted by sum so they can be searched. The mapping
+     * was made by mmap() so it is aligned for the buckets. */
+    buckets = (const struct index_bucket*) (map + sizeof(*header));
+    lo = 0;
+    hi = header->nbuckets;
+    count = 0;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        b = &buckets[mid];
+
+        if (b->sum == target)
+        {
+            if (b->off + b->len > len - header->blob_off)
+                index_error("query_index", "Index file is corrupt");
+
+            fwrite(map + header->blob_off + b->off, sizeof(char), b->len, out);
+            count = b->count;
+            break;
+        }
+
+        if (b->sum < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    unmapfs(map, len);
+    closefs(fs);
+
+    return count;
+}
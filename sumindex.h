@@ -0,0 +1,72 @@
+/**
+ * sumindex.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for sum index files. A sum index holds every word of a
+ * wordlist bucketed by the sum of its chars, so the words that sum to a
+ * target can be found by reading a single bucket instead of scanning the
+ * whole wordlist again.
+ *
+ * An index file is laid out as:
+ *
+ *   struct index_header
+ *   struct index_bucket[nbuckets]   ascending by sum
+ *   blob                            each bucket's words, one per line, in
+ *                                   the order they appear in the wordlist
+ *
+ * All integers are stored in the byte order of the machine that built the
+ * index.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef SUMINDEX_H
+#define SUMINDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * These identify a sum index file and the version of its layout.
+ */
+#define INDEX_MAGIC "SUMS666I"
+#define INDEX_VERSION 1
+
+/**
+ * This is the header at the start of an index file.
+ */
+struct index_header {
+    char magic[8];      /* INDEX_MAGIC, without its null character. */
+    uint32_t version;   /* INDEX_VERSION. */
+    uint32_t nbuckets;  /* Number of buckets. */
+    uint64_t nwords;    /* Number of words in the index. */
+    uint64_t blob_off;  /* Offset of the blob from the start of the file. */
+};
+
+/**
+ * This is one bucket of an index file. It holds every word with one sum.
+ */
+struct index_bucket {
+    int64_t sum;        /* The sum of every word in the bucket. */
+    uint64_t count;     /* Number of words in the bucket. */
+    uint64_t off;       /* Offset of the bucket's words in the blob. */
+    uint64_t len;       /* Length of the bucket's words in the blob. */
+};
+
+/**
+ * This function sums every word in the wordlist provided to it and writes an
+ * index of them to the file with the name provided to it. A compressed
+ * wordlist is decompressed first. It returns the number of words indexed.
+ * If an error occurs the program will exit.
+ */
+uint64_t write_index(FILE* wordlist, char* fname);
+
+/**
+ * This function writes every word in the index file with the name provided to
+ * it that sums to target to the file stream provided to it, one per line. It
+ * returns the number of words written. If the file isn't an index the program
+ * will exit.
+ */
+uint64_t query_index(char* fname, long target, FILE* out);
+
+#endif // SUMINDEX_H
@@ -1,18 +1,325 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <glob.h>
 
 #include "mycutils.h"
+#include "linesum.h"
+#include "sumindex.h"
+#include "phrase.h"
+#include "cipher.h"
+#include "checkpoint.h"
+#include "source.h"
+#include "sorter.h"
+#include "progress.h"
+#include "text.h"
+#include "serve.h"
+#include "pool.h"
+#include "reader.h"
+
+/**
+ * This is the number of words the kernels sum per call.
+ */
+#define LINESUM_BATCH 4096
+
+/**
+ * This is the number of chunks the wordlist is split into per worker thread.
+ */
+#define CHUNKS_PER_THREAD 4
+
+/**
+ * This is the largest distance between the smallest and the largest target
+ * sums for which a lookup table is used to find a sum's target.
+ */
+#define TARGET_TABLE_MAX 65536
+
+/**
+ * This is the size of the buffer of each savefile and of stdout.
+ */
+#define OUTBUF_SIZE (1 << 20)
+
+/**
+ * This is the size of the buffer that streamed wordlists are read into. It
+ * is the most memory a streamed wordlist ever uses.
+ */
+#define STREAM_BUF_SIZE (1 << 20)
+
+/**
+ * This is the size of the chunks that batch mode splits large wordlists
+ * into, so one huge wordlist is scanned by every thread.
+ */
+#define BATCH_CHUNK_SIZE (16 << 20)
+
+/**
+ * This is the default number of megabytes of words that --sort holds in
+ * memory before spilling sorted runs of them to temporary files.
+ */
+#define SORT_MEMORY_MB 256
+
+/**
+ * These are the statistics of a run, which --stats prints when it finishes.
+ */
+struct stats {
+    uint64_t bytes;     /* Number of bytes of the wordlist read. */
+    uint64_t lines;     /* Number of lines scanned. */
+    uint64_t matches;   /* Number of words that summed to a target. */
+    uint64_t longest;   /* Length of the longest line, without its newline. */
+    uint64_t open_ns;   /* Time spent opening the wordlist and savefiles. */
+    uint64_t scan_ns;   /* Time spent scanning, not counting writing. */
+    uint64_t write_ns;  /* Time spent writing the savefiles and stdout. */
+    const char* reader; /* How the wordlist was read, if it was read by an
+                         * asynchronous reader. */
+};
+
+/**
+ * These are the statistics of the serial scanners. Worker threads keep their
+ * own and they are added to these when the threads finish.
+ */
+static struct stats stats;
+
+/**
+ * This is the progress line, or NULL if it isn't shown.
+ */
+static struct progress* progress;
+
+/**
+ * This is the number of lines the serial scanners scan between adding to the
+ * progress line's counters.
+ */
+#define PROGRESS_LINES 4096
+
+/**
+ * This is the most ciphers that words can be summed with in one run.
+ */
+#define MAX_CIPHERS 16
+
+/**
+ * These are the target sums that words are checked against and the ciphers
+ * they are summed with, along with the savefile of each pair of cipher and
+ * target. The savefile of target t under cipher c has index c * n + t.
+ */
+struct targets {
+    long* sums;         /* The target sums, in ascending order. */
+    FILE** savefiles;   /* The savefile of each cipher and target sum. */
+    bufwriter** out;    /* The buffered writer of each savefile. */
+    bufwriter* echo;    /* The buffered writer of stdout, or NULL. */
+    bool to_stdout;     /* Whether every target is saved to stdout. */
+    size_t n;           /* Number of target sums. */
+    const struct cipher* ciphers[MAX_CIPHERS];  /* The ciphers. */
+    size_t nciphers;    /* Number of ciphers. */
+    bool ascii;         /* Whether the only cipher is ascii. */
+    bool codepoints;    /* Whether the only cipher is codepoints. */
+    size_t nout;        /* Number of savefiles, nciphers * n. */
+    struct sorter** sorters;    /* The sorter of each savefile, or NULL. */
+    int* index;         /* Index into sums of each sum from lo to hi, or -1. */
+    long lo;            /* The smallest target sum. */
+    long hi;            /* The largest target sum. */
+    bool range;         /* Whether every sum from lo to hi is a target. */
+    size_t minlen;      /* Length of the shortest word that is saved. */
+    size_t maxlen;      /* Length of the longest word that is saved. */
+    size_t nearest;     /* Number of words --nearest saves per target, or 0. */
+    struct nearest* near;   /* The nearest words to each target, or NULL. */
+};
+
+/**
+ * This is a word kept by --nearest, with its newline.
+ */
+struct nearword {
+    char* word;         /* The word. */
+    size_t len;         /* Length of the word. */
+    size_t cap;         /* Number of bytes allocated to word. */
+    unsigned long dist; /* Distance of the word's sum from the target. */
+    uint64_t seq;       /* Position of the word in the wordlist. */
+};
+
+/**
+ * These are the words kept by --nearest for one cipher and target. They are
+ * a heap with the farthest word (the latest of the farthest, if there is a
+ * tie) at the top, so a word that is nearer replaces it.
+ */
+struct nearest {
+    struct nearword* heap;  /* The words. */
+    size_t n;               /* Number of words kept. */
+    uint64_t seq;           /* Number of words offered. */
+};
 
 void print_help()
 {
-    printf( "This program searches a wordlist for words who's characters' decimal ascii values sum to 666 and saves them to a file.\n\n"
+    printf( "This program searches a wordlist for words who's characters' decimal ascii values sum to 666 (or other targets) and saves them to a file.\n\n"
             "USAGE:\n"
-            "./sums666 <wordlist> <savefile>\n");
+            "./sums666 [OPTIONS] <wordlist> <savefile>\n"
+            "    A <wordlist> of - reads the wordlist from stdin and a <savefile>\n"
+            "    of - saves the words to stdout. A <wordlist> compressed with gzip\n"
+            "    (or zstd, if it was built in) is decompressed as it is scanned.\n"
+            "    Every byte of a line is summed, so a null byte counts as 0 and\n"
+            "    doesn't end the word.\n"
+            "./sums666 index <wordlist> <index>\n"
+            "./sums666 query <index> <target>\n"
+            "./sums666 serve [-j N] <socket> <wordlist|index>...\n"
+            "./sums666 [OPTIONS] batch <directory|glob> <outdir>\n\n"
+            "COMMANDS:\n"
+            "  index     Sum every word in the wordlist once and save them to an\n"
+            "            index file, bucketed by their sums.\n"
+            "  query     Print the words in an index file that sum to <target>.\n"
+            "  serve     Load the wordlists and index files into memory and answer\n"
+            "            requests on the Unix domain socket <socket> with N worker\n"
+            "            threads (one per CPU by default), one per line:\n"
+            "              SUM <target> [cipher]\n"
+            "              RANGE <min> <max> [cipher]\n"
+            "              STATS, PING or QUIT\n"
+            "            Each reply is \"OK n\" and n lines of words, or \"ERR ...\".\n"
+            "            STATS replies with the latency percentiles of the requests\n"
+            "            answered so far, which are also printed when the daemon is\n"
+            "            stopped with SIGINT or SIGTERM.\n"
+            "  batch     Scan every wordlist in the directory (and the directories\n"
+            "            in it), or matched by the glob, and save each one's words to\n"
+            "            a savefile at the same path in <outdir>, with a line per\n"
+            "            wordlist in <outdir>/summary.tsv. Paths are relative to the\n"
+            "            directory, or to the glob's directory before its first\n"
+            "            wildcard, and a .gz wordlist's savefile has no .gz (e.g.\n"
+            "            'lists/*/*.gz' saves lists/a/b.txt.gz as <outdir>/a/b.txt).\n"
+            "            <outdir> isn't scanned, even if the glob matches it, and a\n"
+            "            wordlist whose savefile would be <outdir>/summary.tsv is\n"
+            "            skipped and listed in the summary as not scanned.\n"
+            "            Wordlists are shared out between the threads (one per CPU,\n"
+            "            or -j N), and large ones are split into chunks so they are\n"
+            "            scanned by every thread.\n"
+            "            The targets, ciphers, --min, --max, the length filters,\n"
+            "            --async-io, --progress and --stats can be used.\n\n"
+            "OPTIONS:\n"
+            "  --mmap    Map the wordlist into memory and scan it in place instead of\n"
+            "            reading it line by line. Falls back to reading line by line\n"
+            "            if the wordlist can't be mapped (e.g. it is a pipe).\n"
+            "  --simd    Map the wordlist into memory and sum many words at a time with\n"
+            "            the fastest vector kernel the CPU supports.\n"
+            "  --verify  Check the vector kernels against sums666() on every word in\n"
+            "            the wordlist instead of saving anything. <savefile> can be\n"
+            "            left out. sums666() stops at a null byte, so words with one\n"
+            "            are only checked against the scalar kernel.\n"
+            "  -j N      Scan the wordlist with N threads. The savefile is the same\n"
+            "            as the one a single thread makes. Implies --simd.\n"
+            "  --target N\n"
+            "            Search for words that sum to N instead of 666. Can be given\n"
+            "            more than once.\n"
+            "  --targets N,N,...\n"
+            "            Search for words that sum to any of the comma separated sums.\n"
+            "  --targets-file FILE\n"
+            "            Search for words that sum to any of the sums listed in FILE.\n"
+            "            With more than one target, each target's words are saved to\n"
+            "            its own file, named after <savefile> with the target added\n"
+            "            before the extension (e.g. out.txt -> out.616.txt).\n"
+            "  --min N, --max N\n"
+            "            Search for words whose sum is from N (--min) to N (--max),\n"
+            "            instead of the targets. Either can be left out. A word\n"
+            "            stops being summed once its sum is over --max and the rest\n"
+            "            of it can't bring the sum back down.\n"
+            "  --nearest K\n"
+            "            Save the K words whose sums are nearest each target, nearest\n"
+            "            first, instead of the words that sum to it. They are saved\n"
+            "            when the scan finishes. Scans with one thread.\n"
+            "  --min-length N, --max-length N\n"
+            "            Only save words of at least (or at most) N chars, without\n"
+            "            their newline. Other words aren't summed at all.\n"
+            "  --cipher NAME[,NAME...]\n"
+            "            Sum the chars of each word with the named ciphers instead of\n"
+            "            their decimal ascii values: ascii, ordinal (a=1 ... z=26),\n"
+            "            gematria (a=6 ... z=156), hebrew, greek (isopsephy of the\n"
+            "            UTF-8 letters) or codepoints. Every cipher is summed in the\n"
+            "            same pass. With more than one cipher, each cipher's words are\n"
+            "            saved to its own file with the cipher added before the\n"
+            "            extension (e.g. out.txt -> out.ordinal.txt or\n"
+            "            out.ordinal.616.txt).\n"
+            "  --codepoints\n"
+            "            Sum the Unicode code points of the UTF-8 chars of each word\n"
+            "            instead of their bytes. Lines that are pure ascii are summed\n"
+            "            by the vector kernels without being decoded. Bytes that\n"
+            "            aren't valid UTF-8 are summed as Latin-1 chars. The same as\n"
+            "            --cipher codepoints.\n"
+            "  --cipher-file FILE\n"
+            "            Sum with a cipher read from FILE, which holds the values of\n"
+            "            bytes 0 to 255 separated by whitespace or commas. The cipher\n"
+            "            is named after FILE.\n"
+            "  --stream  Read the wordlist through a fixed size buffer, using the same\n"
+            "            amount of memory no matter how long the wordlist or its lines\n"
+            "            are. Lines longer than the buffer are spilled to a temporary\n"
+            "            file. This is always used when <wordlist> is -, a pipe or\n"
+            "            compressed.\n"
+            "  --async-io[=uring|pread]\n"
+            "            Read the wordlist with many reads in flight at once, with\n"
+            "            io_uring (or one pread() at a time if io_uring isn't\n"
+            "            available, or =pread is given), and scan each block while\n"
+            "            the blocks after it are still being read, instead of\n"
+            "            reading it line by line. Scans with one thread. In batch\n"
+            "            mode, each wordlist is read into memory this way instead of\n"
+            "            being mapped.\n"
+            "  --pairs   Search for pairs of words whose combined sum is the target\n"
+            "            instead of single words. Each pair is saved on one line.\n"
+            "  --triples Search for phrases of three words instead of single words.\n"
+            "  --space   Count the space between the words of a pair or triple (32,\n"
+            "            or its value in the cipher) towards its sum.\n"
+            "  --max-results N\n"
+            "            Stop after N pairs or triples have been found for each target.\n"
+            "            -j N searches with N threads.\n"
+            "  --substrings\n"
+            "            Treat the wordlist as running text (e.g. a book or a log file)\n"
+            "            and save every substring of it that sums to the target, after\n"
+            "            its byte offset and a tab. Substrings don't span lines, hold\n"
+            "            bytes with negative values (bytes over 127 in ascii) or start\n"
+            "            or end with bytes worth nothing. -j N searches with N threads.\n"
+            "            Only ciphers of byte values can be used.\n"
+            "  --whole-words\n"
+            "            Like --substrings, but only save substrings that start at the\n"
+            "            start of a word and end at the end of one.\n"
+            "  --phrases Treat the wordlist as running text and save every phrase of\n"
+            "            consecutive words in it that sums to the target, after the\n"
+            "            byte offset of its first word and a tab, with its words\n"
+            "            separated by spaces. Words are runs of letters, digits,\n"
+            "            underscores and UTF-8 chars. -j N searches with N threads.\n"
+            "  --max-words N\n"
+            "            Save phrases of at most N words (8 by default). Implies\n"
+            "            --phrases.\n"
+            "  --separators none|space|text\n"
+            "            How the separators between the words of a phrase count\n"
+            "            towards its sum: not at all (the default), as a single space\n"
+            "            each (the same as --space) or as the chars they are made of.\n"
+            "  --incremental\n"
+            "            Only scan the words that were appended to the wordlist since\n"
+            "            the last --incremental run and add the ones that are found to\n"
+            "            the end of the savefiles. Where the last run stopped is kept\n"
+            "            in <savefile>.ckpt. The whole wordlist is scanned again if it\n"
+            "            was replaced or rewritten, or the targets or ciphers changed.\n"
+            "            A last line without a newline is left for the next run.\n"
+            "  --sort    Save the words in each savefile in byte order (like\n"
+            "            LC_ALL=C sort) instead of the order they were found in.\n"
+            "            Echoed words are still printed as they are found.\n"
+            "  --unique  Sort the savefiles and save each word only once (like\n"
+            "            LC_ALL=C sort -u).\n"
+            "  --sort-memory MB\n"
+            "            Hold at most MB megabytes of words in memory (256 by default)\n"
+            "            while sorting. Beyond that, sorted runs of words are spilled\n"
+            "            to temporary files and merged when the scan finishes.\n"
+            "  --progress\n"
+            "            Show the percentage of the wordlist scanned, the throughput,\n"
+            "            the matches so far and the time left on stderr while the\n"
+            "            wordlist is scanned.\n"
+            "  --stats   Print statistics about the run on stderr when it finishes.\n"
+            "  -q, --quiet\n"
+            "            Don't print the words that are found on stdout.\n");
     exit(EXIT_FAILURE);
 }
 
-bool sums666(char* word)
+/**
+ * This function returns the sum of the decimal ascii values of the chars in
+ * the word provided to it, which ends at a null character or a newline.
+ */
+int sumword(char* word)
 {
     int wordlen = 0;
     int sum = 0;
@@ -23,40 +330,2878 @@ bool sums666(char* word)
         wordlen++;
     }
 
-    if (sum == 666)
+    return sum;
+}
+
+/**
+ * This function returns true if the chars of the word provided to it sum to
+ * 666. It is the reference that the faster scanners are checked against.
+ */
+bool sums666(char* word)
+{
+    if (sumword(word) == 666)
         return true;
 
     return false;
 }
 
-int main(int argc, char* argv[])
+/**
+ * This function returns the sum of the decimal ascii values of the len chars
+ * starting at word. Unlike sums666() the word doesn't have to be terminated,
+ * so it can be used on words that are still inside a larger buffer.
+ */
+long sumspan(const char* word, size_t len)
+{
+    const char* end = word + len;
+    long sum = 0;
+
+    while (word < end)
+        sum += (int) *word++;
+
+    return sum;
+}
+
+/**
+ * This function returns the index of the target that the sum provided to it
+ * is equal to, or -1 if it isn't equal to any of the targets.
+ */
+static inline int find_target(const struct targets* t, long sum)
+{
+    size_t lo;  /* Lowest index that might hold the sum. */
+    size_t hi;  /* One past the highest index that might hold the sum. */
+    size_t mid; /* The index being checked. */
+
+    if (sum < t->lo || sum > t->hi)
+        return -1;
+
+    if (t->range)
+        return 0;
+
+    if (t->index != NULL)
+        return t->index[sum - t->lo];
+
+    /* The targets are too far apart for a table so they are searched. */
+    lo = 0;
+    hi = t->n;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (t->sums[mid] == sum)
+            return mid;
+        if (t->sums[mid] < sum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+/**
+ * This function returns true if a word of len chars is long enough and short
+ * enough to be saved.
+ */
+static inline bool fits_length(const struct targets* t, size_t len)
+{
+    return len >= t->minlen && len <= t->maxlen;
+}
+
+/**
+ * This function returns the index of the target that a word of len chars
+ * with the sum provided to it is saved for, or -1 if it isn't saved because
+ * of its sum or its length.
+ */
+static inline int match_word(const struct targets* t, long sum, size_t len)
+{
+    return fits_length(t, len) ? find_target(t, sum) : -1;
+}
+
+/**
+ * This function returns the ascii sum of the len chars starting at word, or
+ * a partial sum that is greater than every target once the rest of the word
+ * can't bring the sum back down to one (see cipher_sum_max()). This saves
+ * summing most of a long line that can't match.
+ */
+static inline long sum_bounded(const struct targets* t, const char* word,
+                                                        size_t len)
+{
+    return cipher_sum_max(ascii_cipher(), word, len, t->hi);
+}
+
+/**
+ * This function adds the target sum provided to it to the targets, unless it
+ * is already one of them.
+ */
+void add_target(struct targets* t, long sum)
+{
+    size_t i;
+
+    for (i = 0; i < t->n; i++)
+    {
+        if (t->sums[i] == sum)
+            return;
+    }
+
+    if ((t->sums = realloc(t->sums, sizeof(long) * (t->n + 1))) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function add_target(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    t->sums[t->n++] = sum;
+}
+
+/**
+ * This function adds each of the target sums in the string provided to it to
+ * the targets. The sums can be separated by commas or whitespace. If the
+ * string holds anything that isn't a sum, the help is printed.
+ */
+void parse_targets(struct targets* t, const char* str)
+{
+    char* end;  /* End of the sum that was parsed. */
+    long sum;   /* The sum that was parsed. */
+
+    while (*str != '\0')
+    {
+        /* Skipping separators. */
+        if (*str == ',' || isspace((unsigned char) *str))
+        {
+            str++;
+            continue;
+        }
+
+        sum = strtol(str, &end, 10);
+        if (end == str)
+            print_help();
+
+        add_target(t, sum);
+        str = end;
+    }
+}
+
+/**
+ * This function adds each of the target sums listed in the file with the name
+ * provided to it to the targets.
+ */
+void read_targets(struct targets* t, char* fname)
+{
+    FILE* fs;   /* The targets file. */
+    char* line; /* The current line of the file. */
+
+    fs = openfs(fname, "r");
+
+    while (readfsl(fs, &line))
+    {
+        parse_targets(t, line);
+        free(line);
+    }
+
+    closefs(fs);
+}
+
+/**
+ * This function adds the cipher provided to it to the ciphers that words are
+ * summed with, unless it is already one of them.
+ */
+void add_cipher(struct targets* t, const struct cipher* c)
+{
+    size_t i;
+
+    for (i = 0; i < t->nciphers; i++)
+    {
+        if (t->ciphers[i] == c || strcmp(t->ciphers[i]->name, c->name) == 0)
+            return;
+    }
+
+    if (t->nciphers == MAX_CIPHERS)
+    {
+        fprintf(stderr, "ERROR: At most %d ciphers can be used.\n", MAX_CIPHERS);
+        exit(EXIT_FAILURE);
+    }
+    t->ciphers[t->nciphers++] = c;
+}
+
+/**
+ * This function adds each of the built-in ciphers named in the comma separated
+ * list provided to it to the ciphers. If a name isn't a built-in cipher, the
+ * help is printed.
+ */
+void parse_ciphers(struct targets* t, char* names)
+{
+    const struct cipher* c;
+    char* name;
+
+    for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        if ((c = find_cipher(name)) == NULL)
+        {
+            fprintf(stderr, "ERROR: There is no cipher named %s.\n", name);
+            print_help();
+        }
+        add_cipher(t, c);
+    }
+}
+
+/**
+ * This function compares two target sums for qsort().
+ */
+int compare_sums(const void* a, const void* b)
+{
+    long x = *(const long*) a;
+    long y = *(const long*) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * This function makes every sum from min to max a target, instead of the
+ * targets that were given. The words that sum to any of them are saved to
+ * one savefile for each cipher.
+ */
+void set_range(struct targets* t, long min, long max)
+{
+    if (t->n > 0)
+    {
+        fprintf(stderr, "ERROR: --min and --max can't be used with "
+                        "--target, --targets or --targets-file.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (min > max)
+    {
+        fprintf(stderr, "ERROR: --min is greater than --max.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    add_target(t, min);
+    t->range = true;
+    t->lo = min;
+    t->hi = max;
+}
+
+/**
+ * This function adds the defaults (666 and the ascii cipher) to the targets
+ * if none were given, sorts them and builds the table that find_target()
+ * uses. It must be called before the targets are opened.
+ */
+void sort_targets(struct targets* t)
+{
+    size_t i;   /* Index of the current target. */
+    long s;     /* The current sum in the table. */
+
+    /* Searching for 666 with the ascii cipher if nothing else was given. */
+    if (t->n == 0)
+        add_target(t, 666);
+    if (t->nciphers == 0)
+        add_cipher(t, ascii_cipher());
+    t->ascii = t->nciphers == 1 && t->ciphers[0] == ascii_cipher();
+    t->codepoints = t->nciphers == 1 && t->ciphers[0] == codepoint_cipher();
+    t->nout = t->nciphers * t->n;
+
+    /* A range's bounds were set by set_range() and it needs no table. */
+    t->index = NULL;
+    if (t->range)
+        return;
+
+    qsort(t->sums, t->n, sizeof(long), compare_sums);
+    t->lo = t->sums[0];
+    t->hi = t->sums[t->n - 1];
+
+    /* Building the lookup table if the targets are close enough. */
+    if ((unsigned long) (t->hi - t->lo) < TARGET_TABLE_MAX)
+    {
+        t->index = malloc(sizeof(int) * (t->hi - t->lo + 1));
+        if (t->index == NULL)
+        {
+            fprintf(stderr, "ERROR: In function sort_targets(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (s = t->lo; s <= t->hi; s++)
+            t->index[s - t->lo] = -1;
+        for (i = 0; i < t->n; i++)
+            t->index[t->sums[i] - t->lo] = i;
+    }
+}
+
+/**
+ * This function returns the name of the savefile with index i. With one
+ * cipher and one target it is savefile. Otherwise it is savefile with the
+ * cipher (if there is more than one) and the target (if there is more than
+ * one) added before its extension. Make sure to free() the name when you're
+ * finished with it.
+ */
+char* savefile_name(const struct targets* t, const char* savefile, size_t i)
+{
+    const char* base;   /* The file name part of savefile. */
+    const char* ext;    /* The extension of savefile, or its end. */
+    const char* cname;  /* The cipher part of the name. */
+    char sname[32];     /* The target part of the name. */
+    char* fname;        /* The name of the savefile. */
+
+    if (t->nout == 1)
+    {
+        strfmt(&fname, "%s", savefile);
+        return fname;
+    }
+
+    base = (base = strrchr(savefile, '/')) != NULL ? base + 1 : savefile;
+    if ((ext = strrchr(base, '.')) == NULL || ext == base)
+        ext = base + strlen(base);
+
+    cname = t->nciphers > 1 ? t->ciphers[i / t->n]->name : NULL;
+    sname[0] = '\0';
+    if (t->n > 1)
+        snprintf(sname, sizeof(sname), ".%ld", t->sums[i % t->n]);
+
+    strfmt(&fname, "%.*s%s%s%s%s", (int) (ext - savefile), savefile,
+            cname != NULL ? "." : "", cname != NULL ? cname : "", sname, ext);
+
+    return fname;
+}
+
+/**
+ * This function opens the savefile of each cipher and target, which are
+ * named by savefile_name(). If append is true the words are added to the end
+ * of the savefiles instead of replacing them. If savefile is -, every target
+ * is saved to stdout. Found words are echoed on stdout unless quiet is true
+ * or they are already being saved there.
+ */
+void open_targets(struct targets* t, char* savefile, bool quiet, bool append)
+{
+    char* fname;        /* Name of the current savefile. */
+    size_t i;           /* Index of the current savefile. */
+
+    t->savefiles = malloc(sizeof(FILE*) * t->nout);
+    t->out = malloc(sizeof(bufwriter*) * t->nout);
+    if (t->savefiles == NULL || t->out == NULL)
+    {
+        fprintf(stderr, "ERROR: In function open_targets(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Saving every target to stdout. */
+    t->to_stdout = strcmp(savefile, "-") == 0;
+    if (t->to_stdout)
+    {
+        fflush(stdout);
+        t->out[0] = openbw(STDOUT_FILENO, OUTBUF_SIZE);
+        for (i = 0; i < t->nout; i++)
+        {
+            t->savefiles[i] = stdout;
+            t->out[i] = t->out[0];
+        }
+        t->echo = NULL;
+        return;
+    }
+
+    for (i = 0; i < t->nout; i++)
+    {
+        fname = savefile_name(t, savefile, i);
+        t->savefiles[i] = openfs(fname, append ? "a" : "w");
+        t->out[i] = openbw(fileno(t->savefiles[i]), OUTBUF_SIZE);
+        free(fname);
+    }
+
+    /* Anything already printed must come out before the echoed words. */
+    fflush(stdout);
+    t->echo = quiet ? NULL : openbw(STDOUT_FILENO, OUTBUF_SIZE);
+}
+
+/**
+ * This function makes the savefiles be sorted, by giving each of them a
+ * sorter. The words held in memory by all of the sorters are limited to
+ * budget bytes. If unique is true, each word is only saved once.
+ */
+void sort_savefiles(struct targets* t, bool unique, size_t budget)
+{
+    size_t i;
+
+    if ((t->sorters = malloc(sizeof(struct sorter*) * t->nout)) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function sort_savefiles(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < t->nout; i++)
+        t->sorters[i] = open_sorter(budget / t->nout, unique);
+}
+
+/**
+ * This function saves a word to the savefile with index i, or to its sorter
+ * if it is sorted, and echoes it on stdout.
+ */
+static inline void save_word(const struct targets* t, int i,
+                             const char* word, size_t len)
+{
+    if (t->sorters != NULL)
+        add_sorted(t->sorters[i], word, len);
+    else
+        writebw(t->out[i], word, len);
+
+    if (t->echo != NULL)
+        writebw(t->echo, word, len);
+}
+
+/**
+ * This function makes the targets keep the targets->nearest words nearest to
+ * each target under each cipher instead of saving the words that sum to them.
+ */
+void open_nearest(struct targets* t)
+{
+    size_t i;
+
+    if ((t->near = calloc(t->nout, sizeof(struct nearest))) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function open_nearest(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < t->nout; i++)
+    {
+        t->near[i].heap = calloc(t->nearest, sizeof(struct nearword));
+        if (t->near[i].heap == NULL)
+        {
+            fprintf(stderr, "ERROR: In function open_nearest(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * This function returns true if word a is nearer its target than word b, or
+ * as near and earlier in the wordlist.
+ */
+static inline bool is_nearer(const struct nearword* a, const struct nearword* b)
+{
+    return a->dist < b->dist || (a->dist == b->dist && a->seq < b->seq);
+}
+
+/**
+ * This function compares two kept words for qsort(), nearest first.
+ */
+int compare_nearwords(const void* a, const void* b)
+{
+    return is_nearer(a, b) ? -1 : is_nearer(b, a) ? 1 : 0;
+}
+
+/**
+ * This function offers a word of len chars, whose sum is dist from the
+ * target, to the words kept for the target. It is kept if fewer than k words
+ * are kept or it is nearer than the farthest of them, which it replaces. The
+ * word is copied, with a newline, into the memory of the word it replaces,
+ * so the memory used never grows past k words.
+ */
+static void offer_nearest(struct nearest* nr, size_t k, const char* word,
+                                            size_t len, unsigned long dist)
+{
+    struct nearword* h = nr->heap;
+    struct nearword w;  /* The word being placed. */
+    size_t i;           /* Index of the word in the heap. */
+    size_t c;           /* Index of a child or the parent of i. */
+    uint64_t seq;       /* Position of the word in the wordlist. */
+
+    seq = nr->seq++;
+
+    /* A word that is as far away as the farthest word is later, so it is
+     * farther. */
+    if (nr->n == k && dist >= h[0].dist)
+        return;
+
+    /* Reusing the memory of the word that is replaced. */
+    i = nr->n < k ? nr->n++ : 0;
+    w = h[i];
+    if (len + 1 > w.cap)
+    {
+        w.cap = (len + 1) * 2;
+        if ((w.word = realloc(w.word, w.cap)) == NULL)
+        {
+            fprintf(stderr, "ERROR: In function offer_nearest(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(w.word, word, len);
+    w.word[len] = '\n';
+    w.len = len + 1;
+    w.dist = dist;
+    w.seq = seq;
+
+    if (i > 0 || nr->n == 1)
+    {
+        /* Moving a new word up past the words nearer than it. */
+        for (; i > 0 && is_nearer(&h[(c = (i - 1) / 2)], &w); i = c)
+            h[i] = h[c];
+    }
+    else
+    {
+        /* Moving the replacement down past the words farther than it. */
+        while ((c = 2 * i + 1) < nr->n)
+        {
+            if (c + 1 < nr->n && is_nearer(&h[c], &h[c + 1]))
+                c++;
+            if (!is_nearer(&w, &h[c]))
+                break;
+            h[i] = h[c];
+            i = c;
+        }
+    }
+    h[i] = w;
+}
+
+/**
+ * This function offers a word to the words kept for each target under the
+ * cipher with index c.
+ */
+static inline void offer_word(const struct targets* t, size_t c,
+                              const char* word, size_t len, long sum)
+{
+    unsigned long dist; /* Distance of the sum from a target. */
+    size_t i;
+
+    for (i = 0; i < t->n; i++)
+    {
+        dist = sum >= t->sums[i] ? (unsigned long) sum - t->sums[i]
+                                 : (unsigned long) t->sums[i] - sum;
+        offer_nearest(&t->near[c * t->n + i], t->nearest, word, len, dist);
+    }
+}
+
+/**
+ * This function saves the words kept for each target, nearest first, and
+ * frees them.
+ */
+void close_nearest(struct targets* t)
+{
+    struct nearest* nr;
+    size_t i, j;
+
+    for (i = 0; i < t->nout; i++)
+    {
+        nr = &t->near[i];
+        qsort(nr->heap, nr->n, sizeof(struct nearword), compare_nearwords);
+        for (j = 0; j < nr->n; j++)
+            save_word(t, i, nr->heap[j].word, nr->heap[j].len);
+        stats.matches += nr->n;
+
+        for (j = 0; j < t->nearest; j++)
+            free(nr->heap[j].word);
+        free(nr->heap);
+    }
+
+    free(t->near);
+    t->near = NULL;
+}
+
+/**
+ * This function flushes and closes the savefiles and frees the targets. The
+ * time spent writing to the savefiles and stdout is added to the stats.
+ */
+void close_targets(struct targets* t)
+{
+    size_t i;
+
+    /* The nearest words are only known once the whole wordlist is read. */
+    if (t->near != NULL)
+        close_nearest(t);
+
+    /* Sorted savefiles are only written now that every word is known. */
+    for (i = 0; i < t->nout && t->sorters != NULL; i++)
+        close_sorter(t->sorters[i], t->out[i]);
+
+    for (i = 0; i < t->nout && !t->to_stdout; i++)
+    {
+        flushbw(t->out[i]);
+        stats.write_ns += t->out[i]->write_ns;
+        closebw(t->out[i]);
+        closefs(t->savefiles[i]);
+    }
+
+    /* The targets share one writer when they are saved to stdout. */
+    if (t->to_stdout)
+    {
+        flushbw(t->out[0]);
+        stats.write_ns += t->out[0]->write_ns;
+        closebw(t->out[0]);
+    }
+
+    if (t->echo != NULL)
+    {
+        flushbw(t->echo);
+        stats.write_ns += t->echo->write_ns;
+        closebw(t->echo);
+    }
+
+    free(t->sorters);
+    free(t->out);
+    free(t->savefiles);
+    free(t->index);
+    free(t->sums);
+}
+
+/**
+ * This function adds a line of len bytes to the stats provided to it. nl is
+ * whether the line ends with a newline.
+ */
+static inline void count_line(struct stats* st, size_t len, bool nl)
+{
+    st->bytes += len;
+    st->lines++;
+
+    if (nl)
+        len--;
+    if (len > st->longest)
+        st->longest = len;
+}
+
+/**
+ * This function adds the bytes and matches that were added to the stats st
+ * since last to the progress line, if it is shown, and makes last a copy of
+ * st. Unless force is true this is only done once every PROGRESS_LINES lines,
+ * so it can be called for every line.
+ */
+static inline void tick_progress(const struct stats* st, struct stats* last,
+                                                            bool force)
+{
+    if (progress == NULL || (!force && st->lines - last->lines < PROGRESS_LINES))
+        return;
+
+    add_progress(progress, st->bytes - last->bytes,
+                 st->matches - last->matches);
+    *last = *st;
+}
+
+/**
+ * This function adds the counts of the stats in from to the stats in to.
+ */
+void add_stats(struct stats* to, const struct stats* from)
+{
+    to->bytes += from->bytes;
+    to->lines += from->lines;
+    to->matches += from->matches;
+    if (from->longest > to->longest)
+        to->longest = from->longest;
+}
+
+/**
+ * This function prints the stats provided to it on stderr.
+ */
+void print_stats(const struct stats* st)
+{
+    double open = (double) st->open_ns / NANOS_PER_SEC;
+    double scan = (double) st->scan_ns / NANOS_PER_SEC;
+    double write = (double) st->write_ns / NANOS_PER_SEC;
+    double total = open + scan + write;
+
+    fprintf(stderr,
+            "Bytes read:    %llu\n"
+            "Lines scanned: %llu\n"
+            "Matches:       %llu\n"
+            "Longest line:  %llu\n"
+            "Open:          %.6f s\n"
+            "Scan:          %.6f s\n"
+            "Write:         %.6f s\n"
+            "Total:         %.6f s\n"
+            "Throughput:    %.2f MB/s, %.0f lines/s\n",
+            (unsigned long long) st->bytes, (unsigned long long) st->lines,
+            (unsigned long long) st->matches, (unsigned long long) st->longest,
+            open, scan, write, total,
+            total > 0 ? st->bytes / total / (1 << 20) : 0.0,
+            total > 0 ? st->lines / total : 0.0);
+
+    if (st->reader != NULL)
+        fprintf(stderr, "Read with:     %s\n", st->reader);
+}
+
+/**
+ * This function reads the wordlist one line at a time with readfsln() and
+ * saves the words that sum to one of the targets.
+ */
+void scan_lines(FILE* wordlist, struct targets* targets)
 {
-    FILE* wordlist;
-    FILE* savefile;
     char* line;
+    size_t linelen;
+    size_t wordlen;
     bool freed;
-    
-    if (argc < 3 || argc > 3)
-        print_help();
+    int t;
+    struct stats last;  /* The stats when the progress line was added to. */
 
-    wordlist = openfs(argv[1], "r");
-    savefile = openfs(argv[2], "w");
     freed = true; // Prevent free() error if wordlist is an empty file.
+    last = stats;
 
-    while (readfsl(wordlist, &line))
+    while (readfsln(wordlist, &line, &linelen))
     {
         freed = false;
-        if (sums666(line))
+        wordlen = linelen - (line[linelen - 1] == '\n');
+        if (fits_length(targets, wordlen)
+            && (t = find_target(targets, sum_bounded(targets, line, wordlen)))
+                                                                    != -1)
         {
-           writefss(savefile, line);
-           printf("%s", line);
+           save_word(targets, t, line, linelen);
+           stats.matches++;
         }
+        count_line(&stats, linelen, line[linelen - 1] == '\n');
+        tick_progress(&stats, &last, false);
         free(line);
         freed = true;
     }
+    tick_progress(&stats, &last, true);
 
     if (!freed)
         free(line);
+}
+
+/**
+ * This function maps the wordlist into memory and walks its newlines in place,
+ * saving the words that sum to one of the targets. No memory is allocated per
+ * line. If the wordlist can't be mapped it falls back to scan_lines().
+ */
+void scan_mmap(FILE* wordlist, struct targets* targets)
+{
+    char* map;          /* The mapped wordlist. */
+    size_t len;         /* Length of the mapped wordlist. */
+    const char* line;   /* Start of the current line. */
+    const char* nl;     /* The newline that ends the current line. */
+    const char* end;    /* End of the mapped wordlist. */
+    size_t wordlen;     /* Length of the current line without its newline. */
+    size_t linelen;     /* Length of the current line with its newline. */
+    int t;              /* Index of the target the line sums to. */
+    struct stats last;  /* The stats when the progress line was added to. */
+
+    if ((map = mapfs(wordlist, &len)) == NULL)
+    {
+        scan_lines(wordlist, targets);
+        return;
+    }
+
+    last = stats;
+    end = map + len;
+    for (line = map; line < end; line += linelen)
+    {
+        /* Finding the end of the line. The last line might not have a
+         * newline. */
+        if ((nl = memchr(line, '\n', end - line)) != NULL)
+        {
+            wordlen = nl - line;
+            linelen = wordlen + 1;
+        }
+        else
+        {
+            wordlen = end - line;
+            linelen = wordlen;
+        }
+
+        if (fits_length(targets, wordlen)
+            && (t = find_target(targets, sum_bounded(targets, line, wordlen)))
+                                                                    != -1)
+        {
+            save_word(targets, t, line, linelen);
+            stats.matches++;
+        }
+        count_line(&stats, linelen, linelen != wordlen);
+        tick_progress(&stats, &last, false);
+    }
+    tick_progress(&stats, &last, true);
+
+    unmapfs(map, len);
+}
+
+/**
+ * This is the type of the functions that the scanners call to save a word
+ * that sums to the target with index t. The word includes its newline, if it
+ * has one.
+ */
+typedef void (*save_fn)(const char* word, size_t len, int t, void* arg);
+
+/**
+ * This is a growable buffer that a worker thread saves its words to, so they
+ * can be written out in order once every worker has finished.
+ */
+struct matchbuf {
+    char* buf;      /* The saved words. */
+    size_t len;     /* Number of bytes saved. */
+    size_t cap;     /* Number of bytes allocated. */
+};
+
+/**
+ * This is one of the chunks that a wordlist is split into for the worker
+ * threads. Chunks start at the beginning of a word and end after a newline
+ * (or at the end of the wordlist).
+ */
+struct chunk {
+    const char* buf;        /* Start of the chunk. */
+    size_t len;             /* Length of the chunk. */
+    struct matchbuf* out;   /* Words in the chunk that sum to each target. */
+    struct stats stats;     /* Statistics of the chunk. */
+};
+
+/**
+ * This is the work shared by the worker threads.
+ */
+struct workqueue {
+    struct chunk* chunks;   /* The chunks of the wordlist. */
+    size_t nchunks;         /* Number of chunks. */
+    atomic_size_t next;     /* Index of the next chunk to be scanned. */
+    struct targets* targets;    /* The targets to search for. */
+};
+
+/**
+ * This function saves a word to its target's savefile and echoes it on
+ * stdout.
+ */
+void save_to_files(const char* word, size_t len, int t, void* targets)
+{
+    save_word(targets, t, word, len);
+}
+
+/**
+ * This function saves a word to the end of its target's struct matchbuf in
+ * the array of them provided to it.
+ */
+void save_to_matchbuf(const char* word, size_t len, int t, void* arg)
+{
+    struct matchbuf* mb = (struct matchbuf*) arg + t;
+
+    if (mb->len + len > mb->cap)
+    {
+        mb->cap = mb->cap * 2 > mb->len + len ? mb->cap * 2 : mb->len + len;
+        if ((mb->buf = realloc(mb->buf, mb->cap)) == NULL)
+        {
+            fprintf(stderr, "ERROR: In function save_to_matchbuf(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(mb->buf + mb->len, word, len);
+    mb->len += len;
+}
+
+/**
+ * This function is scan_buffer() for words that are summed with ciphers. Each
+ * word is read once however many ciphers there are, and it is saved once for
+ * each cipher it sums to a target under.
+ */
+static size_t scan_buffer_ciphers(const char* buf, size_t len, bool final,
+                                  const struct targets* targets, save_fn save,
+                                  void* arg, struct stats* st)
+{
+    long sums[MAX_CIPHERS];     /* Sum of the current word in each cipher. */
+    const char* end = buf + len;
+    const char* line;   /* Start of the current line. */
+    const char* nl;     /* The newline that ends the current line. */
+    size_t wordlen;     /* Length of the current line without its newline. */
+    size_t linelen;     /* Length of the current line with its newline. */
+    size_t c;           /* Index of the current cipher. */
+    int t;              /* Index of the target the word sums to. */
+    struct stats last;  /* The stats when the progress line was added to. */
+
+    last = *st;
+    for (line = buf; line < end; line += linelen)
+    {
+        if ((nl = memchr(line, '\n', end - line)) != NULL)
+        {
+            wordlen = nl - line;
+            linelen = wordlen + 1;
+        }
+        else if (final)
+        {
+            wordlen = end - line;
+            linelen = wordlen;
+        }
+        else
+        {
+            break;
+        }
+
+        /* Words that are too long or too short aren't summed at all. */
+        if (!fits_length(targets, wordlen))
+        {
+            count_line(st, linelen, linelen != wordlen);
+            continue;
+        }
+
+        if (targets->nciphers == 1)
+            sums[0] = cipher_sum_max(targets->ciphers[0], line, wordlen,
+                                     targets->hi);
+        else
+            cipher_sums(targets->ciphers, targets->nciphers, line, wordlen,
+                        sums);
+        for (c = 0; c < targets->nciphers; c++)
+        {
+            if ((t = find_target(targets, sums[c])) != -1)
+            {
+                save(line, linelen, c * targets->n + t, arg);
+                st->matches++;
+            }
+        }
+        count_line(st, linelen, linelen != wordlen);
+        tick_progress(st, &last, false);
+    }
+    tick_progress(st, &last, true);
+
+    return line - buf;
+}
+
+/**
+ * This function is scan_buffer() for --nearest. Every word that fits the
+ * length filters is offered to the words kept for each target, and nothing
+ * is saved until the targets are closed. Words summed with the ascii or
+ * codepoints cipher alone are summed by the vector kernels.
+ */
+static size_t scan_buffer_nearest(const char* buf, size_t len, bool final,
+                                  const struct targets* targets,
+                                  struct stats* st)
+{
+    struct linesum ls[LINESUM_BATCH];   /* Sums of the current batch. */
+    long sums[MAX_CIPHERS];     /* Sum of the current word in each cipher. */
+    const char* end = buf + len;
+    const char* line;   /* Start of the current line. */
+    const char* nl;     /* The newline that ends the current line. */
+    size_t wordlen;     /* Length of the current line without its newline. */
+    size_t linelen;     /* Length of the current line with its newline. */
+    size_t pos;         /* Offset of the current batch. */
+    size_t used;        /* Bytes consumed by the current batch. */
+    size_t n;           /* Number of words in the current batch. */
+    size_t i;           /* Index of the current word or cipher. */
+    struct stats last;  /* The stats when the progress line was added to. */
+
+    pos = 0;
+    if (targets->ascii || targets->codepoints)
+    {
+        while ((n = targets->codepoints
+                    ? codepoint_sums(buf + pos, len - pos, ls, LINESUM_BATCH, &used)
+                    : linesums(buf + pos, len - pos, ls, LINESUM_BATCH, &used)))
+        {
+            for (i = 0; i < n; i++)
+            {
+                if (fits_length(targets, ls[i].len))
+                    offer_word(targets, 0, buf + pos + ls[i].off, ls[i].len,
+                               ls[i].sum);
+                if (ls[i].len > st->longest)
+                    st->longest = ls[i].len;
+            }
+            st->lines += n;
+            st->bytes += used;
+            pos += used;
+
+            if (progress != NULL)
+                add_progress(progress, used, 0);
+        }
+    }
+
+    /* The rest of the words are summed one at a time. */
+    last = *st;
+    for (line = buf + pos; line < end; line += linelen)
+    {
+        if ((nl = memchr(line, '\n', end - line)) != NULL)
+        {
+            wordlen = nl - line;
+            linelen = wordlen + 1;
+        }
+        else if (final)
+        {
+            wordlen = end - line;
+            linelen = wordlen;
+        }
+        else
+        {
+            break;
+        }
+
+        if (fits_length(targets, wordlen))
+        {
+            cipher_sums(targets->ciphers, targets->nciphers, line, wordlen,
+                        sums);
+            for (i = 0; i < targets->nciphers; i++)
+                offer_word(targets, i, line, wordlen, sums[i]);
+        }
+        count_line(st, linelen, linelen != wordlen);
+        tick_progress(st, &last, false);
+    }
+    tick_progress(st, &last, true);
+
+    return line - buf;
+}
+
+/**
+ * This function sums every word in the buffer provided to it with the vector
+ * kernel and calls save for each word that sums to one of the targets. If
+ * final is true, the chars after the last newline are a word too. Otherwise
+ * they are left for the caller to scan once the rest of their word has been
+ * read. It returns the number of bytes of the buffer that were scanned, which
+ * are added to the stats provided to it. Words that are summed with the
+ * codepoints cipher alone are summed by codepoint_sums(), and words that are
+ * summed with other ciphers are scanned by scan_buffer_ciphers() instead.
+ */
+size_t scan_buffer(const char* buf, size_t len, bool final,
+                   const struct targets* targets, save_fn save, void* arg,
+                   struct stats* st)
+{
+    struct linesum sums[LINESUM_BATCH]; /* Sums of the current batch. */
+    size_t pos;         /* Offset of the current batch. */
+    size_t used;        /* Bytes consumed by the current batch. */
+    size_t n;           /* Number of words in the current batch. */
+    size_t i;           /* Index of the current word in the batch. */
+    long sum;           /* Sum of the last word. */
+    int t;              /* Index of the target the word sums to. */
+    uint64_t matches;   /* Matches before the current batch. */
+
+    if (targets->near != NULL)
+        return scan_buffer_nearest(buf, len, final, targets, st);
+    if (!targets->ascii && !targets->codepoints)
+        return scan_buffer_ciphers(buf, len, final, targets, save, arg, st);
+
+    pos = 0;
+    while ((n = targets->codepoints
+                ? codepoint_sums(buf + pos, len - pos, sums, LINESUM_BATCH, &used)
+                : linesums(buf + pos, len - pos, sums, LINESUM_BATCH, &used)))
+    {
+        matches = st->matches;
+        for (i = 0; i < n; i++)
+        {
+            if ((t = match_word(targets, sums[i].sum, sums[i].len)) != -1)
+            {
+                save(buf + pos + sums[i].off, sums[i].len + 1, t, arg);
+                st->matches++;
+            }
+            if (sums[i].len > st->longest)
+                st->longest = sums[i].len;
+        }
+        st->lines += n;
+        pos += used;
+
+        if (progress != NULL)
+            add_progress(progress, used, st->matches - matches);
+    }
+
+    if (!final || pos == len)
+    {
+        st->bytes += pos;
+        return pos;
+    }
+
+    /* The kernel leaves the last word if it doesn't end with a newline. */
+    sum = targets->ascii ? sumspan(buf + pos, len - pos)
+                         : cipher_sum(targets->ciphers[0], buf + pos, len - pos);
+    if ((t = match_word(targets, sum, len - pos)) != -1)
+    {
+        save(buf + pos, len - pos, t, arg);
+        st->matches++;
+    }
+    st->bytes += pos;
+    count_line(st, len - pos, false);
+
+    if (progress != NULL)
+        add_progress(progress, len - pos, t != -1);
+
+    return len;
+}
+
+/**
+ * This function adds len bytes of a line that is too long for the stream
+ * buffer to the temporary file it is spilled to, opening the file for the
+ * line's first bytes.
+ */
+static void spill_line(FILE** spill, const char* buf, size_t len)
+{
+    if ((*spill == NULL && (*spill = tmpfile()) == NULL)
+        || fwrite(buf, sizeof(char), len, *spill) != len)
+    {
+        fprintf(stderr, "ERROR: In function spill_line(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * This function scans a line that was spilled to a temporary file like any
+ * other line, saving it if it sums to one of the targets, and closes the
+ * file.
+ */
+static void scan_spilled(FILE** spill, struct targets* targets)
+{
+    char* map;      /* The mapped line. */
+    size_t len;     /* Length of the line, with its newline if it has one. */
+
+    if (fflush(*spill) != 0)
+    {
+        fprintf(stderr, "ERROR: In function scan_spilled(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    map = mapfs(*spill, &len);
+    scan_buffer(map, len, true, targets, save_to_files, targets, &stats);
+    unmapfs(map, len);
+
+    fclose(*spill);
+    *spill = NULL;
+}
+
+/**
+ * This function reads the wordlist through a fixed size buffer and sums it
+ * with the vector kernel, saving the words that sum to one of the targets.
+ * After each read the complete lines in the buffer are scanned and the
+ * unfinished line is slid to the front to be completed by the next read, so
+ * the wordlist can be a pipe of any length, or be decompressed as it is
+ * read. A line too long to fit in the buffer is spilled to a temporary file
+ * as it streams past and scanned from there once it ends, so it is saved
+ * like any other line.
+ */
+void scan_stream(struct source* src, struct targets* targets)
+{
+    char* buf;          /* The stream buffer. */
+    size_t filled;      /* Number of bytes in the buffer. */
+    size_t start;       /* Offset of the first line to scan in the buffer. */
+    size_t used;        /* Number of bytes scanned. */
+    ssize_t n;          /* Number of bytes read. */
+    const char* nl;     /* The newline that ends a spilled line. */
+    FILE* spill;        /* The spilled line's temporary file, or NULL. */
+
+    if ((buf = malloc(STREAM_BUF_SIZE)) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function scan_stream(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    filled = 0;
+    spill = NULL;
+
+    for (;;)
+    {
+        /* Filling the rest of the buffer. */
+        if ((n = read_source(src, buf + filled, STREAM_BUF_SIZE - filled)) == 0)
+            break;
+
+        filled += n;
+        start = 0;
+
+        /* Finishing a spilled line. */
+        if (spill != NULL)
+        {
+            if ((nl = memchr(buf, '\n', filled)) == NULL)
+            {
+                spill_line(&spill, buf, filled);
+                filled = 0;
+                continue;
+            }
+
+            start = nl - buf + 1;
+            spill_line(&spill, buf, start);
+            scan_spilled(&spill, targets);
+        }
+
+        /* Scanning the complete lines. */
+        used = start + scan_buffer(buf + start, filled - start, false,
+                                   targets, save_to_files, targets, &stats);
+
+        /* Sliding the unfinished line to the front. */
+        memmove(buf, buf + used, filled - used);
+        filled -= used;
+
+        /* The unfinished line fills the buffer so it is spilled. */
+        if (filled == STREAM_BUF_SIZE)
+        {
+            spill_line(&spill, buf, filled);
+            filled = 0;
+        }
+    }
+
+    /* Scanning the last line, which has no newline. */
+    if (spill != NULL)
+        scan_spilled(&spill, targets);
+    else
+        scan_buffer(buf, filled, true, targets, save_to_files, targets, &stats);
+
+    free(buf);
+}
+
+/**
+ * This function reads the wordlist with an asynchronous reader and sums it
+ * with the vector kernel, saving the words that sum to one of the targets.
+ * Each block is scanned where it was read into while the blocks after it are
+ * still being read, and only the unfinished line at the end of a block is
+ * copied, to be completed by the next one. Like scan_stream(), a line too
+ * long to fit in the stream buffer is spilled to a temporary file and
+ * scanned from there. If uring is false the wordlist is read with pread().
+ */
+void scan_async(FILE* wordlist, struct targets* targets, bool uring)
+{
+    struct reader* r;   /* The reader. */
+    const char* block;  /* The current block. */
+    size_t n;           /* Number of bytes in the block. */
+    size_t pos;         /* Offset of the first line to scan in the block. */
+    size_t len;         /* Length of the unfinished line's bytes in the
+                         * block, with its newline if it is there. */
+    char* carry;        /* The unfinished line from the blocks before. */
+    size_t carried;     /* Number of bytes in carry. */
+    const char* nl;     /* The newline that ends the unfinished line. */
+    FILE* spill;        /* The spilled line's temporary file, or NULL. */
+
+    if ((carry = malloc(STREAM_BUF_SIZE)) == NULL)
+    {
+        fprintf(stderr, "ERROR: In function scan_async(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    r = open_reader(fileno(wordlist), uring);
+    stats.reader = reader_mode_name(r);
+
+    carried = 0;
+    spill = NULL;
+
+    while ((n = next_block(r, &block)) > 0)
+    {
+        pos = 0;
+
+        /* Finishing the line that was left unfinished by the blocks
+         * before. */
+        if (spill != NULL || carried > 0)
+        {
+            nl = memchr(block, '\n', n);
+            len = nl == NULL ? n : (size_t) (nl - block) + 1;
+
+            /* The line doesn't fit in carry so it is spilled. */
+            if (spill == NULL && carried + len > STREAM_BUF_SIZE)
+            {
+                spill_line(&spill, carry, carried);
+                carried = 0;
+            }
+
+            if (spill != NULL)
+            {
+                spill_line(&spill, block, len);
+                if (nl == NULL)
+                    continue;
+                scan_spilled(&spill, targets);
+            }
+            else
+            {
+                memcpy(carry + carried, block, len);
+                carried += len;
+                if (nl == NULL)
+                    continue;
+                scan_buffer(carry, carried, false, targets, save_to_files,
+                            targets, &stats);
+                carried = 0;
+            }
+
+            pos = len;
+        }
+
+        /* Scanning the complete lines in place. */
+        pos += scan_buffer(block + pos, n - pos, false, targets,
+                           save_to_files, targets, &stats);
+
+        /* Keeping the unfinished line for the next block. Blocks are
+         * smaller than carry so it always fits. */
+        memcpy(carry, block + pos, n - pos);
+        carried = n - pos;
+    }
+
+    /* Scanning the last line, which has no newline. */
+    if (spill != NULL)
+        scan_spilled(&spill, targets);
+    else
+        scan_buffer(carry, carried, true, targets, save_to_files, targets,
+                    &stats);
+
+    close_reader(r);
+    free(carry);
+}
+
+/**
+ * This function maps the wordlist into memory and sums it with the vector
+ * kernel, saving the words that sum to one of the targets. If the wordlist
+ * can't be mapped (it is empty) it falls back to scan_lines().
+ */
+void scan_simd(FILE* wordlist, struct targets* targets)
+{
+    char* map;      /* The mapped wordlist. */
+    size_t len;     /* Length of the mapped wordlist. */
+
+    if ((map = mapfs(wordlist, &len)) == NULL)
+    {
+        scan_lines(wordlist, targets);
+        return;
+    }
+
+    scan_buffer(map, len, true, targets, save_to_files, targets, &stats);
+
+    unmapfs(map, len);
+}
+
+/**
+ * This function is run by each worker thread. It takes chunks from the work
+ * queue until there are none left and scans them.
+ */
+void* scan_worker(void* arg)
+{
+    struct workqueue* wq = arg;
+    struct chunk* c;
+    size_t i;
+
+    while ((i = atomic_fetch_add(&wq->next, 1)) < wq->nchunks)
+    {
+        c = &wq->chunks[i];
+        scan_buffer(c->buf, c->len, true, wq->targets, save_to_matchbuf, c->out,
+                                                                &c->stats);
+    }
+
+    return NULL;
+}
+
+/**
+ * This function splits the buffer provided to it into at most n chunks of
+ * roughly equal size. Each chunk boundary is moved forward to just after the
+ * next newline so no word is split between two chunks. It returns the number
+ * of chunks.
+ */
+size_t split_chunks(const char* buf, size_t len, struct chunk* chunks, size_t n,
+                                                            size_t ntargets)
+{
+    const char* end = buf + len;
+    const char* start;  /* Start of the current chunk. */
+    const char* stop;   /* End of the current chunk. */
+    const char* nl;     /* The newline the current chunk ends at. */
+    size_t nchunks;     /* Number of chunks made. */
+
+    nchunks = 0;
+    for (start = buf; start < end && nchunks < n; start = stop)
+    {
+        /* The last chunk takes whatever is left. */
+        if (nchunks == n - 1 || (size_t) (end - start) <= len / n)
+        {
+            stop = end;
+        }
+        else
+        {
+            nl = memchr(start + len / n, '\n', end - (start + len / n));
+            stop = nl != NULL ? nl + 1 : end;
+        }
+
+        chunks[nchunks].buf = start;
+        chunks[nchunks].len = stop - start;
+        chunks[nchunks].stats = (struct stats) { 0 };
+        chunks[nchunks].out = calloc(ntargets, sizeof(struct matchbuf));
+        if (chunks[nchunks].out == NULL)
+        {
+            fprintf(stderr, "ERROR: In function split_chunks(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        nchunks++;
+    }
+
+    return nchunks;
+}
+
+/**
+ * This function maps the wordlist into memory and scans it with the number
+ * of worker threads provided to it. The wordlist is split into several chunks
+ * per thread so a slow chunk doesn't leave the other threads idle. The words
+ * found in each chunk are saved in the order of the chunks, so the savefile
+ * is the same as the one that scan_lines() makes. If the wordlist can't be
+ * mapped (it is empty) it falls back to scan_lines().
+ */
+void scan_threads(FILE* wordlist, struct targets* targets, unsigned nthreads)
+{
+    struct workqueue wq;    /* The chunks to be scanned. */
+    pthread_t* threads;     /* The worker threads. */
+    char* map;              /* The mapped wordlist. */
+    size_t len;             /* Length of the mapped wordlist. */
+    size_t i;               /* Index of the current thread or chunk. */
+    size_t t;               /* Index of the current savefile. */
+    int err;                /* Error returned by pthread_create(). */
+
+    if ((map = mapfs(wordlist, &len)) == NULL)
+    {
+        scan_lines(wordlist, targets);
+        return;
+    }
+
+    /* Splitting the wordlist into chunks. */
+    wq.chunks = malloc(sizeof(struct chunk) * nthreads * CHUNKS_PER_THREAD);
+    threads = malloc(sizeof(pthread_t) * nthreads);
+    if (wq.chunks == NULL || threads == NULL)
+    {
+        fprintf(stderr, "ERROR: In function scan_threads(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    wq.nchunks = split_chunks(map, len, wq.chunks, nthreads * CHUNKS_PER_THREAD,
+                                                                targets->nout);
+    atomic_init(&wq.next, 0);
+    wq.targets = targets;
+
+    /* Scanning the chunks. */
+    for (i = 0; i < nthreads; i++)
+    {
+        if ((err = pthread_create(&threads[i], NULL, scan_worker, &wq)) != 0)
+        {
+            fprintf(stderr, "ERROR: In function scan_threads(): %s\n",
+                    strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    /* Saving the words in the order they appear in the wordlist. Each
+     * target's words are printed on stdout together, so with more than one
+     * target stdout isn't in wordlist order, but each savefile is. */
+    for (i = 0; i < wq.nchunks; i++)
+    {
+        add_stats(&stats, &wq.chunks[i].stats);
+        for (t = 0; t < targets->nout; t++)
+        {
+            save_to_files(wq.chunks[i].out[t].buf, wq.chunks[i].out[t].len,
+                                                            t, targets);
+            free(wq.chunks[i].out[t].buf);
+        }
+        free(wq.chunks[i].out);
+    }
+
+    free(threads);
+    free(wq.chunks);
+    unmapfs(map, len);
+}
+
+/**
+ * This function checks that the vector kernel and the scalar kernel produce
+ * the same words and sums for the whole wordlist, and that the words the
+ * vector kernel finds to sum to 666 are the ones sums666() finds. It returns
+ * the number of words that didn't match.
+ */
+size_t verify_kernel(const char* map, size_t len)
+{
+    struct linesum vsums[LINESUM_BATCH];    /* Sums from the vector kernel. */
+    struct linesum ssums[LINESUM_BATCH];    /* Sums from the scalar kernel. */
+    size_t pos;         /* Offset of the current batch. */
+    size_t vused;       /* Bytes consumed by the vector kernel. */
+    size_t sused;       /* Bytes consumed by the scalar kernel. */
+    size_t vn;          /* Number of words from the vector kernel. */
+    size_t sn;          /* Number of words from the scalar kernel. */
+    size_t i;           /* Index of the current word in the batch. */
+    size_t words;       /* Number of words checked. */
+    size_t bad;         /* Number of words that didn't match. */
+
+    pos = 0;
+    words = 0;
+    bad = 0;
+    do
+    {
+        vn = linesums(map + pos, len - pos, vsums, LINESUM_BATCH, &vused);
+        sn = linesums_scalar(map + pos, len - pos, ssums, LINESUM_BATCH, &sused);
+
+        if (vn != sn || vused != sused)
+        {
+            fprintf(stderr, "Batch at offset %zu: %zu words from %s, "
+                            "%zu words from scalar.\n",
+                            pos, vn, linesums_kernel(), sn);
+            return bad + 1;
+        }
+
+        for (i = 0; i < vn; i++)
+        {
+            /* sums666() stops at the newline that ends every word the
+             * kernels return, so it can read the word in place. It also
+             * stops at a null byte, which the kernels sum as 0, so words
+             * with one are only checked against the scalar kernel. */
+            if (vsums[i].off != ssums[i].off || vsums[i].len != ssums[i].len
+                || vsums[i].sum != ssums[i].sum
+                || (memchr(map + pos + vsums[i].off, '\0', vsums[i].len)
+                                                                    == NULL
+                    && (vsums[i].sum == 666)
+                        != sums666((char*) map + pos + vsums[i].off)))
+            {
+                fprintf(stderr, "Word at offset %zu: sum %lld from %s, "
+                                "%lld from scalar.\n",
+                                pos + ssums[i].off, (long long) vsums[i].sum,
+                                linesums_kernel(), (long long) ssums[i].sum);
+                bad++;
+            }
+        }
+
+        words += vn;
+        pos += vused;
+    } while (vn > 0);
+
+    printf("Checked %zu words with the %s kernel: %zu mismatches.\n",
+            words, linesums_kernel(), bad);
+
+    return bad;
+}
+
+/**
+ * This function runs verify_kernel() over the wordlist with every vector
+ * kernel the CPU supports. It returns the total number of mismatches.
+ */
+size_t verify_simd(FILE* wordlist)
+{
+    const char* kernels[] = { "sse2", "avx2" };
+    char* map;      /* The mapped wordlist. */
+    size_t len;     /* Length of the mapped wordlist. */
+    size_t bad;     /* Number of words that didn't match. */
+    size_t k;       /* Index of the current kernel. */
+
+    if ((map = mapfs(wordlist, &len)) == NULL)
+    {
+        fprintf(stderr, "ERROR: --verify needs a wordlist that can be mapped.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bad = 0;
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        if (linesums_use(kernels[k]))
+            bad += verify_kernel(map, len);
+    }
+
+    /* Going back to the fastest kernel. */
+    linesums_use(NULL);
+
+    unmapfs(map, len);
+
+    return bad;
+}
+
+/**
+ * This is what save_phrase() needs to save a target's phrases.
+ */
+struct phrase_dest {
+    struct targets* targets;    /* The targets. */
+    int t;                      /* Index of the target's savefile. */
+};
+
+/**
+ * This function saves phrases that sum to a target to the target's savefile.
+ */
+void save_phrase(const char* phrases, size_t len, void* arg)
+{
+    struct phrase_dest* dest = arg;
+
+    save_word(dest->targets, dest->t, phrases, len);
+}
+
+/**
+ * This function loads the whole wordlist into memory, buckets its words by
+ * their sums in each cipher and saves the phrases of words whose combined sum
+ * is one of the targets. space is whether the spaces between words count
+ * towards the sums. Wordlists that can't be mapped are read from src.
+ */
+void scan_phrases(FILE* wordlist, struct source* src, struct targets* targets,
+                                  struct phrase_opts* opts, bool space)
+{
+    struct phrase_dest dest;    /* Where the phrases are saved. */
+    struct buckets* b;          /* The bucketed words. */
+    const struct cipher* cph;   /* The current cipher. */
+    char* buf;                  /* The wordlist. */
+    size_t len;                 /* Length of the wordlist. */
+    bool mapped;                /* Whether the wordlist was mapped. */
+    size_t c;                   /* Index of the current cipher. */
+    size_t t;                   /* Index of the current target. */
+
+    mapped = !source_compressed(src) && (buf = mapfs(wordlist, &len)) != NULL;
+    if (!mapped)
+        buf = read_source_all(src, &len);
+
+    dest.targets = targets;
+    for (c = 0; c < targets->nciphers; c++)
+    {
+        cph = targets->ciphers[c];
+        b = bucket_words(buf, len, targets->ascii ? NULL : cph);
+        opts->space = space ? cph->bytes[' '] : 0;
+
+        if (c == 0)
+        {
+            stats.bytes += len;
+            stats.lines += b->nwords;
+            for (t = 0; t < b->nwords; t++)
+            {
+                if (b->words[t].len > stats.longest)
+                    stats.longest = b->words[t].len;
+            }
+        }
+
+        for (t = 0; t < targets->n; t++)
+        {
+            dest.t = c * targets->n + t;
+            stats.matches += find_phrases(b, targets->sums[t], opts,
+                                          save_phrase, &dest);
+        }
+
+        free_buckets(b);
+    }
+
+    if (mapped)
+        unmapfs(buf, len);
+    else
+        free(buf);
+}
+
+/**
+ * This function loads the whole wordlist into memory as running text and
+ * saves every substring of it, or every phrase of consecutive words of it if
+ * opts->maxwords isn't 0, whose sum in each cipher is one of the targets,
+ * with its byte offset. Wordlists that can't be mapped are read from src.
+ */
+void scan_text(FILE* wordlist, struct source* src, struct targets* targets,
+                               struct text_opts* opts)
+{
+    struct phrase_dest dest;    /* Where the results are saved. */
+    char* buf;                  /* The text. */
+    size_t len;                 /* Length of the text. */
+    bool mapped;                /* Whether the text was mapped. */
+    size_t c;                   /* Index of the current cipher. */
+    size_t t;                   /* Index of the current target. */
+
+    mapped = !source_compressed(src) && (buf = mapfs(wordlist, &len)) != NULL;
+    if (!mapped)
+        buf = read_source_all(src, &len);
+
+    stats.bytes += len;
+    for (t = 0; t < len; t++)
+    {
+        if (buf[t] == '\n')
+            stats.lines++;
+    }
+
+    dest.targets = targets;
+    for (c = 0; c < targets->nciphers; c++)
+    {
+        for (t = 0; t < targets->n; t++)
+        {
+            dest.t = c * targets->n + t;
+            if (opts->maxwords > 0)
+                stats.matches += find_phrases_text(buf, len,
+                                        targets->ciphers[c], targets->sums[t],
+                                        opts, save_phrase, &dest);
+            else
+                stats.matches += find_substrings(buf, len,
+                                        targets->ciphers[c], targets->sums[t],
+                                        opts, save_phrase, &dest);
+        }
+    }
+
+    if (mapped)
+        unmapfs(buf, len);
+    else
+        free(buf);
+}
+
+/**
+ * This is a wordlist scanned by batch mode.
+ */
+struct batchfile {
+    char* path;             /* Path of the wordlist. */
+    char* savefile;         /* Path of its savefile. */
+    uint64_t size;          /* Size of the wordlist. */
+    struct stats stats;     /* Statistics of the wordlist. */
+    int err;                /* Why it couldn't be scanned, or 0. */
+    struct batch* batch;    /* The batch it is part of. */
+
+    char* buf;              /* The wordlist, while it is scanned. */
+    size_t len;             /* Length of the wordlist. */
+    bool mapped;            /* Whether the wordlist was mapped. */
+    struct chunk* chunks;   /* The chunks of the wordlist. */
+    struct batchchunk* tasks;   /* The task of each chunk. */
+    size_t nchunks;         /* Number of chunks. */
+    atomic_size_t left;     /* Number of chunks not yet scanned. */
+};
+
+/**
+ * This is the task that scans one chunk of a wordlist in batch mode.
+ */
+struct batchchunk {
+    struct batchfile* file;     /* The wordlist. */
+    size_t i;                   /* Index of the chunk. */
+};
+
+/**
+ * This is the state of batch mode.
+ */
+struct batch {
+    struct targets* targets;    /* The targets to search for. */
+    struct pool* pool;          /* The threads that scan the wordlists. */
+    struct batchfile* files;    /* The wordlists. */
+    size_t nfiles;              /* Number of wordlists. */
+    size_t cap;                 /* Number of wordlists allocated. */
+    struct stat outdir;         /* Status of the output directory. */
+    char* summary;              /* Name of the summary file. */
+    bool async;                 /* Whether wordlists are read, not mapped. */
+    bool uring;                 /* Whether they are read with io_uring. */
+};
+
+/**
+ * This function makes every directory in path, up to its last '/', that
+ * doesn't already exist. It returns 0 or an errno.
+ */
+int make_dirs(const char* path)
+{
+    char* dir;      /* A copy of path that is cut at each '/'. */
+    char* slash;    /* The current '/'. */
+    int err;        /* The error that stopped it, or 0. */
+
+    if ((dir = strdup(path)) == NULL)
+        return errno;
+
+    err = 0;
+    for (slash = strchr(dir + 1, '/'); slash != NULL && err == 0;
+         slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        if (mkdir(dir, 0777) == -1 && errno != EEXIST)
+            err = errno;
+        *slash = '/';
+    }
+
+    free(dir);
+
+    return err;
+}
+
+/**
+ * These are the suffixes of compressed wordlists, which their plain text
+ * savefiles don't keep.
+ */
+static const char* const compressed_suffixes[] = {
+    ".gz",
+#ifdef SUMS666_ZSTD
+    ".zst",
+#endif
+};
+
+/**
+ * This function adds the wordlist at path to the batch. Its savefile is at
+ * rel in the output directory, without the suffix of a compressed wordlist
+ * unless a wordlist without the suffix is next to it. If one of its
+ * savefiles would be the summary file, it is added with an error instead so
+ * it isn't scanned.
+ */
+static void add_batch_file(struct batch* b, const char* path,
+                           const char* outdir, const char* rel, uint64_t size)
+{
+    struct batchfile* f;
+    struct stat st;     /* Status of the wordlist without its suffix. */
+    char* plain;        /* Path of the wordlist without its suffix. */
+    char* fname;        /* Name of one of the wordlist's savefiles. */
+    size_t len;         /* Length of rel. */
+    size_t sfx;         /* Length of the suffix to leave off. */
+    size_t i;
+
+    if (b->nfiles == b->cap)
+    {
+        b->cap = b->cap > 0 ? b->cap * 2 : 256;
+        if ((b->files = realloc(b->files, sizeof(struct batchfile) * b->cap))
+                                                                    == NULL)
+        {
+            fprintf(stderr, "ERROR: In function add_batch_file(): %s\n",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    f = &b->files[b->nfiles++];
+    memset(f, 0, sizeof(*f));
+    strfmt(&f->path, "%s", path);
+
+    len = strlen(rel);
+    sfx = 0;
+    for (i = 0; i < sizeof(compressed_suffixes) / sizeof(char*); i++)
+    {
+        if (len > strlen(compressed_suffixes[i])
+            && strcmp(rel + len - strlen(compressed_suffixes[i]),
+                      compressed_suffixes[i]) == 0)
+            sfx = strlen(compressed_suffixes[i]);
+    }
+    if (sfx > 0)
+    {
+        strfmt(&plain, "%.*s", (int) (strlen(path) - sfx), path);
+        if (stat(plain, &st) == 0)
+            sfx = 0;
+        free(plain);
+    }
+
+    strfmt(&f->savefile, "%s/%.*s", outdir, (int) (len - sfx), rel);
+    f->size = size;
+    f->batch = b;
+
+    for (i = 0; i < b->targets->nout && f->err == 0; i++)
+    {
+        fname = savefile_name(b->targets, f->savefile, i);
+        if (strcmp(fname, b->summary) == 0)
+        {
+            fprintf(stderr, "WARNING: Skipping %s, whose savefile would be "
+                            "the summary.\n", path);
+            f->err = EEXIST;
+        }
+        free(fname);
+    }
+}
+
+/**
+ * This function adds every wordlist in the directory at path, and in the
+ * directories in it, to the batch. Their savefiles are at the same paths
+ * under rel in the output directory. Symbolic links to directories and the
+ * output directory itself are skipped.
+ */
+void walk_batch_dir(struct batch* b, const char* path, const char* outdir,
+                                     const char* rel)
+{
+    struct dirent* e;   /* The current entry. */
+    struct stat st;     /* Status of the current entry. */
+    struct stat lst;    /* Status of the current entry's link. */
+    char* sub;          /* Path of the current entry. */
+    char* subrel;       /* Path of the current entry's savefile. */
+    DIR* dir;           /* The directory. */
+
+    if ((dir = opendir(path)) == NULL)
+    {
+        fprintf(stderr, "WARNING: Skipping %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    while ((e = readdir(dir)) != NULL)
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+
+        strfmt(&sub, "%s/%s", path, e->d_name);
+        if (*rel != '\0')
+            strfmt(&subrel, "%s/%s", rel, e->d_name);
+        else
+            strfmt(&subrel, "%s", e->d_name);
+
+        if (stat(sub, &st) == 0 && lstat(sub, &lst) == 0)
+        {
+            if (S_ISDIR(st.st_mode) && !S_ISLNK(lst.st_mode)
+                && (st.st_dev != b->outdir.st_dev
+                    || st.st_ino != b->outdir.st_ino))
+                walk_batch_dir(b, sub, outdir, subrel);
+            else if (S_ISREG(st.st_mode))
+                add_batch_file(b, sub, outdir, subrel, st.st_size);
+        }
+
+        free(sub);
+        free(subrel);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * This function returns whether the path provided to it is the output
+ * directory of the batch or is in it, so a glob doesn't match the savefiles
+ * of an earlier run.
+ */
+static bool in_batch_outdir(const struct batch* b, const char* path)
+{
+    struct stat st;     /* Status of the current directory. */
+    char* dir;          /* The path up to the current '/'. */
+    size_t len;         /* Length of the path. */
+    size_t i;
+    bool in;
+
+    strfmt(&dir, "%s", path);
+    len = strlen(path);
+    in = false;
+    for (i = 1; i <= len && !in; i++)
+    {
+        if (path[i] != '/' && path[i] != '\0')
+            continue;
+        dir[i] = '\0';
+        in = stat(dir, &st) == 0 && st.st_dev == b->outdir.st_dev
+                                 && st.st_ino == b->outdir.st_ino;
+        dir[i] = path[i];
+    }
+    free(dir);
+
+    return in;
+}
+
+/**
+ * This function returns the length of the directory that every path a glob
+ * matches is in, which is the part of the glob before the '/' that comes
+ * before its first wildcard. It is 0 if the glob has no '/' before one.
+ */
+static size_t glob_base(const char* pattern)
+{
+    size_t base;    /* Length of the directory so far. */
+    size_t i;
+
+    base = 0;
+    for (i = 0; pattern[i] != '\0' && strchr("*?[\\", pattern[i]) == NULL; i++)
+    {
+        if (pattern[i] == '/')
+            base = i + 1;
+    }
+
+    return base;
+}
+
+/**
+ * This function returns the path, under the output directory, of the
+ * savefile of a wordlist or directory that was matched by a glob, given the
+ * part of the path after the glob's base directory. It is that part without
+ * a leading '/' or "./", or just its last part if it goes up a directory.
+ */
+static char* batch_rel(const char* path)
+{
+    const char* p;  /* The path without its leading '/'s and "./"s. */
+    const char* up; /* A ".." in the path. */
+    char* rel;
+
+    for (p = path; *p == '/' || strncmp(p, "./", 2) == 0; )
+        p += *p == '/' ? 1 : 2;
+
+    for (up = strstr(p, ".."); up != NULL; up = strstr(up + 2, ".."))
+    {
+        if ((up == p || up[-1] == '/') && (up[2] == '\0' || up[2] == '/'))
+        {
+            p = (p = strrchr(path, '/')) != NULL && p[1] != '\0' ? p + 1 : path;
+            break;
+        }
+    }
+
+    strfmt(&rel, "%s", p);
+
+    return rel;
+}
+
+/**
+ * This function compares two wordlists of a batch by their paths, for
+ * qsort().
+ */
+int compare_batch_files(const void* a, const void* b)
+{
+    return strcmp(((const struct batchfile*) a)->path,
+                  ((const struct batchfile*) b)->path);
+}
+
+/**
+ * This function saves the words a wordlist's chunks found to its savefiles,
+ * in wordlist order, and frees the wordlist.
+ */
+void finish_batch_file(struct batchfile* f)
+{
+    const struct targets* targets = f->batch->targets;
+    char* fname;    /* Name of the current savefile. */
+    FILE* fs;       /* The current savefile. */
+    size_t i;       /* Index of the current chunk. */
+    size_t t;       /* Index of the current savefile. */
+
+    for (i = 0; i < f->nchunks; i++)
+        add_stats(&f->stats, &f->chunks[i].stats);
+
+    f->err = make_dirs(f->savefile);
+    for (t = 0; t < targets->nout && f->err == 0; t++)
+    {
+        fname = savefile_name(targets, f->savefile, t);
+        if ((fs = fopen(fname, "w")) == NULL)
+        {
+            f->err = errno;
+        }
+        else
+        {
+            for (i = 0; i < f->nchunks; i++)
+                fwrite(f->chunks[i].out[t].buf, sizeof(char),
+                       f->chunks[i].out[t].len, fs);
+            if (fclose(fs) != 0)
+                f->err = errno;
+        }
+        free(fname);
+    }
+
+    for (i = 0; i < f->nchunks; i++)
+    {
+        for (t = 0; t < targets->nout; t++)
+            free(f->chunks[i].out[t].buf);
+        free(f->chunks[i].out);
+    }
+    free(f->chunks);
+    free(f->tasks);
+
+    if (f->mapped)
+        unmapfs(f->buf, f->len);
+    else
+        free(f->buf);
+}
+
+/**
+ * This function is the task that scans one chunk of a wordlist. The task
+ * that scans the wordlist's last chunk saves its words.
+ */
+void scan_batch_chunk(void* arg)
+{
+    struct batchchunk* bc = arg;
+    struct batchfile* f = bc->file;
+    struct chunk* c = &f->chunks[bc->i];
+
+    scan_buffer(c->buf, c->len, true, f->batch->targets, save_to_matchbuf,
+                c->out, &c->stats);
+
+    if (atomic_fetch_sub(&f->left, 1) == 1)
+        finish_batch_file(f);
+}
+
+/**
+ * This function is the task that scans a wordlist. A wordlist larger than
+ * BATCH_CHUNK_SIZE is split into chunks, which are tasks of their own, so
+ * idle threads can steal them while this thread scans the first one.
+ */
+void scan_batch_file(void* arg)
+{
+    struct batchfile* f = arg;
+    struct source* src;     /* The wordlist, if it can't be mapped. */
+    FILE* fs;               /* The wordlist. */
+    size_t n;               /* Number of chunks to split it into. */
+    size_t i;               /* Index of the current chunk. */
+
+    if ((fs = fopen(f->path, "r")) == NULL)
+    {
+        f->err = errno;
+        return;
+    }
+
+    src = open_source(fileno(fs));
+    if (!source_compressed(src) && f->batch->async)
+        f->buf = read_file_async(fileno(fs), &f->len, f->batch->uring);
+    else
+        f->mapped = !source_compressed(src)
+                 && (f->buf = mapfs(fs, &f->len)) != NULL;
+    if (f->buf == NULL)
+        f->buf = read_source_all(src, &f->len);
+    close_source(src);
+    fclose(fs);
+
+    n = f->len / BATCH_CHUNK_SIZE + 1;
+    f->chunks = malloc(sizeof(struct chunk) * n);
+    f->tasks = malloc(sizeof(struct batchchunk) * n);
+    if (f->chunks == NULL || f->tasks == NULL)
+    {
+        fprintf(stderr, "ERROR: In function scan_batch_file(): %s\n",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    f->nchunks = split_chunks(f->buf, f->len, f->chunks, n,
+                              f->batch->targets->nout);
+
+    /* An empty wordlist still gets its (empty) savefiles. */
+    if (f->nchunks == 0)
+    {
+        finish_batch_file(f);
+        return;
+    }
+
+    atomic_init(&f->left, f->nchunks);
+    for (i = 0; i < f->nchunks; i++)
+    {
+        f->tasks[i].file = f;
+        f->tasks[i].i = i;
+    }
+    for (i = 1; i < f->nchunks; i++)
+        submit_task(f->batch->pool, scan_batch_chunk, &f->tasks[i]);
+
+    scan_batch_chunk(&f->tasks[0]);
+}
+
+/**
+ * This function writes the summary of a batch, which has a line for each
+ * wordlist and a line of totals, to the file with the name provided to it.
+ */
+void write_batch_summary(const struct batch* b, const char* fname)
+{
+    const struct batchfile* f;  /* The current wordlist. */
+    FILE* fs;                   /* The summary file. */
+    size_t i;
+
+    fs = openfs((char*) fname, "w");
+    fprintf(fs, "matches\tlines\tbytes\twordlist\n");
+
+    for (i = 0; i < b->nfiles; i++)
+    {
+        f = &b->files[i];
+        if (f->err != 0)
+            fprintf(fs, "-\t-\t-\t%s (%s)\n", f->path, strerror(f->err));
+        else
+            fprintf(fs, "%llu\t%llu\t%llu\t%s\n",
+                    (unsigned long long) f->stats.matches,
+                    (unsigned long long) f->stats.lines,
+                    (unsigned long long) f->stats.bytes, f->path);
+    }
+
+    fprintf(fs, "%llu\t%llu\t%llu\ttotal\n",
+            (unsigned long long) stats.matches,
+            (unsigned long long) stats.lines,
+            (unsigned long long) stats.bytes);
+
+    closefs(fs);
+}
+
+/**
+ * This function scans every wordlist in the directory, or matched by the
+ * glob, provided to it with nthreads threads and saves each one's words to
+ * a savefile at the same path in outdir, relative to the directory or to
+ * the glob's directory before its first wildcard and without the suffix of
+ * a compressed wordlist, with a summary of every wordlist in
+ * outdir/summary.tsv. Nothing in outdir is scanned, and a wordlist whose
+ * savefile would be the summary is left out. Wordlists are scanned whole,
+ * except large ones, which are split into chunks, and idle threads steal
+ * wordlists and chunks from busy ones. If show_progress is true, a progress
+ * line of the bytes scanned across every wordlist is drawn. If async is
+ * true, uncompressed wordlists are read into memory with many reads in
+ * flight (with io_uring if uring is true and it is available) instead of
+ * being mapped.
+ */
+void scan_batch(char* input, char* outdir, struct targets* targets,
+                unsigned nthreads, bool show_progress, bool async, bool uring)
+{
+    struct batch b;     /* The batch. */
+    struct stat st;     /* Status of the input or a match of it. */
+    glob_t g;           /* The matches of the glob. */
+    uint64_t total;     /* Total size of the wordlists. */
+    uint64_t failed;    /* Number of wordlists that couldn't be scanned. */
+    char* rel;          /* Path of a match's savefile in outdir. */
+    size_t base;        /* Length of the directory of the glob's paths. */
+    size_t i;
+
+    memset(&b, 0, sizeof(b));
+    b.targets = targets;
+    b.async = async;
+    b.uring = uring;
+
+    if (mkdir(outdir, 0777) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "ERROR: Can't make %s: %s\n", outdir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (stat(outdir, &b.outdir) != 0 || !S_ISDIR(b.outdir.st_mode))
+    {
+        fprintf(stderr, "ERROR: %s isn't a directory.\n", outdir);
+        exit(EXIT_FAILURE);
+    }
+    strfmt(&b.summary, "%s/summary.tsv", outdir);
+
+    /* Finding the wordlists. Every savefile's path is the path of its
+     * wordlist under the input, which is the directory that was given or
+     * the directory of the glob's paths before its first wildcard. */
+    if (stat(input, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        walk_batch_dir(&b, input, outdir, "");
+    }
+    else if (glob(input, 0, NULL, &g) == 0)
+    {
+        base = glob_base(input);
+        for (i = 0; i < g.gl_pathc; i++)
+        {
+            if (stat(g.gl_pathv[i], &st) != 0
+                || in_batch_outdir(&b, g.gl_pathv[i]))
+                continue;
+            rel = batch_rel(g.gl_pathv[i] + base);
+            if (S_ISDIR(st.st_mode))
+                walk_batch_dir(&b, g.gl_pathv[i], outdir, rel);
+            else if (S_ISREG(st.st_mode))
+                add_batch_file(&b, g.gl_pathv[i], outdir, rel, st.st_size);
+            free(rel);
+        }
+        globfree(&g);
+    }
+
+    if (b.nfiles == 0)
+    {
+        fprintf(stderr, "ERROR: No wordlists found in %s.\n", input);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The wordlists are scanned, and summarised, in the order of their
+     * paths, so the summary is the same every run. */
+    qsort(b.files, b.nfiles, sizeof(struct batchfile), compare_batch_files);
+
+    total = 0;
+    for (i = 0; i < b.nfiles; i++)
+    {
+        b.files[i].batch = &b;
+        if (b.files[i].err == 0)
+            total += b.files[i].size;
+    }
+
+    if (show_progress)
+        progress = start_progress(total);
+
+    b.pool = open_pool(nthreads);
+    for (i = 0; i < b.nfiles; i++)
+    {
+        if (b.files[i].err == 0)
+            submit_task(b.pool, scan_batch_file, &b.files[i]);
+    }
+    wait_pool(b.pool);
+    close_pool(b.pool);
+
+    if (progress != NULL)
+        stop_progress(progress);
+
+    failed = 0;
+    for (i = 0; i < b.nfiles; i++)
+    {
+        add_stats(&stats, &b.files[i].stats);
+        failed += b.files[i].err != 0;
+    }
+
+    write_batch_summary(&b, b.summary);
+
+    printf("Scanned %llu wordlists and found %llu words. The summary is in "
+           "%s.\n", (unsigned long long) (b.nfiles - failed),
+           (unsigned long long) stats.matches, b.summary);
+    if (failed > 0)
+        fprintf(stderr, "WARNING: %llu wordlists couldn't be scanned.\n",
+                (unsigned long long) failed);
+
+    free(b.summary);
+    for (i = 0; i < b.nfiles; i++)
+    {
+        free(b.files[i].path);
+        free(b.files[i].savefile);
+    }
+    free(b.files);
+}
+
+/**
+ * This is the state of an incremental scan, which only scans the part of the
+ * wordlist that was appended after the last scan.
+ */
+struct incremental {
+    char* ckptfile;     /* Name of the checkpoint file. */
+    char* map;          /* The mapped wordlist, or NULL if it is empty. */
+    size_t len;         /* Length of the mapped wordlist. */
+    struct stat st;     /* Status of the wordlist. */
+    uint64_t config;    /* Hash of the targets and ciphers. */
+    uint64_t resume;    /* Offset the scan starts at. */
+    uint64_t end;       /* Offset the scan stopped at. */
+};
+
+/**
+ * This function returns a hash of the target sums and the ciphers, so a
+ * checkpoint made while searching for other targets isn't trusted.
+ */
+uint64_t hash_targets(const struct targets* t)
+{
+    const struct cipher* c;     /* The current cipher. */
+    uint64_t h;                 /* The hash. */
+    size_t i;                   /* Index of the current cipher. */
+
+    h = hash_bytes(t->sums, sizeof(long) * t->n, HASH_SEED);
+
+    /* Ranges and length filters are hashed only if they are used, so older
+     * checkpoints are still trusted. */
+    if (t->range)
+        h = hash_bytes(&t->hi, sizeof(t->hi), h);
+    if (t->minlen > 0 || t->maxlen < SIZE_MAX)
+    {
+        h = hash_bytes(&t->minlen, sizeof(t->minlen), h);
+        h = hash_bytes(&t->maxlen, sizeof(t->maxlen), h);
+    }
+    for (i = 0; i < t->nciphers; i++)
+    {
+        c = t->ciphers[i];
+        h = hash_bytes(c->name, strlen(c->name) + 1, h);
+        h = hash_bytes(c->bytes, sizeof(c->bytes), h);
+        h = hash_bytes(&c->unicode, sizeof(c->unicode), h);
+    }
+
+    return h;
+}
+
+/**
+ * This function maps the wordlist and reads the checkpoint named after
+ * savefile (savefile.ckpt) to find where an incremental scan resumes. The
+ * scan starts from the beginning of the wordlist if there is no checkpoint,
+ * if it can't be trusted or if one of the savefiles is missing.
+ */
+void begin_incremental(struct incremental* inc, FILE* wordlist,
+                       const struct targets* targets, char* savefile)
+{
+    struct checkpoint ck;   /* The last run's checkpoint. */
+    char* fname;            /* Name of the current savefile. */
+    bool missing;           /* Whether the current savefile is missing. */
+    size_t i;               /* Index of the current savefile. */
+
+    if (fstat(fileno(wordlist), &inc->st) != 0 || !S_ISREG(inc->st.st_mode)
+        || strcmp(savefile, "-") == 0)
+    {
+        fprintf(stderr, "ERROR: --incremental needs a wordlist file and "
+                        "a savefile.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* The wordlist might have grown since it was stat'ed. */
+    if ((inc->map = mapfs(wordlist, &inc->len)) == NULL)
+        inc->len = 0;
+    inc->st.st_size = inc->len;
+
+    strfmt(&inc->ckptfile, "%s.ckpt", savefile);
+    inc->config = hash_targets(targets);
+    inc->resume = 0;
+    inc->end = 0;
+
+    if (inc->map == NULL || !read_checkpoint(inc->ckptfile, &ck))
+        return;
+
+    for (i = 0; i < targets->nout; i++)
+    {
+        fname = savefile_name(targets, savefile, i);
+        missing = access(fname, F_OK) != 0;
+        free(fname);
+
+        if (missing)
+            return;
+    }
+
+    inc->resume = resume_checkpoint(&ck, &inc->st, inc->map, inc->config);
+}
+
+/**
+ * This function scans the wordlist from where the incremental scan resumes,
+ * saving the words that sum to one of the targets. A last line without a
+ * newline might still be being written, so it is left for the next scan.
+ */
+void scan_incremental(struct incremental* inc, struct targets* targets)
+{
+    inc->end = inc->resume;
+
+    if (inc->map != NULL)
+        inc->end += scan_buffer(inc->map + inc->resume, inc->len - inc->resume,
+                                false, targets, save_to_files, targets, &stats);
+}
+
+/**
+ * This function writes the checkpoint of an incremental scan, which must
+ * only be done once the savefiles have been flushed, and frees it.
+ */
+void end_incremental(struct incremental* inc)
+{
+    struct checkpoint ck;   /* The new checkpoint. */
+
+    make_checkpoint(&ck, &inc->st, inc->map, inc->end, inc->config);
+    write_checkpoint(inc->ckptfile, &ck);
+
+    if (inc->map != NULL)
+        unmapfs(inc->map, inc->len);
+    free(inc->ckptfile);
+}
+
+/**
+ * This function runs the index and query commands. It returns false if the
+ * arguments aren't one of them.
+ */
+bool run_command(int argc, char* argv[])
+{
+    FILE* wordlist;
+    char* end;
+    long target;
+    long nthreads;
+    int first;
+
+    if (argc < 2)
+        return false;
+
+    if (strcmp(argv[1], "index") == 0)
+    {
+        if (argc != 4)
+            print_help();
+
+        wordlist = strcmp(argv[2], "-") == 0 ? stdin : openfs(argv[2], "r");
+        printf("Indexed %llu words.\n",
+                (unsigned long long) write_index(wordlist, argv[3]));
+        closefs(wordlist);
+        return true;
+    }
+
+    if (strcmp(argv[1], "query") == 0)
+    {
+        if (argc != 4)
+            print_help();
+
+        target = strtol(argv[3], &end, 10);
+        if (*argv[3] == '\0' || *end != '\0')
+            print_help();
+
+        query_index(argv[2], target, stdout);
+        return true;
+    }
+
+    if (strcmp(argv[1], "serve") == 0)
+    {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        first = 2;
+        if (argc > 3 && strcmp(argv[2], "-j") == 0)
+        {
+            nthreads = atol(argv[3]);
+            first = 4;
+        }
+        if (argc - first < 2 || nthreads < 1)
+            print_help();
+
+        serve(argv[first], argv + first + 1, argc - first - 1, nthreads);
+        return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* wordlist;
+    struct targets targets;
+    bool use_mmap;
+    bool use_simd;
+    bool use_stream;
+    bool use_async;
+    bool async_uring;
+    bool verify;
+    bool quiet;
+    bool show_stats;
+    bool show_progress;
+    uint64_t total;
+    bool space;
+    bool incremental;
+    bool sort;
+    bool unique;
+    size_t sort_mb;
+    bool has_min;
+    bool has_max;
+    long min;
+    long max;
+    struct incremental inc;
+    struct source* source;
+    struct stat st;
+    struct phrase_opts phrases;
+    struct text_opts text;
+    bool substrings;
+    bool text_phrases;
+    bool has_sep;
+    struct timespec timer;
+    uint64_t scan_ns;
+    unsigned nthreads;
+    bool has_jobs;
+    size_t c;
+    int opt;
+
+    const struct option longopts[] = {
+        { "mmap", no_argument, NULL, 'm' },
+        { "simd", no_argument, NULL, 's' },
+        { "stream", no_argument, NULL, 'S' },
+        { "async-io", optional_argument, NULL, 'A' },
+        { "verify", no_argument, NULL, 'v' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "quiet", no_argument, NULL, 'q' },
+        { "stats", no_argument, NULL, 'x' },
+        { "progress", no_argument, NULL, 'P' },
+        { "min", required_argument, NULL, 'a' },
+        { "max", required_argument, NULL, 'b' },
+        { "nearest", required_argument, NULL, 'k' },
+        { "min-length", required_argument, NULL, 'l' },
+        { "max-length", required_argument, NULL, 'L' },
+        { "pairs", no_argument, NULL, '2' },
+        { "triples", no_argument, NULL, '3' },
+        { "space", no_argument, NULL, 'w' },
+        { "max-results", required_argument, NULL, 'M' },
+        { "substrings", no_argument, NULL, 'g' },
+        { "whole-words", no_argument, NULL, 'W' },
+        { "phrases", no_argument, NULL, 'p' },
+        { "max-words", required_argument, NULL, 'K' },
+        { "separators", required_argument, NULL, 'E' },
+        { "target", required_argument, NULL, 't' },
+        { "targets", required_argument, NULL, 'T' },
+        { "targets-file", required_argument, NULL, 'F' },
+        { "cipher", required_argument, NULL, 'c' },
+        { "cipher-file", required_argument, NULL, 'C' },
+        { "codepoints", no_argument, NULL, 'u' },
+        { "incremental", no_argument, NULL, 'i' },
+        { "sort", no_argument, NULL, 'o' },
+        { "unique", no_argument, NULL, 'U' },
+        { "sort-memory", required_argument, NULL, 'B' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    if (run_command(argc, argv))
+        exit(EXIT_SUCCESS);
+
+    use_mmap = false;
+    use_simd = false;
+    use_stream = false;
+    use_async = false;
+    async_uring = true;
+    verify = false;
+    quiet = false;
+    show_stats = false;
+    show_progress = false;
+    space = false;
+    incremental = false;
+    sort = false;
+    unique = false;
+    sort_mb = SORT_MEMORY_MB;
+    phrases = (struct phrase_opts) { 0 };
+    text = (struct text_opts) { 0 };
+    substrings = false;
+    text_phrases = false;
+    has_sep = false;
+    nthreads = 1;
+    has_jobs = false;
+    has_min = false;
+    has_max = false;
+    min = 0;
+    max = 0;
+    targets = (struct targets) { 0 };
+    targets.maxlen = SIZE_MAX;
+
+    while ((opt = getopt_long(argc, argv, "hj:q", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                use_mmap = true;
+                break;
+            case 's':
+                use_simd = true;
+                break;
+            case 'S':
+                use_stream = true;
+                break;
+            case 'A':
+                if (optarg == NULL || strcmp(optarg, "uring") == 0)
+                    async_uring = true;
+                else if (strcmp(optarg, "pread") == 0)
+                    async_uring = false;
+                else
+                    print_help();
+                use_async = true;
+                break;
+            case 'v':
+                verify = true;
+                break;
+            case 'j':
+                if (atoi(optarg) < 1)
+                    print_help();
+                nthreads = atoi(optarg);
+                has_jobs = true;
+                use_simd = true;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'x':
+                show_stats = true;
+                break;
+            case 'P':
+                show_progress = true;
+                break;
+            case 'a':
+                min = strtol(optarg, NULL, 10);
+                has_min = true;
+                break;
+            case 'b':
+                max = strtol(optarg, NULL, 10);
+                has_max = true;
+                break;
+            case 'k':
+                if (atol(optarg) < 1)
+                    print_help();
+                targets.nearest = atol(optarg);
+                break;
+            case 'l':
+                targets.minlen = strtoull(optarg, NULL, 10);
+                break;
+            case 'L':
+                targets.maxlen = strtoull(optarg, NULL, 10);
+                break;
+            case '2':
+            case '3':
+                phrases.nwords = opt - '0';
+                break;
+            case 'w':
+                space = true;
+                break;
+            case 'M':
+                phrases.max_results = strtoull(optarg, NULL, 10);
+                break;
+            case 'g':
+                substrings = true;
+                break;
+            case 'W':
+                substrings = true;
+                text.bounded = true;
+                break;
+            case 'p':
+                text_phrases = true;
+                break;
+            case 'K':
+                if (atol(optarg) < 1)
+                    print_help();
+                text.maxwords = atol(optarg);
+                text_phrases = true;
+                break;
+            case 'E':
+                if (strcmp(optarg, "none") == 0)
+                    text.sep = SEPARATORS_NONE;
+                else if (strcmp(optarg, "space") == 0)
+                    text.sep = SEPARATORS_SPACE;
+                else if (strcmp(optarg, "text") == 0)
+                    text.sep = SEPARATORS_TEXT;
+                else
+                    print_help();
+                has_sep = true;
+                break;
+            case 't':
+            case 'T':
+                parse_targets(&targets, optarg);
+                break;
+            case 'F':
+                read_targets(&targets, optarg);
+                break;
+            case 'c':
+                parse_ciphers(&targets, optarg);
+                break;
+            case 'C':
+                add_cipher(&targets, read_cipher(optarg));
+                break;
+            case 'u':
+                add_cipher(&targets, codepoint_cipher());
+                break;
+            case 'i':
+                incremental = true;
+                break;
+            case 'o':
+                sort = true;
+                break;
+            case 'U':
+                sort = true;
+                unique = true;
+                break;
+            case 'B':
+                if (atol(optarg) < 1)
+                    print_help();
+                sort_mb = atol(optarg);
+                break;
+            default:
+                print_help();
+        }
+    }
+
+    /* Batch mode scans every wordlist in a directory, or matched by a glob,
+     * with the targets, ciphers and filters given. */
+    if (argc - optind == 3 && strcmp(argv[optind], "batch") == 0)
+    {
+        if (phrases.nwords != 0 || substrings || text_phrases || incremental
+            || sort || targets.nearest > 0 || verify)
+        {
+            fprintf(stderr, "ERROR: batch can't be used with --pairs, "
+                            "--triples, --substrings, --phrases, "
+                            "--incremental, --sort, --unique, --nearest or "
+                            "--verify.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (has_min || has_max)
+            set_range(&targets, has_min ? min : LONG_MIN,
+                                has_max ? max : LONG_MAX);
+        sort_targets(&targets);
+
+        start_timer(&timer);
+        scan_batch(argv[optind + 1], argv[optind + 2], &targets,
+                   has_jobs ? nthreads : sysconf(_SC_NPROCESSORS_ONLN),
+                   show_progress, use_async, async_uring);
+        stats.scan_ns = elapsed_timer(timer);
+
+        if (show_stats)
+            print_stats(&stats);
+        exit(EXIT_SUCCESS);
+    }
+
+    /* Verifying doesn't save anything, so it doesn't need a savefile. */
+    if (argc - optind != 2 && !(verify && argc - optind == 1))
+        print_help();
+
+    start_timer(&timer);
+
+    if (strcmp(argv[optind], "-") == 0)
+    {
+        wordlist = stdin;
+        use_stream = true;
+    }
+    else
+    {
+        wordlist = openfs(argv[optind], "r");
+    }
+
+    if (verify)
+    {
+        bool ok = verify_simd(wordlist) == 0;
+        closefs(wordlist);
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* Compressed wordlists, and wordlists that can't be mapped like pipes,
+     * are streamed through the source, which has detected their format. */
+    source = open_source(fileno(wordlist));
+    total = 0;
+    if (source_compressed(source) || fstat(fileno(wordlist), &st) != 0
+        || !S_ISREG(st.st_mode))
+        use_stream = true;
+    else
+        total = st.st_size;
+
+    if (has_min || has_max)
+    {
+        if (targets.nearest > 0)
+        {
+            fprintf(stderr, "ERROR: --nearest can't be used with --min or "
+                            "--max.\n");
+            exit(EXIT_FAILURE);
+        }
+        set_range(&targets, has_min ? min : LONG_MIN,
+                            has_max ? max : LONG_MAX);
+    }
+
+    /* Phrases are made from buckets of words with exact sums. */
+    if (phrases.nwords != 0 && (targets.range || targets.nearest > 0
+        || targets.minlen > 0 || targets.maxlen < SIZE_MAX))
+    {
+        fprintf(stderr, "ERROR: --pairs and --triples can't be used with "
+                        "--min, --max, --nearest or the length filters.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Substrings of the text are found with sliding windows over exact
+     * sums of bytes. */
+    if (substrings)
+    {
+        if (phrases.nwords != 0 || targets.range || targets.nearest > 0)
+        {
+            fprintf(stderr, "ERROR: --substrings can't be used with --pairs, "
+                            "--triples, --min, --max or --nearest.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (c = 0; c < targets.nciphers; c++)
+        {
+            if (!text_cipher(targets.ciphers[c]))
+            {
+                fprintf(stderr, "ERROR: --substrings can't be used with the "
+                                "%s cipher, which decodes UTF-8.\n",
+                        targets.ciphers[c]->name);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    /* Phrases of the text are found with a sliding window over exact sums
+     * of words. */
+    if (text_phrases)
+    {
+        if (substrings || phrases.nwords != 0 || targets.range
+            || targets.nearest > 0 || targets.minlen > 0
+            || targets.maxlen < SIZE_MAX)
+        {
+            fprintf(stderr, "ERROR: --phrases can't be used with "
+                            "--substrings, --whole-words, --pairs, --triples, "
+                            "--min, --max, --nearest or the length filters.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (text.maxwords == 0)
+            text.maxwords = TEXT_MAX_WORDS;
+        if (space && !has_sep)
+            text.sep = SEPARATORS_SPACE;
+    }
+
+    sort_targets(&targets);
+
+    if (incremental)
+    {
+        if (phrases.nwords != 0 || substrings || text_phrases)
+        {
+            fprintf(stderr, "ERROR: --incremental can't be used with "
+                            "--pairs, --triples, --substrings or --phrases.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (source_compressed(source))
+        {
+            fprintf(stderr, "ERROR: --incremental needs an uncompressed "
+                            "wordlist.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (sort || targets.nearest > 0)
+        {
+            fprintf(stderr, "ERROR: --incremental can't be used with "
+                            "--sort, --unique or --nearest.\n");
+            exit(EXIT_FAILURE);
+        }
+        begin_incremental(&inc, wordlist, &targets, argv[optind + 1]);
+    }
+
+    open_targets(&targets, argv[optind + 1], quiet,
+                 incremental && inc.resume > 0);
+
+    if (sort)
+        sort_savefiles(&targets, unique, sort_mb << 20);
+    if (targets.nearest > 0)
+        open_nearest(&targets);
+
+    stats.open_ns = elapsed_timer(timer);
+    start_timer(&timer);
+
+    phrases.nthreads = nthreads;
+    text.nthreads = nthreads;
+    text.minlen = targets.minlen;
+    text.maxlen = targets.maxlen;
+
+    /* Phrases are found in buckets of words, and substrings and phrases of
+     * running text in the whole text, not by scanning the wordlist a line at
+     * a time, so they don't have a progress line. */
+    if (show_progress && phrases.nwords == 0 && !substrings && !text_phrases)
+        progress = start_progress(incremental ? inc.len - inc.resume : total);
+
+    if (phrases.nwords != 0)
+        scan_phrases(wordlist, source, &targets, &phrases, space);
+    else if (substrings || text_phrases)
+        scan_text(wordlist, source, &targets, &text);
+    else if (incremental)
+        scan_incremental(&inc, &targets);
+    else if (use_stream)
+        scan_stream(source, &targets);
+    else if (use_async)
+        scan_async(wordlist, &targets, async_uring);
+    else if (nthreads > 1 && targets.near == NULL)
+        scan_threads(wordlist, &targets, nthreads);
+    else if (use_simd || !targets.ascii || targets.near != NULL)
+        scan_simd(wordlist, &targets);
+    else if (use_mmap)
+        scan_mmap(wordlist, &targets);
+    else
+        scan_lines(wordlist, &targets);
+
+    if (progress != NULL)
+        stop_progress(progress);
+
+    close_source(source);
+    closefs(wordlist);
+    close_targets(&targets);
+
+    if (incremental)
+        end_incremental(&inc);
+
+    /* Time spent writing while scanning isn't counted as scanning. */
+    scan_ns = elapsed_timer(timer);
+    stats.scan_ns = scan_ns > stats.write_ns ? scan_ns - stats.write_ns : 0;
+
+    if (show_stats)
+        print_stats(&stats);
 
     exit(EXIT_SUCCESS);
 }
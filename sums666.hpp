@@ -0,0 +1,215 @@
+/**
+ * sums666.hpp
+ *
+ * This file contains a thin C++17 wrapper around libsums666. A scanner owns a
+ * sums666_scanner, and scanning a buffer returns a range of the words in it
+ * that sum to a target, as std::string_views into the buffer. The words are
+ * found a batch at a time as the range is iterated:
+ *
+ *     sums666::scanner s({ 616, 666 }, "ordinal");
+ *     for (const sums666::match& m : s.scan(buffer))
+ *         std::cout << m.word << ' ' << m.sum << '\n';
+ *
+ * The buffer must outlive the range and the matches.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef SUMS666_HPP
+#define SUMS666_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "libsums666.h"
+
+namespace sums666 {
+
+/**
+ * This is a word that sums to a target.
+ */
+struct match {
+    std::string_view word;      // The word, without its newline.
+    std::size_t offset;         // Offset of the word in the buffer.
+    std::int64_t sum;           // Sum of the word.
+};
+
+/**
+ * This is the range of the words in a buffer that sum to a target.
+ */
+class matches {
+public:
+    /**
+     * This is the end of a range.
+     */
+    struct sentinel {};
+
+    /**
+     * This is an input iterator over a range. Incrementing it past the end
+     * of its batch scans the next batch of the buffer.
+     */
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = match;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const match*;
+        using reference = const match&;
+
+        iterator() = default;
+
+        explicit iterator(const matches* range) : range_(range) { fill(); }
+
+        reference operator*() const { return current_; }
+        pointer operator->() const { return &current_; }
+
+        iterator& operator++()
+        {
+            if (++index_ == count_)
+                fill();
+            else
+                load();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(sentinel) const { return count_ == 0; }
+        bool operator!=(sentinel) const { return count_ != 0; }
+
+    private:
+        /**
+         * This function scans the next batch of the buffer.
+         */
+        void fill()
+        {
+            std::string_view buf = range_->buf_;
+            std::size_t used = 0;
+
+            index_ = 0;
+            count_ = sums666_matches(range_->s_, buf.data() + pos_,
+                                     buf.size() - pos_, range_->final_,
+                                     batch_.data(), batch_.size(), &used);
+            base_ = pos_;
+            pos_ += used;
+            load();
+        }
+
+        /**
+         * This function makes the current match from the batch.
+         */
+        void load()
+        {
+            if (index_ < count_)
+            {
+                const sums666_match& m = batch_[index_];
+                current_ = { range_->buf_.substr(base_ + m.off, m.len),
+                             base_ + m.off, m.sum };
+            }
+        }
+
+        const matches* range_ = nullptr;
+        std::array<sums666_match, 256> batch_ {};
+        std::size_t index_ = 0;     // Index of the current match in batch_.
+        std::size_t count_ = 0;     // Number of matches in batch_.
+        std::size_t base_ = 0;      // Offset of the batch in the buffer.
+        std::size_t pos_ = 0;       // Offset of the next batch.
+        match current_ {};
+    };
+
+    matches(sums666_scanner* s, std::string_view buf, bool final)
+        : s_(s), buf_(buf), final_(final) {}
+
+    iterator begin() const { return iterator(this); }
+    sentinel end() const { return {}; }
+
+private:
+    sums666_scanner* s_;
+    std::string_view buf_;
+    bool final_;
+};
+
+/**
+ * This is a scanner. It can be used by one thread at a time.
+ */
+class scanner {
+public:
+    /**
+     * This constructor makes a scanner for the targets provided to it under
+     * the built-in cipher with the name provided to it. It throws
+     * std::invalid_argument if there are no targets or no such cipher.
+     */
+    scanner(const std::vector<long>& targets, const char* cipher = "ascii")
+        : s_(sums666_open(targets.data(), targets.size(), cipher))
+    {
+        if (s_ == nullptr)
+            throw std::invalid_argument("sums666: bad targets or cipher");
+    }
+
+    scanner(std::initializer_list<long> targets, const char* cipher = "ascii")
+        : scanner(std::vector<long>(targets), cipher) {}
+
+    /**
+     * This constructor makes a scanner whose cipher gives byte b the value
+     * values[b].
+     */
+    scanner(const std::vector<long>& targets,
+            const std::array<std::int32_t, 256>& values)
+        : s_(sums666_open_values(targets.data(), targets.size(),
+                                 values.data()))
+    {
+        if (s_ == nullptr)
+            throw std::invalid_argument("sums666: bad targets");
+    }
+
+    scanner(const scanner&) = delete;
+    scanner& operator=(const scanner&) = delete;
+
+    scanner(scanner&& other) noexcept : s_(std::exchange(other.s_, nullptr)) {}
+
+    scanner& operator=(scanner&& other) noexcept
+    {
+        std::swap(s_, other.s_);
+        return *this;
+    }
+
+    ~scanner() { sums666_close(s_); }
+
+    /**
+     * This function returns the range of the words in buf that sum to a
+     * target. If final is false, the bytes after the last newline are left
+     * out, so a buffer that ends part way through a word can be scanned.
+     */
+    matches scan(std::string_view buf, bool final = true) const
+    {
+        return matches(s_, buf, final);
+    }
+
+    /**
+     * This function returns the sum of a word under the scanner's cipher.
+     */
+    std::int64_t sum(std::string_view word) const
+    {
+        return sums666_sum(s_, word.data(), word.size());
+    }
+
+    /**
+     * This function returns the underlying C scanner.
+     */
+    sums666_scanner* get() const { return s_; }
+
+private:
+    sums666_scanner* s_;
+};
+
+} // namespace sums666
+
+#endif // SUMS666_HPP
@@ -0,0 +1,532 @@
+/**
+ * text.c
+ *
+ * This file contains the definitions of the functions that search running
+ * text for substrings and phrases of consecutive words whose sum is a target.
+ *
+ * Inside a line, every byte that a substring can hold is worth nothing or
+ * more, so the sum of a window of bytes only grows as its end moves right
+ * and only shrinks as its start moves right. Each end of the window has at
+ * most one start whose window sums to the target, which a window whose
+ * start and end only ever move right finds while touching each byte twice.
+ *
+ * The text is split into chunks that are searched by their own threads. The
+ * substrings found by a chunk are the ones that end in it, so a chunk's
+ * window starts by backing up over the bytes before the chunk that a
+ * substring ending in it might hold, which are the ones on the same line
+ * whose sum isn't already over the target.
+ *
+ * Phrases are found a word at a time instead of a byte at a time. Each
+ * word's key is the sum of the text before it, so a phrase's sum is the sum
+ * of the text up to the end of its last word less its first word's key. The
+ * keys of the last few words are kept in a hash table, so the phrases that
+ * end at a word are found with one lookup, however many words they have,
+ * and each word is touched a fixed number of times. Chunks back up over the
+ * words before them that a phrase ending in them might hold.
+ *
+ * Author: Richard Gale
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "mycutils.h"
+#include "cipher.h"
+#include "text.h"
+
+/**
+ * This is the number of bytes of text in each chunk.
+ */
+#define TEXT_CHUNK (1 << 20)
+
+/**
+ * This is the smallest number of buckets of the hash table of words' keys.
+ */
+#define TEXT_MIN_BUCKETS 64
+
+/**
+ * These are the substrings or phrases found in one chunk of the text.
+ */
+struct result {
+    char* buf;          /* The results, one per line. */
+    size_t len;         /* Number of bytes of results. */
+    size_t cap;         /* Number of bytes allocated. */
+    uint64_t count;     /* Number of results. */
+    bool done;          /* Whether the chunk has been searched. */
+};
+
+/**
+ * This is one word of the text that a phrase might start or end with.
+ */
+struct token {
+    size_t off;     /* Offset of the word in the text. */
+    size_t len;     /* Length of the word. */
+    long key;       /* Sum of the text before the word, without the separator
+                     * just before it. */
+    size_t next;    /* One more than the index of the last word before it
+                     * with a key in the same bucket, or 0 if there is none. */
+};
+
+struct search;
+
+/**
+ * This is the type of the functions that search one chunk of the text.
+ */
+typedef void (*chunk_fn)(struct search* s, size_t i, struct result* r);
+
+/**
+ * This is the state of a search that is shared by its threads.
+ */
+struct search {
+    const char* buf;                /* The text. */
+    size_t len;                     /* Length of the text. */
+    const struct cipher* c;         /* The cipher. */
+    const int32_t* values;          /* Value of each byte. */
+    long target;                    /* The sum to search for. */
+    const struct text_opts* opts;   /* The settings of the search. */
+    struct result* results;         /* The results of each chunk. */
+    size_t nchunks;                 /* Number of chunks. */
+    chunk_fn search;                /* Searches a chunk. */
+    atomic_size_t next;             /* The next chunk to search. */
+    pthread_mutex_t lock;           /* Protects the results' done flags. */
+    pthread_cond_t cond;            /* Signalled when a chunk is done. */
+};
+
+/**
+ * This function prints an error message and exits the program.
+ */
+static void text_error(const char* func, int err)
+{
+    char* tstamp;   /* A time stamp. */
+
+    fprintf(stderr, "[ %s ] ERROR: In function %s(): %s\n",
+            (tstamp = timestamp()), func, strerror(err));
+
+    free(tstamp);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * This function returns true if a substring can't hold the byte provided to
+ * it, either because it breaks a line or because it is worth less than
+ * nothing.
+ */
+static inline bool is_break(const int32_t* values, unsigned char b)
+{
+    return b == '\n' || b == '\r' || values[b] < 0;
+}
+
+/**
+ * This function returns true if the byte provided to it is part of a word.
+ * Words are made of ascii letters, digits and underscores, and the bytes of
+ * UTF-8 chars.
+ */
+static inline bool is_word_byte(unsigned char b)
+{
+    return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z')
+        || (b >= '0' && b <= '9') || b == '_' || b >= 0x80;
+}
+
+/**
+ * This function returns true if the len bytes at off in the text are a
+ * whole word or words, i.e. they start at the start of a word and end at
+ * the end of one.
+ */
+static inline bool is_bounded(const struct search* s, size_t off, size_t len)
+{
+    const unsigned char* t = (const unsigned char*) s->buf;
+
+    return is_word_byte(t[off]) && is_word_byte(t[off + len - 1])
+        && (off == 0 || !is_word_byte(t[off - 1]))
+        && (off + len == s->len || !is_word_byte(t[off + len]));
+}
+
+/**
+ * This function returns true if the byte cipher provided to it can be used
+ * by find_substrings().
+ */
+bool text_cipher(const struct cipher* c)
+{
+    return c->cp == NULL && !c->unicode;
+}
+
+/**
+ * This function makes room for a result of len bytes, after its offset off
+ * and a tab, at the end of the result's buffer. It returns where the rest of
+ * the result goes.
+ */
+static char* add_result(struct result* r, size_t off, size_t len)
+{
+    char num[32];   /* The offset and the tab. */
+    int n;          /* Length of the offset and the tab. */
+    char* at;       /* Where the rest of the result goes. */
+
+    n = snprintf(num, sizeof(num), "%zu\t", off);
+
+    if (r->len + n + len > r->cap)
+    {
+        r->cap = r->cap * 2 > r->len + n + len ? r->cap * 2
+                                                : r->len + n + len + 4096;
+        if ((r->buf = realloc(r->buf, r->cap)) == NULL)
+            text_error("add_result", errno);
+    }
+
+    memcpy(r->buf + r->len, num, n);
+    at = r->buf + r->len + n;
+    r->len += n + len;
+    r->count++;
+
+    return at;
+}
+
+/**
+ * This function adds the len byte substring at off in the text to the
+ * result.
+ */
+static void add_substring(const struct search* s, struct result* r,
+                          size_t off, size_t len)
+{
+    char* at = add_result(r, off, len + 1);
+
+    memcpy(at, s->buf + off, len);
+    at[len] = '\n';
+}
+
+/**
+ * This function adds the phrase of words first to last to the result, with
+ * its words separated by spaces.
+ */
+static void add_phrase(const struct search* s, struct result* r,
+                       const struct token* first, const struct token* last)
+{
+    const struct token* w;  /* The current word. */
+    size_t len;             /* Length of the phrase and its newline. */
+    char* at;               /* Where the next word goes. */
+
+    for (len = 0, w = first; w <= last; w++)
+        len += w->len + 1;
+
+    at = add_result(r, first->off, len);
+    for (w = first; w <= last; w++)
+    {
+        memcpy(at, s->buf + w->off, w->len);
+        at += w->len;
+        *at++ = w < last ? ' ' : '\n';
+    }
+}
+
+/**
+ * This function finds the substrings that end in chunk i.
+ */
+static void search_chunk(struct search* s, size_t i, struct result* r)
+{
+    const unsigned char* t = (const unsigned char*) s->buf;
+    const int32_t* v = s->values;
+    size_t start;   /* Offset of the start of the chunk. */
+    size_t end;     /* Offset of the end of the chunk. */
+    size_t from;    /* Offset the window starts from. */
+    size_t lo;      /* Offset of the start of the window. */
+    size_t hi;      /* Offset of the end of the window. */
+    size_t len;     /* Length of the window. */
+    long sum;       /* Sum of the window. */
+
+    start = i * TEXT_CHUNK;
+    end = start + TEXT_CHUNK < s->len ? start + TEXT_CHUNK : s->len;
+
+    /* A substring that ends in the chunk can't start before a line break or
+     * hold bytes before the chunk that already sum to over the target. */
+    sum = 0;
+    for (from = start; from > 0 && !is_break(v, t[from - 1])
+                       && sum + v[t[from - 1]] <= s->target; from--)
+        sum += v[t[from - 1]];
+
+    sum = 0;
+    for (lo = hi = from; hi < end; hi++)
+    {
+        if (is_break(v, t[hi]))
+        {
+            lo = hi + 1;
+            sum = 0;
+            continue;
+        }
+
+        /* Moving the start of the window until it sums to no more than the
+         * target and starts with a byte that is worth something. */
+        sum += v[t[hi]];
+        while (sum > s->target)
+            sum -= v[t[lo++]];
+        while (lo <= hi && v[t[lo]] == 0)
+            lo++;
+
+        if (hi < start || sum != s->target || lo > hi || v[t[hi]] == 0)
+            continue;
+
+        len = hi - lo + 1;
+        if (len < s->opts->minlen || len > s->opts->maxlen)
+            continue;
+        if (s->opts->bounded && !is_bounded(s, lo, len))
+            continue;
+
+        add_substring(s, r, lo, len);
+    }
+}
+
+/**
+ * This function is run by each search thread. It takes chunks in order until
+ * there are none left and searches them.
+ */
+static void* search_worker(void* arg)
+{
+    struct search* s = arg;
+    size_t i;   /* The chunk being searched. */
+
+    while ((i = atomic_fetch_add(&s->next, 1)) < s->nchunks)
+    {
+        s->search(s, i, &s->results[i]);
+
+        pthread_mutex_lock(&s->lock);
+        s->results[i].done = true;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * This function hashes the key provided to it into one of nbuckets buckets,
+ * which is a power of two.
+ */
+static inline size_t hash_key(long key, size_t nbuckets)
+{
+    return ((uint64_t) key * 0x9E3779B97F4A7C15ULL >> 32) & (nbuckets - 1);
+}
+
+/**
+ * This function returns the sum of each separator between two words.
+ */
+static long separator_sum(const struct search* s, size_t off, size_t len)
+{
+    switch (s->opts->sep)
+    {
+        case SEPARATORS_SPACE:
+            return cipher_sum(s->c, " ", 1);
+        case SEPARATORS_TEXT:
+            return cipher_sum(s->c, s->buf + off, len);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * This function finds the phrases whose last word starts in chunk i.
+ */
+static void search_phrases(struct search* s, size_t i, struct result* r)
+{
+    const unsigned char* t = (const unsigned char*) s->buf;
+    size_t maxwords = s->opts->maxwords;
+    struct token* words;    /* The words of the chunk and those before it. */
+    size_t nwords;          /* Number of words. */
+    size_t cap;             /* Number of words allocated. */
+    size_t* heads;          /* One more than the index of the last word with
+                             * a key in each bucket, or 0. */
+    size_t nbuckets;        /* Number of buckets. */
+    size_t start;           /* Offset of the start of the chunk. */
+    size_t end;             /* Offset of the end of the chunk. */
+    size_t first;           /* Offset of the first word that starts in it. */
+    size_t from;            /* Offset the words are read from. */
+    size_t pos;             /* Offset of the current byte. */
+    size_t sep;             /* Offset of the separator before the word. */
+    size_t lowest;          /* Index of the first word a phrase can start at. */
+    size_t j;               /* Index of a word in the current bucket. */
+    size_t k;               /* Number of words backed up over. */
+    size_t h;               /* The current bucket. */
+    long want;              /* The key of the first word of a phrase. */
+    long sum;               /* Sum of the text up to the last word. */
+    struct token* w;        /* The current word. */
+
+    start = i * TEXT_CHUNK;
+    end = start + TEXT_CHUNK < s->len ? start + TEXT_CHUNK : s->len;
+
+    /* A word that the chunk starts part way through belongs to the chunk
+     * before it. */
+    for (first = start; first > 0 && first < s->len && is_word_byte(t[first])
+                        && is_word_byte(t[first - 1]); first++)
+        ;
+
+    /* Backing up over the words that can start a phrase whose last word
+     * starts in the chunk. */
+    from = first;
+    for (k = 1; k < maxwords && from > 0; k++)
+    {
+        while (from > 0 && !is_word_byte(t[from - 1]))
+            from--;
+        while (from > 0 && is_word_byte(t[from - 1]))
+            from--;
+    }
+
+    for (nbuckets = TEXT_MIN_BUCKETS; nbuckets < maxwords * 2; nbuckets *= 2)
+        ;
+    cap = 4096;
+    words = malloc(sizeof(struct token) * cap);
+    heads = calloc(nbuckets, sizeof(size_t));
+    if (words == NULL || heads == NULL)
+        text_error("search_phrases", errno);
+
+    sum = 0;
+    for (nwords = 0, pos = from; ; nwords++)
+    {
+        for (sep = pos; pos < s->len && !is_word_byte(t[pos]); pos++)
+            ;
+        if (pos >= end)
+            break;
+
+        if (nwords == cap)
+        {
+            cap *= 2;
+            if ((words = realloc(words, sizeof(struct token) * cap)) == NULL)
+                text_error("search_phrases", errno);
+        }
+
+        /* Reading the word. The separator before the first word read isn't
+         * part of any phrase that is found. */
+        w = &words[nwords];
+        w->off = pos;
+        while (pos < s->len && is_word_byte(t[pos]))
+            pos++;
+        w->len = pos - w->off;
+        w->key = nwords == 0 ? sum : sum + separator_sum(s, sep, w->off - sep);
+        sum = w->key + cipher_sum(s->c, s->buf + w->off, w->len);
+
+        h = hash_key(w->key, nbuckets);
+        w->next = heads[h];
+        heads[h] = nwords + 1;
+
+        if (w->off < first)
+            continue;
+
+        /* The phrases that end with the word start with the words before it
+         * whose key is the sum of the text up to it less the target. The
+         * bucket holds the latest words first, so they are found shortest
+         * first, and older words are too far back to start a phrase. */
+        want = sum - s->target;
+        lowest = nwords + 1 >= maxwords ? nwords + 1 - maxwords : 0;
+        for (j = heads[hash_key(want, nbuckets)]; j > lowest; j = words[j - 1].next)
+        {
+            if (words[j - 1].key == want)
+                add_phrase(s, r, &words[j - 1], w);
+        }
+    }
+
+    free(heads);
+    free(words);
+}
+
+/**
+ * This function searches every chunk of the text with s->search and calls
+ * save for each chunk's results. The chunks are searched by opts->nthreads
+ * threads while this thread saves the results of each chunk, in order, as
+ * soon as it is done. It returns the number of results.
+ */
+static uint64_t search_text(struct search* s, text_fn save, void* arg)
+{
+    pthread_t* threads;     /* The search threads. */
+    unsigned nthreads;      /* Number of search threads. */
+    uint64_t found;         /* Number of results found. */
+    size_t i;               /* Index of the current thread or chunk. */
+    int err;                /* Error returned by pthread_create(). */
+
+    s->nchunks = (s->len + TEXT_CHUNK - 1) / TEXT_CHUNK;
+    atomic_init(&s->next, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    nthreads = s->opts->nthreads > 0 ? s->opts->nthreads : 1;
+    if (nthreads > s->nchunks)
+        nthreads = s->nchunks > 0 ? s->nchunks : 1;
+    s->results = calloc(s->nchunks + 1, sizeof(struct result));
+    threads = malloc(sizeof(pthread_t) * nthreads);
+    if (s->results == NULL || threads == NULL)
+        text_error("search_text", errno);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        if ((err = pthread_create(&threads[i], NULL, search_worker, s)) != 0)
+            text_error("search_text", err);
+    }
+
+    /* Saving each chunk's results in order. */
+    found = 0;
+    for (i = 0; i < s->nchunks; i++)
+    {
+        pthread_mutex_lock(&s->lock);
+        while (!s->results[i].done)
+            pthread_cond_wait(&s->cond, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+
+        if (s->results[i].len > 0)
+            save(s->results[i].buf, s->results[i].len, arg);
+
+        found += s->results[i].count;
+        free(s->results[i].buf);
+    }
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->results);
+    free(threads);
+
+    return found;
+}
+
+/**
+ * This function finds every substring of the text whose sum is target.
+ */
+uint64_t find_substrings(const char* buf, size_t len, const struct cipher* c,
+                         long target, const struct text_opts* opts,
+                         text_fn save, void* arg)
+{
+    struct search s;    /* The state of the search. */
+
+    /* Every substring holds a byte that is worth something, and nothing it
+     * holds is worth less than nothing. */
+    if (target < 1)
+        return 0;
+
+    s.buf = buf;
+    s.len = len;
+    s.c = c;
+    s.values = c->bytes;
+    s.target = target;
+    s.opts = opts;
+    s.search = search_chunk;
+
+    return search_text(&s, save, arg);
+}
+
+/**
+ * This function finds every phrase of consecutive words of the text whose
+ * sum is target.
+ */
+uint64_t find_phrases_text(const char* buf, size_t len, const struct cipher* c,
+                           long target, const struct text_opts* opts,
+                           text_fn save, void* arg)
+{
+    struct search s;    /* The state of the search. */
+
+    if (opts->maxwords == 0)
+        return 0;
+
+    s.buf = buf;
+    s.len = len;
+    s.c = c;
+    s.values = c->bytes;
+    s.target = target;
+    s.opts = opts;
+    s.search = search_phrases;
+
+    return search_text(&s, save, arg);
+}
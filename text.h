@@ -0,0 +1,92 @@
+/**
+ * text.h
+ *
+ * This file contains the public data-structures and function prototype
+ * declarations for searching running text, such as a book or a log file,
+ * instead of a wordlist with one word per line, for substrings or phrases of
+ * consecutive words that sum to a target.
+ *
+ * Author: Richard Gale
+ */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cipher.h"
+
+/**
+ * This is the default number of words in the longest phrase that
+ * find_phrases_text() finds.
+ */
+#define TEXT_MAX_WORDS 8
+
+/**
+ * These are the ways the separators between the words of a phrase can count
+ * towards its sum.
+ */
+enum separators {
+    SEPARATORS_NONE,    /* They count nothing. */
+    SEPARATORS_SPACE,   /* Each one counts as a single space. */
+    SEPARATORS_TEXT     /* Each one counts as the bytes it is made of. */
+};
+
+/**
+ * These are the settings of a text search.
+ */
+struct text_opts {
+    bool bounded;       /* Whether substrings must be whole words. */
+    size_t minlen;      /* Length of the shortest substring that is saved. */
+    size_t maxlen;      /* Length of the longest substring that is saved. */
+    size_t maxwords;    /* Most words in a phrase, or 0 for substrings. */
+    enum separators sep;    /* How separators count towards a phrase. */
+    unsigned nthreads;  /* Number of threads that search. */
+};
+
+/**
+ * This is the type of the functions that are given the substrings that are
+ * found. They are given one or more whole results at a time, each one being
+ * the byte offset of the substring in the text, a tab, the substring and a
+ * newline.
+ */
+typedef void (*text_fn)(const char* results, size_t len, void* arg);
+
+/**
+ * This function returns true if the byte cipher provided to it can be used
+ * by find_substrings(). Ciphers that decode UTF-8 can't.
+ */
+bool text_cipher(const struct cipher* c);
+
+/**
+ * This function finds every substring of the text in buf whose sum under the
+ * cipher provided to it is target and gives them to save, in the order they
+ * end in the text, no matter how many threads search. A substring never
+ * spans a line break, never holds a byte with a negative value (bytes over
+ * 127 under the ascii cipher) and never starts or ends with a byte that is
+ * worth nothing. If opts->bounded is true, only substrings that start at
+ * the start of a word and end at the end of a word are found. It returns the
+ * number of substrings found. If an error occurs the program will exit.
+ */
+uint64_t find_substrings(const char* buf, size_t len, const struct cipher* c,
+                         long target, const struct text_opts* opts,
+                         text_fn save, void* arg);
+
+/**
+ * This function finds every phrase of one to opts->maxwords consecutive
+ * words of the text in buf whose sum under the cipher provided to it is
+ * target and gives them to save, in the order they end in the text, with
+ * the shortest first, no matter how many threads search. Words are runs of
+ * ascii letters, digits, underscores and the bytes of UTF-8 chars, and
+ * everything between them is a separator, which counts towards the sum as
+ * opts->sep says. Each result is the byte offset of the phrase's first word,
+ * a tab and its words separated by spaces. It returns the number of phrases
+ * found. If an error occurs the program will exit.
+ */
+uint64_t find_phrases_text(const char* buf, size_t len, const struct cipher* c,
+                           long target, const struct text_opts* opts,
+                           text_fn save, void* arg);
+
+#endif // TEXT_H